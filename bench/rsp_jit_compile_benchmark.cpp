@@ -0,0 +1,109 @@
+// Times the RSP recompiler on a fixed set of blocks, so that a change to the emitters can be measured against the
+// build before it. IMEM is filled with a synthetic microcode: a straight run of scalar, load/store and vector
+// instructions in a repeating mix, ended by a BREAK. Each pass compiles all of its blocks from an empty code cache.
+
+#include "n64.hpp"
+#include "numtypes.hpp"
+#include "rsp/recompiler.hpp"
+#include "rsp/rsp.hpp"
+#include "status.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+#include <print>
+#include <vector>
+
+using namespace n64;
+
+constexpr int num_passes = 100;
+constexpr u32 break_instr = 0x0D;
+
+static u32 IType(u32 op, u32 rs, u32 rt, u32 imm)
+{
+    return op << 26 | rs << 21 | rt << 16 | (imm & 0xFFFF);
+}
+
+static u32 RType(u32 rs, u32 rt, u32 rd, u32 sa, u32 funct)
+{
+    return rs << 21 | rt << 16 | rd << 11 | sa << 6 | funct;
+}
+
+static u32 VuLoadStore(u32 op, u32 base, u32 vt, u32 element, u32 offset)
+{
+    constexpr u32 quad = 4; // LQV/SQV
+    return op << 26 | base << 21 | vt << 16 | quad << 11 | element << 7 | (offset & 0x7F);
+}
+
+static u32 VuOp(u32 element, u32 vt, u32 vs, u32 vd, u32 funct)
+{
+    return 0x4A00'0000 | element << 21 | vt << 16 | vs << 11 | vd << 6 | funct;
+}
+
+// Registers rotate with the index, so that the register allocator sees a realistic spread of them
+static u32 MakeInstruction(u32 index)
+{
+    u32 r = 1 + index % 29; // $1 - $29, with r + 2 still below $31
+    u32 v = index % 32;
+    switch (index % 12) {
+    case 0: return IType(0x09, r + 1, r, index); // ADDIU
+    case 1: return RType(r + 1, r + 2, r, 0, 0x21); // ADDU
+    case 2: return IType(0x23, 0, r, index * 4 & 0xFFC); // LW
+    case 3: return VuOp(0, (v + 2) % 32, (v + 1) % 32, v, 0x00); // VMULF
+    case 4: return RType(0, r + 1, r, index % 32, 0x00); // SLL
+    case 5: return VuOp(8 + index % 8, (v + 2) % 32, (v + 1) % 32, v, 0x08); // VMACF
+    case 6: return RType(r + 1, r + 2, r, 0, 0x24); // AND
+    case 7: return VuLoadStore(0x32, 0, v, 0, index); // LQV
+    case 8: return VuOp(0, (v + 2) % 32, (v + 1) % 32, v, 0x10); // VADD
+    case 9: return IType(0x2B, 0, r, index * 4 & 0xFFC); // SW
+    case 10: return VuOp(0, (v + 2) % 32, (v + 1) % 32, v, 0x0F); // VMADH
+    default: return VuLoadStore(0x3A, 0, v, 0, index); // SQV
+    }
+}
+
+static void LoadMicrocode()
+{
+    for (u32 i = 0; i < 0x400; ++i) {
+        u32 instr = std::byteswap(i == 0x3FF ? break_instr : MakeInstruction(i)); // rsp ram BE
+        std::memcpy(rsp::imem + 4 * i, &instr, 4);
+    }
+}
+
+int main()
+{
+    rsp::PowerOn();
+    LoadMicrocode();
+    rsp::cpu_impl = CpuImpl::Recompiler;
+
+    std::vector<double> ns_per_instr;
+    u64 blocks_per_pass = 0, instrs_per_pass = 0;
+    for (int pass = 0; pass < num_passes; ++pass) {
+        rsp::TearDownRecompiler();
+        rsp::recompiler_stats = {};
+        if (Status status = rsp::InitRecompiler(); !status.Ok()) {
+            std::println(stderr, "Failed to initialize the RSP recompiler: {}", status.Message());
+            return EXIT_FAILURE;
+        }
+        rsp::pc = 0;
+        rsp::sp.status.halted = false;
+        rsp::RunRecompiler(1'000'000); // runs up to the BREAK, compiling each block on its first visit
+        if (!rsp::sp.status.halted) {
+            std::println(stderr, "The benchmark microcode did not reach its BREAK");
+            return EXIT_FAILURE;
+        }
+        blocks_per_pass = rsp::recompiler_stats.compiled_blocks;
+        instrs_per_pass = rsp::recompiler_stats.compiled_instrs;
+        ns_per_instr.push_back(double(rsp::recompiler_stats.compile_time_total_ns) / double(instrs_per_pass));
+    }
+    rsp::TearDownRecompiler();
+
+    std::ranges::sort(ns_per_instr);
+    std::println("RSP recompiler: {} blocks of {} instructions per pass, {} passes", blocks_per_pass, instrs_per_pass,
+      num_passes);
+    std::println("Compile time per instruction: min {:.1f} ns, median {:.1f} ns, max {:.1f} ns",
+      ns_per_instr.front(),
+      ns_per_instr[ns_per_instr.size() / 2],
+      ns_per_instr.back());
+    return EXIT_SUCCESS;
+}
@@ -4,5 +4,7 @@ union CoreConfiguration {
     struct {
         bool use_cpu_recompiler;
         bool use_rsp_recompiler;
+        bool skip_idle_loops;
+        bool hle_graphics;
     } n64;
 };
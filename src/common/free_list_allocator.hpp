@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "log.hpp"
+#include "numtypes.hpp"
+
+// Hands out objects of type T carved out of fixed-size slabs. Released objects are put on a free list and handed out
+// again before any new slab memory is used, so that memory use stays bounded by the peak number of live objects.
+template<typename T>
+    requires(std::is_default_constructible_v<T> && std::is_trivially_destructible_v<T>)
+class FreeListAllocator {
+    std::vector<std::unique_ptr<T[]>> slabs_;
+    std::vector<T*> free_list_;
+    size_t objects_per_slab_;
+    size_t max_slabs_;
+    size_t num_slabs_used_;
+    size_t next_in_slab_;
+    bool out_of_memory_;
+
+public:
+    FreeListAllocator(size_t size = 0, size_t slab_size = 64_KiB)
+      : slabs_{},
+        free_list_{},
+        objects_per_slab_{},
+        max_slabs_{},
+        num_slabs_used_{},
+        next_in_slab_{},
+        out_of_memory_{}
+    {
+        allocate(size, slab_size);
+    }
+
+    T* acquire()
+    {
+        if (!free_list_.empty()) {
+            T* obj = free_list_.back();
+            free_list_.pop_back();
+            *obj = T{};
+            return obj;
+        }
+        if (num_slabs_used_ == 0 || next_in_slab_ == objects_per_slab_) {
+            if (num_slabs_used_ == max_slabs_) [[unlikely]] {
+                if (!std::exchange(out_of_memory_, true)) {
+                    LogWarn("Free list allocator ran out of memory ({} bytes)",
+                      max_slabs_ * objects_per_slab_ * sizeof(T));
+                }
+                return nullptr;
+            }
+            if (num_slabs_used_ == slabs_.size()) {
+                slabs_.push_back(std::make_unique<T[]>(objects_per_slab_));
+            }
+            num_slabs_used_++;
+            next_in_slab_ = 0;
+        }
+        T* obj = &slabs_[num_slabs_used_ - 1][next_in_slab_++];
+        *obj = T{};
+        return obj;
+    }
+
+    // 'size' is the maximum number of bytes that may be used for objects. Slabs are allocated lazily.
+    void allocate(size_t size, size_t slab_size = 64_KiB)
+    {
+        deallocate();
+        objects_per_slab_ = std::max(slab_size / sizeof(T), size_t(1));
+        max_slabs_ = size / (objects_per_slab_ * sizeof(T));
+    }
+
+    void deallocate()
+    {
+        slabs_ = {};
+        free_list_ = {};
+        num_slabs_used_ = next_in_slab_ = 0;
+        out_of_memory_ = false;
+    }
+
+    bool out_of_memory() const { return out_of_memory_; }
+
+    void release(T* obj)
+    {
+        assert(obj);
+        free_list_.push_back(obj);
+        out_of_memory_ = false;
+    }
+
+    // Releases all objects at once, keeping the slabs around for reuse.
+    void reset()
+    {
+        free_list_.clear();
+        num_slabs_used_ = next_in_slab_ = 0;
+        out_of_memory_ = false;
+    }
+};
@@ -0,0 +1,75 @@
+#include "jit_code_cache.hpp"
+#include "fatal_error.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+
+using namespace asmjit;
+
+void* JitCodeCache::add(CodeHolder& code)
+{
+    Error err = code.flatten();
+    if (!err) {
+        err = code.resolveUnresolvedLinks();
+    }
+    if (err) {
+        FATAL("Failed to prepare code for the code cache; returned {}", DebugUtils::errorAsString(err));
+    }
+    // Relocation can only shrink the code, e.g. if no address table entries turned out to be needed.
+    size_t estimated_size = code.codeSize();
+    if (estimated_size > available()) {
+        return nullptr;
+    }
+    u8* dst = base_ + used_;
+    err = code.relocateToBase(reinterpret_cast<u64>(dst));
+    if (err) {
+        FATAL("Failed to relocate code; returned {}", DebugUtils::errorAsString(err));
+    }
+    size_t code_size = code.codeSize();
+    {
+        VirtMem::ProtectJitReadWriteScope write_scope(dst, code_size);
+        code.copyFlattenedData(dst, code_size, CopySectionFlags::kPadSectionBuffer);
+    }
+    used_ = std::min(size_, used_ + (code_size + 15 & ~size_t(15)));
+    return dst;
+}
+
+void* JitCodeCache::add(std::span<u8 const> code)
+{
+    if (code.size() > available()) {
+        return nullptr;
+    }
+    u8* dst = base_ + used_;
+    {
+        VirtMem::ProtectJitReadWriteScope write_scope(dst, code.size());
+        std::memcpy(dst, code.data(), code.size());
+    }
+    used_ = std::min(size_, used_ + (code.size() + 15 & ~size_t(15)));
+    return dst;
+}
+
+Status JitCodeCache::allocate(size_t size)
+{
+    deallocate();
+    void* ptr;
+    Error err = VirtMem::alloc(&ptr, size, VirtMem::MemoryFlags::kAccessRWX);
+    if (err) {
+        return FailureStatus(std::format("Failed to allocate {} bytes of executable memory; returned {}",
+          size,
+          DebugUtils::errorAsString(err)));
+    }
+    base_ = static_cast<u8*>(ptr);
+    size_ = size;
+    used_ = 0;
+    return OkStatus();
+}
+
+void JitCodeCache::deallocate()
+{
+    if (base_) {
+        VirtMem::release(base_, size_);
+        base_ = nullptr;
+        size_ = used_ = 0;
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "asmjit/core.h"
+#include "numtypes.hpp"
+#include "status.hpp"
+
+#include <span>
+
+// A single contiguous region of executable memory, out of which compiled code is bump-allocated. Code is never freed
+// individually; once the region runs full, its owner flushes it as a whole. Keeping all code of a recompiler together
+// improves i-cache and iTLB locality, and guarantees that any two blocks are within reach of a rel32 jump.
+class JitCodeCache {
+    u8* base_{};
+    size_t size_{};
+    size_t used_{};
+
+public:
+    JitCodeCache() = default;
+    JitCodeCache(JitCodeCache const&) = delete;
+    JitCodeCache& operator=(JitCodeCache const&) = delete;
+    ~JitCodeCache() { deallocate(); }
+
+    // Returns nullptr if the code does not fit; the contents of the cache are left untouched in that case.
+    void* add(asmjit::CodeHolder& code);
+    // Adds code that has already been relocated, or that the caller relocates in place.
+    void* add(std::span<u8 const> code);
+    Status allocate(size_t size);
+    size_t available() const { return size_ - used_; }
+    u8* base() { return base_; }
+    u8 const* base() const { return base_; }
+    size_t capacity() const { return size_; }
+    void deallocate();
+    void flush() { used_ = 0; }
+    size_t used() const { return used_; }
+};
@@ -76,7 +76,7 @@ std::string HostRegToStr(asmjit::x86::Xmm reg)
     return std::format("xmm{}", reg.id());
 }
 
-void jit_call_no_stack_alignment(asmjit::x86::Compiler& c, void* func)
+void jit_call_no_stack_alignment(asmjit::x86::Assembler& c, void* func)
 {
     using namespace asmjit::x86;
     if constexpr (platform.abi.systemv) {
@@ -89,7 +89,7 @@ void jit_call_no_stack_alignment(asmjit::x86::Compiler& c, void* func)
     }
 }
 
-void jit_call_with_stack_alignment(asmjit::x86::Compiler& c, void* func)
+void jit_call_with_stack_alignment(asmjit::x86::Assembler& c, void* func)
 {
     using namespace asmjit::x86;
     if constexpr (platform.abi.systemv) {
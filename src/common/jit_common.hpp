@@ -13,7 +13,7 @@ using HostGpr32 = std::conditional_t<platform.x64, asmjit::x86::Gpd, asmjit::a64
 using HostGpr64 = std::conditional_t<platform.x64, asmjit::x86::Gpq, asmjit::a64::GpX>;
 using HostGpr128 = std::conditional_t<platform.x64, asmjit::x86::Xmm, asmjit::a64::VecV>;
 using HostVpr128 = std::conditional_t<platform.x64, asmjit::x86::Xmm, asmjit::a64::VecV>;
-using JitCompiler = std::conditional_t<platform.x64, asmjit::x86::Compiler, asmjit::a64::Compiler>;
+using JitAssembler = std::conditional_t<platform.x64, asmjit::x86::Assembler, asmjit::a64::Assembler>;
 
 struct AsmjitLogErrorHandler : public asmjit::ErrorHandler {
     void handleError(asmjit::Error err, char const* message, asmjit::BaseEmitter* /*origin*/) override;
@@ -45,8 +45,8 @@ inline constexpr std::array host_gpr_arg = [] {
     }
 }();
 
-void jit_call_no_stack_alignment(asmjit::x86::Compiler& c, void* func);
-void jit_call_with_stack_alignment(asmjit::x86::Compiler& c, void* func);
+void jit_call_no_stack_alignment(asmjit::x86::Assembler& c, void* func);
+void jit_call_with_stack_alignment(asmjit::x86::Assembler& c, void* func);
 [[gnu::const]] std::string HostRegToStr(HostGpr32 reg);
 [[gnu::const]] std::string HostRegToStr(HostGpr64 reg);
 [[gnu::const]] std::string HostRegToStr(HostGpr128 reg);
@@ -55,7 +55,7 @@ void jit_call_with_stack_alignment(asmjit::x86::Compiler& c, void* func);
 [[gnu::const]] constexpr bool IsVolatile(asmjit::a64::Vec reg);
 [[gnu::const]] constexpr bool IsVolatile(asmjit::x86::Vec reg);
 
-inline void jit_call_no_stack_alignment(asmjit::x86::Compiler& c, auto func)
+inline void jit_call_no_stack_alignment(asmjit::x86::Assembler& c, auto func)
 {
     using namespace asmjit::x86;
     if constexpr (platform.abi.systemv) {
@@ -68,7 +68,7 @@ inline void jit_call_no_stack_alignment(asmjit::x86::Compiler& c, auto func)
     }
 }
 
-inline void jit_call_with_stack_alignment(asmjit::x86::Compiler& c, auto func)
+inline void jit_call_with_stack_alignment(asmjit::x86::Assembler& c, auto func)
 {
     using namespace asmjit::x86;
     if constexpr (platform.abi.systemv) {
@@ -22,6 +22,9 @@ std::string config_path;
 
 constexpr char const* rom_path_id = "rom_path";
 constexpr char const* filter_game_list_id = "filter_game_list";
+constexpr char const* games_id = "games"; /* settings that apply to single games, keyed by the rom file name */
+constexpr char const* n64_hle_graphics_id = "hle_graphics";
+constexpr char const* n64_skip_idle_loops_id = "skip_idle_loops";
 constexpr char const* n64_use_cpu_recompiler_id = "use_cpu_recompiler";
 constexpr char const* n64_use_rsp_recompiler_id = "use_cpu_recompiler";
 
@@ -75,6 +78,16 @@ std::optional<std::string> GetGamePath(System system)
     return Get<std::string>(config[SystemToNode(system)][rom_path_id]);
 }
 
+std::optional<bool> GetN64HleGraphics(std::string const& game_title)
+{
+    return Get<bool>(config[SystemToNode(System::N64)][games_id][game_title][n64_hle_graphics_id]);
+}
+
+std::optional<bool> GetN64SkipIdleLoops(std::string const& game_title)
+{
+    return Get<bool>(config[SystemToNode(System::N64)][games_id][game_title][n64_skip_idle_loops_id]);
+}
+
 std::optional<bool> GetN64UseCpuRecompiler()
 {
     return Get<bool>(config[SystemToNode(System::N64)][n64_use_cpu_recompiler_id]);
@@ -124,6 +137,16 @@ void SetGamePath(System system, fs::path const& path)
     Set(config[SystemToNode(system)][rom_path_id], path.generic_string());
 }
 
+void SetN64HleGraphics(std::string const& game_title, bool hle)
+{
+    Set(config[SystemToNode(System::N64)][games_id][game_title][n64_hle_graphics_id], hle);
+}
+
+void SetN64SkipIdleLoops(std::string const& game_title, bool skip)
+{
+    Set(config[SystemToNode(System::N64)][games_id][game_title][n64_skip_idle_loops_id], skip);
+}
+
 void SetN64UseCpuRecompiler(bool use)
 {
     Set(config[SystemToNode(System::N64)][n64_use_cpu_recompiler_id], use);
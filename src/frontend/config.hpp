@@ -11,11 +11,15 @@ namespace frontend::config {
 
 std::optional<std::string> GetGamePath(System system);
 std::optional<bool> GetFilterGameList(System system);
+std::optional<bool> GetN64HleGraphics(std::string const& game_title);
+std::optional<bool> GetN64SkipIdleLoops(std::string const& game_title);
 std::optional<bool> GetN64UseCpuRecompiler();
 std::optional<bool> GetN64UseRspRecompiler();
 void Open(std::filesystem::path const& work_path);
 void SetGamePath(System system, std::filesystem::path const& path);
 void SetFilterGameList(System system, bool filter);
+void SetN64HleGraphics(std::string const& game_title, bool hle);
+void SetN64SkipIdleLoops(std::string const& game_title, bool skip);
 void SetN64UseCpuRecompiler(bool use);
 void SetN64UseRspRecompiler(bool use);
 
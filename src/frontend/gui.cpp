@@ -61,6 +61,7 @@ static void FileDialog(InplaceFunction<void(fs::path)> on_file_selected);
 static void FolderDialog(InplaceFunction<void(fs::path)> on_folder_selected);
 static Status InitGraphics();
 static Status InitSdl();
+static void LoadN64GameSettings(std::string const& game_title);
 static void LoadSelectedBios();
 static void OnExit();
 static void OnGameSelected(System system, size_t list_index);
@@ -154,6 +155,9 @@ void DrawCoreSettingsWindow()
             if (ImGui::RadioButton("Recompiler##rsp", &rsp_impl_sel, 1)) {
                 n64_configuration.n64.use_rsp_recompiler = true;
             }
+
+            ImGui::Checkbox("Skip idle loops (this game)", &n64_configuration.n64.skip_idle_loops);
+            ImGui::Checkbox("HLE graphics (this game)", &n64_configuration.n64.hle_graphics);
         };
 
         switch (tab) {
@@ -164,8 +168,10 @@ void DrawCoreSettingsWindow()
         if (ImGui::Button("Apply and save")) {
             if (game_is_running && system == System::N64) {
                 core->ApplyConfig(n64_configuration);
-                // TODO: save to file
-                n64_configuration = {};
+                // The config setters write the config file
+                config::SetN64SkipIdleLoops(current_game_title, n64_configuration.n64.skip_idle_loops);
+                config::SetN64HleGraphics(current_game_title, n64_configuration.n64.hle_graphics);
+                LoadN64GameSettings(current_game_title); // the checkboxes show what was saved
             }
             show_core_settings_window = !show_core_settings_window;
         }
@@ -556,7 +562,10 @@ Status LoadGame(fs::path const& path)
 {
     assert(core);
     switch (system) {
-    case System::N64: core->ApplyConfig(n64_configuration); break;
+    case System::N64:
+        LoadN64GameSettings(path.filename().string());
+        core->ApplyConfig(n64_configuration);
+        break;
     default:; // TODO
     }
     InitGraphics();
@@ -610,6 +619,13 @@ void OnCtrlKeyPress(SDL_Keycode keycode)
     }
 }
 
+// The settings of the core that are kept per game; the others are left as they are
+void LoadN64GameSettings(std::string const& game_title)
+{
+    n64_configuration.n64.skip_idle_loops = config::GetN64SkipIdleLoops(game_title).value_or(true);
+    n64_configuration.n64.hle_graphics = config::GetN64HleGraphics(game_title).value_or(false);
+}
+
 void LoadSelectedBios()
 {
     assert(core);
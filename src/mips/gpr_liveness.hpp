@@ -0,0 +1,290 @@
+#pragma once
+
+#include "numtypes.hpp"
+
+#include <cassert>
+#include <span>
+#include <vector>
+
+namespace mips {
+
+enum class Isa {
+    Rsp, // MIPS I without multiplication/division, likely branches, traps and exceptions, plus the vector unit
+    Vr4300 // MIPS III
+};
+
+// The GPRs that an instruction reads and writes; bit n stands for GPR n. GPR 0 is never part of either set.
+struct GprAccess {
+    u32 reads;
+    u32 writes;
+    bool may_exit; // may leave the block, e.g. by raising an exception, at which point all GPRs are observable
+};
+
+// Instructions not modelled (e.g. coprocessor instructions of the VR4300) are assumed to read every GPR and to leave
+// the block, so that no value is ever considered dead across them.
+constexpr GprAccess GetGprAccess(u32 instr, Isa isa)
+{
+    constexpr GprAccess unknown = { .reads = ~1u, .writes = 0, .may_exit = true };
+    bool vr4300 = isa == Isa::Vr4300;
+    u32 opcode = instr >> 26, rs = instr >> 21 & 31, rt = instr >> 16 & 31, rd = instr >> 11 & 31;
+    u32 s = 1u << rs, t = 1u << rt, d = 1u << rd;
+    auto access = [](u32 reads, u32 writes, bool may_exit = false) {
+        return GprAccess{ .reads = reads & ~1u, .writes = writes & ~1u, .may_exit = may_exit };
+    };
+    switch (opcode) {
+    case 0x00: // SPECIAL
+        switch (instr & 63) {
+        case 0x00: /* SLL */
+        case 0x02: /* SRL */
+        case 0x03: /* SRA */ return access(t, d);
+        case 0x04: /* SLLV */
+        case 0x06: /* SRLV */
+        case 0x07: /* SRAV */
+        case 0x21: /* ADDU */
+        case 0x23: /* SUBU */
+        case 0x24: /* AND */
+        case 0x25: /* OR */
+        case 0x26: /* XOR */
+        case 0x27: /* NOR */
+        case 0x2A: /* SLT */
+        case 0x2B: /* SLTU */ return access(s | t, d);
+        case 0x20: /* ADD */
+        case 0x22: /* SUB */ return access(s | t, d, vr4300); // overflow exception
+        case 0x08: /* JR */ return access(s, 0);
+        case 0x09: /* JALR */ return access(s, d);
+        case 0x0F: /* SYNC */ return vr4300 ? access(0, 0) : unknown;
+        case 0x10: /* MFHI */
+        case 0x12: /* MFLO */ return vr4300 ? access(0, d) : unknown;
+        case 0x11: /* MTHI */
+        case 0x13: /* MTLO */ return vr4300 ? access(s, 0) : unknown;
+        case 0x18: /* MULT */
+        case 0x19: /* MULTU */
+        case 0x1A: /* DIV */
+        case 0x1B: /* DIVU */ return vr4300 ? access(s | t, 0) : unknown;
+        case 0x14: /* DSLLV */
+        case 0x16: /* DSRLV */
+        case 0x17: /* DSRAV */
+        case 0x2C: /* DADD */
+        case 0x2D: /* DADDU */
+        case 0x2E: /* DSUB */
+        case 0x2F: /* DSUBU */ return vr4300 ? access(s | t, d, true) : unknown; // reserved instruction exception
+        case 0x1C: /* DMULT */
+        case 0x1D: /* DMULTU */
+        case 0x1E: /* DDIV */
+        case 0x1F: /* DDIVU */ return vr4300 ? access(s | t, 0, true) : unknown;
+        case 0x38: /* DSLL */
+        case 0x3A: /* DSRL */
+        case 0x3B: /* DSRA */
+        case 0x3C: /* DSLL32 */
+        case 0x3E: /* DSRL32 */
+        case 0x3F: /* DSRA32 */ return vr4300 ? access(t, d, true) : unknown;
+        default: return unknown; // SYSCALL, BREAK, traps
+        }
+
+    case 0x01: // REGIMM
+        switch (rt) {
+        case 0x00: /* BLTZ */
+        case 0x01: /* BGEZ */ return access(s, 0);
+        case 0x02: /* BLTZL */
+        case 0x03: /* BGEZL */ return vr4300 ? access(s, 0, true) : unknown; // leaves the block if not taken
+        case 0x10: /* BLTZAL */
+        case 0x11: /* BGEZAL */ return access(s, 1u << 31);
+        case 0x12: /* BLTZALL */
+        case 0x13: /* BGEZALL */ return vr4300 ? access(s, 1u << 31, true) : unknown;
+        default: return unknown;
+        }
+
+    case 0x02: /* J */ return access(0, 0);
+    case 0x03: /* JAL */ return access(0, 1u << 31);
+    case 0x04: /* BEQ */
+    case 0x05: /* BNE */
+    case 0x06: /* BLEZ */
+    case 0x07: /* BGTZ */ return access(s | t, 0);
+    case 0x08: /* ADDI */ return access(s, t, vr4300);
+    case 0x09: /* ADDIU */
+    case 0x0A: /* SLTI */
+    case 0x0B: /* SLTIU */
+    case 0x0C: /* ANDI */
+    case 0x0D: /* ORI */
+    case 0x0E: /* XORI */ return access(s, t);
+    case 0x0F: /* LUI */ return access(0, t);
+
+    case 0x12: // COP2
+        if (vr4300) return unknown;
+        if (instr >> 25 & 1) return access(0, 0); // vector computational instructions
+        switch (rs) {
+        case 0x00: /* MFC2 */
+        case 0x02: /* CFC2 */ return access(0, t);
+        case 0x04: /* MTC2 */
+        case 0x06: /* CTC2 */ return access(t, 0);
+        default: return unknown;
+        }
+
+    case 0x14: /* BEQL */
+    case 0x15: /* BNEL */
+    case 0x16: /* BLEZL */
+    case 0x17: /* BGTZL */ return vr4300 ? access(s | t, 0, true) : unknown;
+    case 0x18: /* DADDI */
+    case 0x19: /* DADDIU */ return vr4300 ? access(s, t, true) : unknown;
+
+    // Accesses to the RSP memories cannot fail; the VR4300 may take a TLB or address error exception
+    case 0x20: /* LB */
+    case 0x21: /* LH */
+    case 0x23: /* LW */
+    case 0x24: /* LBU */
+    case 0x25: /* LHU */
+    case 0x27: /* LWU */ return access(s, t, vr4300);
+    case 0x28: /* SB */
+    case 0x29: /* SH */
+    case 0x2B: /* SW */ return access(s | t, 0, vr4300);
+    case 0x32: /* LWC2 */
+    case 0x3A: /* SWC2 */ return vr4300 ? unknown : access(s, 0);
+    case 0x1A: /* LDL */
+    case 0x1B: /* LDR */
+    case 0x22: /* LWL */
+    case 0x26: /* LWR */
+    case 0x38: /* SC */
+    case 0x3C: /* SCD */ return vr4300 ? access(s | t, t, true) : unknown;
+    case 0x30: /* LL */
+    case 0x34: /* LLD */
+    case 0x37: /* LD */ return vr4300 ? access(s, t, true) : unknown;
+    case 0x2A: /* SWL */
+    case 0x2C: /* SDL */
+    case 0x2D: /* SDR */
+    case 0x2E: /* SWR */
+    case 0x3F: /* SD */ return vr4300 ? access(s | t, 0, true) : unknown;
+    case 0x2F: /* CACHE */
+    case 0x31: /* LWC1 */
+    case 0x35: /* LDC1 */
+    case 0x39: /* SWC1 */
+    case 0x3D: /* SDC1 */ return vr4300 ? access(s, 0, true) : unknown;
+
+    default: return unknown; // COP0, COP1, reserved instructions
+    }
+}
+
+enum class BranchKind {
+    None,
+    Conditional, // to a fixed target, falling through to the instruction after the delay slot if not taken
+    Terminal // jumps, branches that are always taken, and branches likely, which skip the delay slot if not taken
+};
+
+// Blocks are left after the delay slot of any branch, if it is taken. Only after a conditional branch can a block go on
+// with the instructions that follow it.
+constexpr BranchKind GetBranchKind(u32 instr, Isa isa)
+{
+    bool vr4300 = isa == Isa::Vr4300;
+    u32 opcode = instr >> 26, rs = instr >> 21 & 31, rt = instr >> 16 & 31;
+    switch (opcode) {
+    case 0x00: // SPECIAL
+        return (instr & 63) == 0x08 || (instr & 63) == 0x09 ? BranchKind::Terminal : BranchKind::None; // JR, JALR
+    case 0x01: // REGIMM
+        switch (rt) {
+        case 0x00: /* BLTZ */
+        case 0x10: /* BLTZAL */ return BranchKind::Conditional;
+        case 0x01: /* BGEZ */
+        case 0x11: /* BGEZAL */ return rs == 0 ? BranchKind::Terminal : BranchKind::Conditional;
+        case 0x02: /* BLTZL */
+        case 0x03: /* BGEZL */
+        case 0x12: /* BLTZALL */
+        case 0x13: /* BGEZALL */ return vr4300 ? BranchKind::Terminal : BranchKind::None;
+        default: return BranchKind::None;
+        }
+    case 0x02: /* J */
+    case 0x03: /* JAL */ return BranchKind::Terminal;
+    case 0x04: /* BEQ */ return rs == rt ? BranchKind::Terminal : BranchKind::Conditional;
+    case 0x05: /* BNE */
+    case 0x06: /* BLEZ */
+    case 0x07: /* BGTZ */ return BranchKind::Conditional;
+    case 0x10: // COP0
+    case 0x11: // COP1
+    case 0x12: // COP2
+    case 0x13: // COP3
+        return vr4300 && rs == 0x08 ? BranchKind::Terminal : BranchKind::None; // BCzF, BCzT and their likely variants
+    case 0x14: /* BEQL */
+    case 0x15: /* BNEL */
+    case 0x16: /* BLEZL */
+    case 0x17: /* BGTZL */ return vr4300 ? BranchKind::Terminal : BranchKind::None;
+    default: return BranchKind::None;
+    }
+}
+
+// Liveness of the GPRs over the instructions of a block, computed in a backward pass before the block is emitted. A
+// value is live if it may be read, by a later instruction or at an exit from the block, before being overwritten.
+// The register allocators use it to avoid loading values that are about to be overwritten, to evict the value that
+// is needed the furthest in the future, and to drop values that nothing can observe any more.
+class GprLiveness {
+    std::vector<GprAccess> accesses_;
+    std::vector<u32> live_after_; // GPRs live right after each instruction
+    u32 dead_on_entry_{};
+
+public:
+    // The instructions after the last one given are assumed to read every GPR, as are those after the delay slot of a
+    // branch within the block, where the block is left if the branch is taken. Within the block, so is the first one,
+    // as it may be the delay slot of a branch in the preceding block, which is performed right after it.
+    void Analyze(std::span<u32 const> instrs, Isa isa)
+    {
+        accesses_.clear();
+        for (u32 instr : instrs) {
+            accesses_.push_back(GetGprAccess(instr, isa));
+        }
+        live_after_.resize(instrs.size());
+        u32 live = ~1u;
+        for (size_t i = instrs.size(); i-- > 0;) {
+            if (i > 0 && GetBranchKind(instrs[i - 1], isa) != BranchKind::None) {
+                live = ~1u;
+            }
+            live_after_[i] = live;
+            GprAccess const& access = accesses_[i];
+            live = access.may_exit ? ~1u : (live & ~access.writes) | access.reads;
+        }
+        dead_on_entry_ = ~live & ~1u;
+        if (!live_after_.empty()) {
+            live_after_[0] = ~1u;
+        }
+    }
+
+    GprAccess const& Access(u32 index) const { return accesses_[index]; }
+
+    // GPRs whose values on entry to the block are overwritten before anything can observe them, given that no branch
+    // is pending when the block is entered
+    u32 DeadOnEntry() const { return dead_on_entry_; }
+
+    // Whether the value of 'gpr' is unobservable once the instruction at 'index' has been performed, up until the
+    // instruction overwrites it. Its host register can then be reused without the value being written back.
+    bool IsDeadAfter(u32 index, u32 gpr) const
+    {
+        assert(gpr < 32);
+        GprAccess const& access = accesses_[index];
+        return !access.may_exit && !(access.reads >> gpr & 1) && !(live_after_[index] >> gpr & 1);
+    }
+
+    // Whether the instruction at 'index' overwrites 'gpr' without reading its old value, and without possibly leaving
+    // the block first. Its host register then need not be loaded with the old value.
+    bool IsWriteOnly(u32 index, u32 gpr) const
+    {
+        assert(gpr < 32);
+        GprAccess const& access = accesses_[index];
+        return !access.may_exit && (access.writes & ~access.reads) >> gpr & 1;
+    }
+
+    // The index of the first instruction at or after 'index' to read the value that 'gpr' holds before it, or Size()
+    // if there is no such instruction within the block.
+    u32 NextRead(u32 index, u32 gpr) const
+    {
+        assert(gpr < 32);
+        for (u32 i = index; i < Size(); ++i) {
+            if (accesses_[i].reads >> gpr & 1) {
+                return i;
+            }
+            if (accesses_[i].writes >> gpr & 1) {
+                break;
+            }
+        }
+        return Size();
+    }
+
+    u32 Size() const { return u32(accesses_.size()); }
+};
+
+} // namespace mips
@@ -2,6 +2,7 @@
 
 #include "jit_common.hpp"
 #include "mips/disassembler.hpp"
+#include "mips/gpr_liveness.hpp"
 #include "numtypes.hpp"
 
 #include <algorithm>
@@ -12,29 +13,11 @@
 #include <optional>
 #include <span>
 #include <string>
+#include <tuple>
 #include <utility>
 
 namespace mips {
 
-// clang-format off
-/*
-    TODO: possible improvement is to not load register from guest when GetDirtyGpr is called. Right now, in this situation:
-        addu $1, $2, $3,
-    we would also load $1, even though it is overwritten.
-    However, it causes some problems, where given
-        addu $1, $1, $2,
-    we must load $1 before writing to it. So we could do that when we encounter it the second time. However, then we must make sure that for:
-        addu $1, $2, $3,
-        addu $1, $1, $2,
-    we mark $1 as "loaded" before starting the second addu, else, we may try to load it in the second addu even though it is dirty.
-    One might think that checking the condition 'do_load && !is_dirty' could work to decide if to load, but for
-        addu $1, $1, $2,
-    this would not work, as is_dirty would already be set when we encounter $1 for the second time, so we would not load it there, which we need to.
-
-    Possible solution would be to always get the source registers before the destination one?
-*/
-// clang-format on
-
 // template<typename T, typename HostGpr>
 // concept BaseRegisterAllocator = requires(T t) {
 //     { t.SetupGprStackSpace() };
@@ -60,9 +43,19 @@ struct RegisterAllocatorState {
     std::array<Binding*, num_guest_regs> guest_to_host{};
     typename decltype(bindings)::iterator next_free_binding_it{ bindings.begin() };
     RegisterAllocator* reg_alloc{};
+    GprLiveness const* liveness{}; // of the block being emitted; only set for the GPR state
+    u32 instr_index{}; // of the instruction being emitted, into 'liveness'
     u16 host_access_index{};
+    u16 instr_first_access_index{}; // bindings with an access index at least this are used by the current instruction
     bool nonvolatile_gprs_used{};
 
+    // Called before emitting each instruction of the block
+    void BeginInstruction(u32 index)
+    {
+        instr_index = index;
+        instr_first_access_index = host_access_index;
+    }
+
     void DestroyVolatile(HostGpr gpr)
     {
         assert(IsVolatile(gpr));
@@ -167,7 +160,13 @@ struct RegisterAllocatorState {
             binding = &*(next_free_binding_it++);
             found_free = true;
         } else {
-            auto min_access_index = std::numeric_limits<decltype(host_access_index)>::max();
+            // Without liveness information, the least recently used binding is evicted. With it, bindings used by the
+            // current instruction are kept, and of the others, the one read again the furthest in the future is evicted.
+            auto eviction_priority = [this](Binding const& b) {
+                bool used_by_instr = b.access_index >= instr_first_access_index;
+                u32 next_read = HasLiveness() ? liveness->NextRead(instr_index, b.guest.value()) : 0;
+                return std::tuple{ !used_by_instr, next_read, -s32(b.access_index) };
+            };
             for (Binding& b : bindings) {
                 if (b.reserved) {
                     continue;
@@ -176,14 +175,17 @@ struct RegisterAllocatorState {
                     found_free = true;
                     binding = &b;
                     break;
-                } else if (b.access_index < min_access_index) {
-                    min_access_index = b.access_index;
+                } else if (!binding || eviction_priority(b) > eviction_priority(*binding)) {
                     binding = &b;
                 }
             }
             assert(binding);
             if (!found_free) {
-                Flush(*binding, false);
+                if (HasLiveness() && liveness->IsDeadAfter(instr_index, binding->guest.value())) {
+                    ResetBinding(*binding); // the value is overwritten before it can be observed
+                } else {
+                    Flush(*binding, false);
+                }
             }
         }
 
@@ -201,7 +203,9 @@ struct RegisterAllocatorState {
             }
         }
 
-        reg_alloc->LoadGuest(binding->host, guest);
+        if (!mark_dirty || !HasLiveness() || !liveness->IsWriteOnly(instr_index, guest)) {
+            reg_alloc->LoadGuest(binding->host, guest);
+        }
 
         return binding->host;
     }
@@ -228,6 +232,8 @@ struct RegisterAllocatorState {
         return std::format("Used: {}; Free: {}\n", used_str, free_str);
     }
 
+    bool HasLiveness() const { return liveness && instr_index < liveness->Size(); }
+
     void Reserve(HostGpr reg)
     {
         auto it = std::ranges::find_if(bindings, [reg](Binding& b) { return b.host == reg; });
@@ -237,6 +243,26 @@ struct RegisterAllocatorState {
         }
     }
 
+    // Emits the code that brings the bindings of 'target', an earlier state of this allocator, back into effect, e.g.
+    // at the jump back to the start of a loop. Values that are to move, or that are to be clean in 'target', are first
+    // written back; the values bound in 'target' are then reloaded where needed. The state itself is left untouched,
+    // as the code following the jump is still emitted under it.
+    void Reconcile(std::array<Binding, num_host_regs> const& target) const
+    {
+        for (size_t i = 0; i < bindings.size(); ++i) {
+            Binding const& b = bindings[i];
+            if (b.Occupied() && b.dirty && (target[i].guest != b.guest || !target[i].dirty)) {
+                reg_alloc->FlushGuest(b.host, b.guest.value());
+            }
+        }
+        for (size_t i = 0; i < bindings.size(); ++i) {
+            Binding const& t = target[i];
+            if (t.Occupied() && t.guest != bindings[i].guest) {
+                reg_alloc->LoadGuest(t.host, t.guest.value());
+            }
+        }
+    }
+
     void Reset()
     {
         for (Binding& b : bindings) {
@@ -247,10 +273,14 @@ struct RegisterAllocatorState {
         }
         guest_to_host = {};
         host_access_index = 0;
+        instr_first_access_index = 0;
+        instr_index = std::numeric_limits<u32>::max();
         next_free_binding_it = bindings.begin();
         nonvolatile_gprs_used = false;
     }
 
+    void SetLiveness(GprLiveness const* gpr_liveness) { liveness = gpr_liveness; }
+
     void ResetBinding(Binding& b)
     {
         if (b.Occupied()) {
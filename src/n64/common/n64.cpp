@@ -12,8 +12,10 @@
 #include "memory/rdram.hpp"
 #include "n64_build_options.hpp"
 #include "rdp/rdp.hpp"
+#include "rsp/hle.hpp"
 #include "rsp/rsp.hpp"
 #include "scheduler.hpp"
+#include "vr4300/persistent_cache.hpp"
 #include "vr4300/vr4300.hpp"
 
 using namespace n64;
@@ -24,6 +26,8 @@ void N64::ApplyConfig(CoreConfiguration config)
       std::exchange(cpu_impl, config.n64.use_cpu_recompiler ? CpuImpl::Recompiler : CpuImpl::Interpreter);
     CpuImpl prev_rsp_impl =
       std::exchange(rsp_impl, config.n64.use_rsp_recompiler ? CpuImpl::Recompiler : CpuImpl::Interpreter);
+    vr4300::skip_idle_loops = config.n64.skip_idle_loops;
+    rsp::hle::enable_graphics_hle = config.n64.hle_graphics;
     // TODO: handle this
     if (running && (cpu_impl != prev_cpu_impl || rsp_impl != prev_rsp_impl)) {
         /*Stop();
@@ -79,6 +83,9 @@ Status N64::LoadRom(std::filesystem::path const& path)
 {
     Status status = cart::LoadRom(path);
     game_loaded = status.Ok();
+    if (game_loaded && enable_cpu_jit_persistent_cache) {
+        vr4300::OpenPersistentCache(cart::GetRomHeaderCrc());
+    }
     return status;
 }
 
@@ -120,6 +127,7 @@ void N64::Run(std::stop_token stop_token)
         rsp_impl == n64::CpuImpl::Interpreter ? scheduler::Run<CpuImpl::Recompiler, CpuImpl::Interpreter>(stop_token)
                                               : scheduler::Run<CpuImpl::Recompiler, CpuImpl::Recompiler>(stop_token);
     }
+    vr4300::SavePersistentCache();
 }
 
 void N64::StreamState(Serializer& serializer)
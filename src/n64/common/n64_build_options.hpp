@@ -3,17 +3,25 @@
 namespace n64 {
 
 inline constexpr bool enable_logging = 0;
+inline constexpr bool enable_cpu_fastmem = 1; // inline RDRAM accesses in the CPU recompiler; bypasses the dcache model
 inline constexpr bool enable_cpu_jit_error_handler = 1;
+inline constexpr bool enable_cpu_jit_persistent_cache = 1; // store compiled blocks on disk, per ROM, for later runs
+inline constexpr bool enable_cpu_jit_tiered_compilation = 1; // interpret cold blocks while they compile on a thread
+inline constexpr bool enable_rsp_audio_hle = 1; // run standard audio microcode tasks natively instead of on the RSP
+inline constexpr bool enable_rsp_catch_up = 0; // let the RSP fall behind, running it when the CPU observes it
 inline constexpr bool enable_rsp_jit_error_handler = 1;
+inline constexpr bool enable_rsp_thread = 0; // run the RSP on a thread of its own, meeting the CPU where they interact
 inline constexpr bool log_cpu_branches = enable_logging && 0;
 inline constexpr bool log_cpu_instructions = enable_logging && 1;
 inline constexpr bool log_cpu_jit_blocks = enable_logging && 1;
 inline constexpr bool log_cpu_jit_register_status = enable_logging && 0;
+inline constexpr bool log_cpu_jit_ir = enable_logging && 0;
 inline constexpr bool log_cpu_reads = enable_logging && 0;
 inline constexpr bool log_cpu_writes = enable_logging && 0;
 inline constexpr bool log_dma = enable_logging && 0;
 inline constexpr bool log_exceptions = enable_logging && 0;
 inline constexpr bool log_interrupts = enable_logging && 0;
+inline constexpr bool log_jit_compile_stats = enable_logging && 0; // compile time per instruction, at teardown
 inline constexpr bool log_io_all = enable_logging && 0;
 inline constexpr bool log_io_ai = enable_logging && (log_io_all || 0);
 inline constexpr bool log_io_mi = enable_logging && (log_io_all || 0);
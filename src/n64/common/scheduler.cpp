@@ -1,124 +1,250 @@
 #include "scheduler.hpp"
 #include "interface/ai.hpp"
+#include "interface/mi.hpp"
 #include "interface/vi.hpp"
 #include "n64.hpp"
+#include "n64_build_options.hpp"
 #include "rsp/interpreter.hpp"
 #include "rsp/recompiler.hpp"
+#include "rsp/rsp.hpp"
+#include "rsp/rsp_thread.hpp"
 #include "vr4300/interpreter.hpp"
 #include "vr4300/recompiler.hpp"
 
-#include <vector>
+#include <algorithm>
+#include <array>
+#include <limits>
 
 namespace n64::scheduler {
 
-constexpr s32 rsp_cycles_per_update = 2 * cpu_cycles_per_update / 3;
-static_assert(2 * cpu_cycles_per_update == 3 * rsp_cycles_per_update, "CPU cycles per update must be divisible by 3.");
-
+/* Times are absolute, in CPU cycles since the scheduler was initialized. Each event type has a slot of its own, as
+   there is never more than one event of a type pending, so that adding, moving or removing an event does not need to
+   search or shift a list. */
 struct Event {
-    EventType event_type;
-    s64 cpu_cycles_until_fire; /* signed so that we can subtract a duration and check if the result is negative */
+    u64 time; /* 'never' if the event is not pending */
     EventCallback callback;
 };
 
-static bool quit;
-static std::vector<Event> events; /* sorted after when they will occur */
-static std::vector<EventCallback> fired_events_callbacks;
+constexpr u64 never = std::numeric_limits<u64>::max();
+constexpr size_t num_event_types = size_t(EventType::VINewField) + 1;
+
+/* With 'enable_rsp_catch_up', how far behind the CPU a running RSP may fall while the CPU does not observe it */
+constexpr u64 max_rsp_lag = 16 * cpu_cycles_per_update;
+
+static std::array<Event, num_event_types> events;
+static u64 next_event_time; /* the earliest time of all events */
+static u64 cpu_run_start_time; /* the time at the start of the current (or the last) run of the CPU */
+static u64 rsp_time; /* the time up to which the RSP has been given cycles */
+static u32 rsp_cycle_thirds; /* the RSP runs for 2/3 of the cycles of the CPU; the remainder of the last conversion */
+static s32 rsp_cycle_overrun; /* the cycles that the RSP ran for past the end of its last run */
+static u32 (*run_rsp)(u32 rsp_cycles); /* null while the scheduler is not running */
 
-static void CheckEvents(s64 cpu_cycle_step);
+static void CheckEvents();
+static void OnEventTimeLowered(u64 time);
+static void OnRspCatchUpEvent();
+static void RunRsp(u64 time);
+static u32 TakeRspCycles(u64 time);
+static void UpdateNextEventTime();
 
 void AddEvent(EventType event_type, s64 cpu_cycles_until_fire, EventCallback callback)
 {
-    /* Compensate for the fact that we may be in the middle of a CPU update, and times for other events
-        have not updated yet. TODO: We are assuming that only the main CPU can cause an event to be added.
-        Is it ok? */
-    s64 enqueue_time = cpu_cycles_until_fire + s64(vr4300::GetElapsedCycles());
-    for (auto it = events.begin(); it != events.end(); ++it) {
-        if (enqueue_time < it->cpu_cycles_until_fire) {
-            events.emplace(it, Event{ event_type, enqueue_time, callback });
-            return;
+    /* We may be in the middle of a run of the CPU; the time is counted from the current point within it.
+       TODO: We are assuming that only the main CPU can cause an event to be added. Is it ok? */
+    u64 time = GetTime() + u64(std::max(cpu_cycles_until_fire, s64(0)));
+    Event& event = events[size_t(event_type)];
+    u64 prev_time = event.time;
+    event = { time, callback };
+    if (time < next_event_time) {
+        OnEventTimeLowered(time);
+    } else if (prev_time == next_event_time) {
+        UpdateNextEventTime();
+    }
+}
+
+/* Called before the CPU observes or changes state of the RSP or RDP. The RSP, when left behind the CPU (see
+   'enable_rsp_catch_up'), is run up to the current point within the CPU run; the RSP thread (see 'enable_rsp_thread')
+   is waited for. */
+void CatchUpRsp()
+{
+    if constexpr (enable_rsp_thread) {
+        rsp::SyncThread();
+    } else if constexpr (enable_rsp_catch_up) {
+        if (run_rsp) {
+            mi::DeferInterruptChecks(true);
+            RunRsp(GetTime());
+            mi::DeferInterruptChecks(false);
+            if (mi::InterruptCheckDeferred()) {
+                /* End the CPU run after the access; the scheduler then passes the interrupt on */
+                vr4300::cycles_to_run = std::min(vr4300::cycles_to_run, u32(vr4300::GetElapsedCycles()));
+            }
         }
     }
-    events.emplace_back(Event{ event_type, enqueue_time, callback });
 }
 
 void ChangeEventTime(EventType event_type, s64 cpu_cycles_until_fire)
 {
-    for (auto it = events.begin(); it != events.end(); ++it) {
-        if (it->event_type == event_type) {
-            EventCallback callback = it->callback;
-            events.erase(it);
-            AddEvent(event_type, cpu_cycles_until_fire, callback);
-            return;
-        }
+    Event& event = events[size_t(event_type)];
+    if (event.time != never) {
+        AddEvent(event_type, cpu_cycles_until_fire, event.callback);
     }
 }
 
-void CheckEvents(s64 cpu_cycle_step)
+void CheckEvents()
 {
-    fired_events_callbacks.clear();
-    for (auto it = events.begin(); it != events.end();) {
-        it->cpu_cycles_until_fire -= cpu_cycle_step;
-        if (it->cpu_cycles_until_fire <= 0) {
-            /* erase element before invoking callback, in case it mutates the event list */
-            fired_events_callbacks.push_back(it->callback);
-            it = events.erase(it);
-        } else {
-            ++it;
+    u64 time = GetTime();
+    if (next_event_time > time) {
+        return;
+    }
+    /* Take all due events out before invoking any callback, as callbacks may add events again */
+    std::array<Event, num_event_types> fired_events;
+    size_t num_fired_events = 0;
+    for (Event& event : events) {
+        if (event.time <= time) {
+            fired_events[num_fired_events++] = event;
+            event.time = never;
         }
     }
-    for (EventCallback callback : fired_events_callbacks) {
-        callback();
+    UpdateNextEventTime();
+    std::sort(fired_events.begin(), fired_events.begin() + num_fired_events, [](Event const& lhs, Event const& rhs) {
+        return lhs.time < rhs.time;
+    });
+    for (size_t i = 0; i < num_fired_events; ++i) {
+        fired_events[i].callback();
     }
 }
 
+/* Counted from the current point within the CPU run, like the times given to AddEvent. */
+s64 GetCyclesUntilNextEvent()
+{
+    if (next_event_time == never) {
+        return std::numeric_limits<s64>::max();
+    }
+    return s64(next_event_time - GetTime());
+}
+
+/* In CPU cycles since the scheduler was initialized, up to the current point within the CPU run. */
+u64 GetTime()
+{
+    return cpu_run_start_time + vr4300::GetElapsedCycles();
+}
+
 void Initialize()
 {
-    quit = false;
-    events.clear();
-    events.reserve(16);
-    fired_events_callbacks.clear();
-    fired_events_callbacks.reserve(16);
+    events.fill({ never, nullptr });
+    next_event_time = never;
+    cpu_run_start_time = 0;
+    rsp_time = 0;
+    rsp_cycle_thirds = 0;
+    rsp_cycle_overrun = 0;
+    vr4300::cycle_counter = 0;
     vr4300::AddInitialEvents();
     vi::AddInitialEvents();
 }
 
+/* An event that now fires before the end of the current CPU run cuts the run short, so that the event is handled in
+   time; compiled blocks check the cycle budget of the run at their exits. */
+void OnEventTimeLowered(u64 time)
+{
+    next_event_time = time;
+    u64 cycles_until_time = time - cpu_run_start_time;
+    if (cycles_until_time < vr4300::cycles_to_run) {
+        vr4300::cycles_to_run = u32(cycles_until_time);
+    }
+}
+
+/* With 'enable_rsp_catch_up', the RSP is caught up at the latest 'max_rsp_lag' cycles after it was last run, while it
+   is running, so that interrupts that it raises are not held back by much. */
+void OnRspCatchUpEvent()
+{
+    RunRsp(GetTime());
+    if (!rsp::sp.status.halted) {
+        AddEvent(EventType::RspCatchUp, max_rsp_lag, OnRspCatchUpEvent);
+    }
+}
+
+/* Called when the CPU starts the RSP. An HLE task finishes as soon as the RSP runs; the RSP is run at once. */
+void OnRspStarted()
+{
+    if constexpr (enable_rsp_catch_up && !enable_rsp_thread) {
+        AddEvent(EventType::RspCatchUp, 0, OnRspCatchUpEvent);
+    }
+}
+
 void RemoveEvent(EventType event_type)
 {
-    for (auto it = events.begin(); it != events.end(); ++it) {
-        if (it->event_type == event_type) {
-            events.erase(it);
-            return;
-        }
+    Event& event = events[size_t(event_type)];
+    u64 prev_time = event.time;
+    event.time = never;
+    if (prev_time == next_event_time) {
+        UpdateNextEventTime();
+    }
+}
+
+void RunRsp(u64 time)
+{
+    if (time <= rsp_time) {
+        return;
+    }
+    s32 rsp_cycles = s32(TakeRspCycles(time));
+    if (rsp_cycle_overrun < rsp_cycles) {
+        rsp_cycle_overrun = run_rsp(rsp_cycles - rsp_cycle_overrun);
+    } else {
+        rsp_cycle_overrun -= rsp_cycles;
     }
 }
 
+/* The RSP cycles from 'rsp_time' to 'time', which becomes the new 'rsp_time' */
+u32 TakeRspCycles(u64 time)
+{
+    rsp_cycle_thirds += 2 * u32(time - rsp_time);
+    rsp_time = time;
+    u32 rsp_cycles = rsp_cycle_thirds / 3;
+    rsp_cycle_thirds %= 3;
+    return rsp_cycles;
+}
+
+void UpdateNextEventTime()
+{
+    next_event_time = std::ranges::min(events, {}, &Event::time).time;
+}
+
 template<CpuImpl vr4300_impl, CpuImpl rsp_impl> void Run(std::stop_token stop_token)
 {
     Initialize();
     rsp::SetActiveCpuImpl(rsp_impl);
     vr4300::SetActiveCpuImpl(vr4300_impl);
 
-    s32 cpu_cycle_overrun = 0, rsp_cycle_overrun = 0;
+    /* The CPU runs up to the next event, but for at most 'cpu_cycles_per_update' cycles, so that the RSP keeps up
+       with it. With 'enable_rsp_catch_up', the RSP is instead left behind, and run in longer stretches: when the CPU
+       observes it (see CatchUpRsp), or when the RspCatchUp event fires. */
+    run_rsp = rsp_impl == CpuImpl::Interpreter ? rsp::RunInterpreter : rsp::RunRecompiler;
+    if constexpr (enable_rsp_thread) {
+        rsp::StartThread(run_rsp);
+    } else if constexpr (enable_rsp_catch_up) {
+        AddEvent(EventType::RspCatchUp, 0, OnRspCatchUpEvent);
+    }
     while (!stop_token.stop_requested()) {
-        if (cpu_cycle_overrun < cpu_cycles_per_update) {
-            u32 cpu_step = u32(cpu_cycles_per_update - cpu_cycle_overrun);
-            cpu_cycle_overrun =
-              vr4300_impl == CpuImpl::Interpreter ? vr4300::RunInterpreter(cpu_step) : vr4300::RunRecompiler(cpu_step);
-            u32 actual_cpu_step = cpu_step + cpu_cycle_overrun;
-            ai::Step(actual_cpu_step);
-            CheckEvents(actual_cpu_step);
-        } else {
-            cpu_cycle_overrun -= cpu_cycles_per_update;
-        }
-        s32 rsp_step = rsp_cycles_per_update + 2 * cpu_cycle_overrun / 3;
-        if (rsp_cycle_overrun < rsp_step) {
-            rsp_step -= rsp_cycle_overrun;
-            rsp_cycle_overrun =
-              rsp_impl == CpuImpl::Interpreter ? rsp::RunInterpreter(rsp_step) : rsp::RunRecompiler(rsp_step);
+        cpu_run_start_time = GetTime();
+        u64 cycles_until_next_event = next_event_time - cpu_run_start_time;
+        u32 cpu_step = u32(std::clamp(cycles_until_next_event, u64(1), u64(cpu_cycles_per_update)));
+        vr4300_impl == CpuImpl::Interpreter ? vr4300::RunInterpreter(cpu_step) : vr4300::RunRecompiler(cpu_step);
+        ai::Step(u32(vr4300::GetElapsedCycles()));
+        CheckEvents();
+
+        u64 time = GetTime();
+        if constexpr (enable_rsp_thread) {
+            rsp::ApplyDeferredInterrupts();
+            rsp::AddThreadCycles(TakeRspCycles(time));
+        } else if constexpr (!enable_rsp_catch_up) {
+            RunRsp(time);
         } else {
-            rsp_cycle_overrun -= rsp_step;
+            mi::RunDeferredInterruptCheck();
         }
     }
+    if constexpr (enable_rsp_thread) {
+        rsp::StopThread();
+    }
+    run_rsp = nullptr;
 }
 
 template void Run<CpuImpl::Interpreter, CpuImpl::Interpreter>(std::stop_token);
@@ -13,14 +13,20 @@ enum class EventType {
     CountCompareMatch,
     PiDmaFinish,
     PiWriteFinish,
+    RspCatchUp,
     SiDmaFinish,
     SpDmaFinish,
-    VINewHalfline
+    VIInterrupt,
+    VINewField
 };
 
 void AddEvent(EventType event, s64 cpu_cycles_until_fire, EventCallback callback);
+void CatchUpRsp();
 void ChangeEventTime(EventType event, s64 cpu_cycles_until_fire);
+s64 GetCyclesUntilNextEvent();
+u64 GetTime();
 void Initialize();
+void OnRspStarted();
 void RemoveEvent(EventType event);
 template<CpuImpl vr4300_impl, CpuImpl rsp_impl> void Run(std::stop_token stop_token);
 
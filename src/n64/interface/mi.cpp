@@ -2,6 +2,7 @@
 #include "log.hpp"
 #include "n64_build_options.hpp"
 #include "platform.hpp"
+#include "rsp/rsp_thread.hpp"
 #include "vr4300/vr4300.hpp"
 
 #include <cstring>
@@ -28,8 +29,15 @@ struct {
     s32 mode, version, interrupt, mask;
 } static mi;
 
+static bool defer_interrupt_checks; /* while the CPU is in the middle of an access; see scheduler::CatchUpRsp */
+static bool interrupt_check_deferred;
+
 void CheckInterrupts()
 {
+    if (defer_interrupt_checks) {
+        interrupt_check_deferred = true;
+        return;
+    }
     if (mi.interrupt & mi.mask) {
         vr4300::SetInterruptPending(vr4300::ExternalInterruptSource::MI);
     } else {
@@ -39,18 +47,40 @@ void CheckInterrupts()
 
 void ClearInterrupt(InterruptType interrupt_type)
 {
+    if (enable_rsp_thread && rsp::OnRspThread()) {
+        rsp::DeferInterrupt(interrupt_type, false);
+        return;
+    }
     mi.interrupt &= ~std::to_underlying(interrupt_type);
     CheckInterrupts();
 }
 
+/* An interrupt taken in the middle of a load or store would have the CPU run the instruction again after the
+   exception handler, and any side effect of the access twice. Until this is called with 'false', changes to the
+   interrupt state are not passed on to the CPU; RunDeferredInterruptCheck does so, once the access has retired. */
+void DeferInterruptChecks(bool defer)
+{
+    defer_interrupt_checks = defer;
+}
+
 void Initialize()
 {
     mi.mode = mi.interrupt = mi.mask = 0;
     mi.version = 0x0202'0102;
+    defer_interrupt_checks = interrupt_check_deferred = false;
+}
+
+bool InterruptCheckDeferred()
+{
+    return interrupt_check_deferred;
 }
 
 void RaiseInterrupt(InterruptType interrupt_type)
 {
+    if (enable_rsp_thread && rsp::OnRspThread()) {
+        rsp::DeferInterrupt(interrupt_type, true);
+        return;
+    }
     mi.interrupt |= std::to_underlying(interrupt_type);
     CheckInterrupts();
 }
@@ -78,6 +108,13 @@ constexpr std::string_view RegOffsetToStr(u32 reg_offset)
     }
 }
 
+void RunDeferredInterruptCheck()
+{
+    if (std::exchange(interrupt_check_deferred, false)) {
+        CheckInterrupts();
+    }
+}
+
 void WriteReg(u32 addr, u32 data)
 {
     u32 offset = addr >> 2 & 3;
@@ -15,9 +15,12 @@ enum class InterruptType : s32 {
 };
 
 void ClearInterrupt(InterruptType);
+void DeferInterruptChecks(bool defer);
 void Initialize();
+bool InterruptCheckDeferred();
 u32 ReadReg(u32 addr);
 void RaiseInterrupt(InterruptType);
+void RunDeferredInterruptCheck();
 void WriteReg(u32 addr, u32 data);
 
 } // namespace n64::mi
@@ -6,6 +6,7 @@
 #include "rdp/rdp.hpp"
 #include "scheduler.hpp"
 
+#include <algorithm>
 #include <bit>
 #include <cstring>
 #include <string_view>
@@ -15,16 +16,28 @@ namespace n64::vi {
 
 static Registers vi;
 static u32 cpu_cycles_per_halfline;
+/* VI_V_CURRENT is not stepped by an event every half-line, but derived from the time when it is read. 'line_time'
+   is the time at which the half-line 'line_v_current' started. Events are only scheduled for the end of the field
+   and for the half-line that raises the VI interrupt. */
+static u64 line_time;
+static u32 line_v_current;
 constexpr u32 default_vsync_ntsc = 0x20D;
 
 static void CheckVideoInterrupt();
+static u32 GetHalflinesInField();
+static u32 GetHalflinesSinceLineTime();
 static bool Interlaced();
-static void OnNewHalflineEvent();
+static void OnInterruptEvent();
+static void OnNewFieldEvent();
+static void RestartHalfline();
+static void ScheduleInterruptEvent();
+static void ScheduleNewFieldEvent();
+static void UpdateVCurrent();
 constexpr std::string_view RegOffsetToStr(u32 reg_offset);
 
 void AddInitialEvents()
 {
-    scheduler::AddEvent(scheduler::EventType::VINewHalfline, cpu_cycles_per_halfline, OnNewHalflineEvent);
+    RestartHalfline();
 }
 
 void CheckVideoInterrupt()
@@ -38,6 +51,22 @@ void CheckVideoInterrupt()
     }
 }
 
+/* Counted from 'line_time'; the field ends once VI_V_CURRENT would reach VI_V_SYNC. */
+u32 GetHalflinesInField()
+{
+    return line_v_current < vi.v_sync ? (vi.v_sync - line_v_current + 1) / 2 : 1;
+}
+
+u32 GetHalflinesSinceLineTime()
+{
+    return u32((scheduler::GetTime() - line_time) / cpu_cycles_per_halfline);
+}
+
+s64 GetCyclesUntilNextHalfline()
+{
+    return cpu_cycles_per_halfline - s64((scheduler::GetTime() - line_time) % cpu_cycles_per_halfline);
+}
+
 void Initialize()
 {
     vi = {};
@@ -48,7 +77,8 @@ void Initialize()
     vi.v_sync = default_vsync_ntsc; /* todo: pal */
     vi.h_sync = 0x15'07FF;
     cpu_cycles_per_halfline = cpu_cycles_per_frame / (vi.v_sync >> 1);
-    scheduler::ChangeEventTime(scheduler::EventType::VINewHalfline, cpu_cycles_per_halfline);
+    line_time = scheduler::GetTime();
+    line_v_current = 0;
 }
 
 bool Interlaced()
@@ -56,27 +86,80 @@ bool Interlaced()
     return vi.ctrl & 0x40;
 }
 
-void OnNewHalflineEvent()
+/* Only scheduled while the interrupt is enabled, for the half-line where VI_V_CURRENT matches VI_V_INTR */
+void OnInterruptEvent()
 {
-    vi.v_current += 2;
-    if (vi.v_current >= vi.v_sync) {
-        u32 field = vi.v_current & 1;
-        vi.v_current = (field ^ 1) & u32(Interlaced());
-        rdp::implementation->UpdateScreen();
-    }
+    mi::RaiseInterrupt(mi::InterruptType::VI);
+}
+
+void OnNewFieldEvent()
+{
+    line_time += u64(GetHalflinesInField()) * cpu_cycles_per_halfline;
+    u32 field = line_v_current & 1;
+    line_v_current = (field ^ 1) & u32(Interlaced());
+    vi.v_current = line_v_current;
+    scheduler::CatchUpRsp(); /* the RSP may not have submitted all RDP commands of the field yet */
+    rdp::implementation->UpdateScreen();
     CheckVideoInterrupt();
-    scheduler::AddEvent(scheduler::EventType::VINewHalfline, cpu_cycles_per_halfline, OnNewHalflineEvent);
+    ScheduleNewFieldEvent();
+    ScheduleInterruptEvent();
 }
 
 Registers const& ReadAllRegisters()
 {
+    UpdateVCurrent();
     return vi;
 }
 
+/* Starts the half-line of the last known VI_V_CURRENT anew, as stepping by half-lines did on a write to VI_V_SYNC */
+void RestartHalfline()
+{
+    line_time = scheduler::GetTime();
+    line_v_current = vi.v_current;
+    ScheduleNewFieldEvent();
+    ScheduleInterruptEvent();
+}
+
+/* The interrupt is checked for at the start of every half-line; only the half-line of the current field where
+   VI_V_CURRENT matches VI_V_INTR can raise it. The first half-line of a field is checked by OnNewFieldEvent. */
+void ScheduleInterruptEvent()
+{
+    u32 mask = 0x3fe | ~vi.v_sync & 1;
+    bool int_enable = (vi.ctrl & 3) != 0;
+    if (!int_enable || (line_v_current & mask & 1) != (vi.v_intr & mask & 1)
+        || (vi.v_intr & 0x3FE) <= (line_v_current & 0x3FE)) {
+        scheduler::RemoveEvent(scheduler::EventType::VIInterrupt);
+        return;
+    }
+    u32 halfline = ((vi.v_intr & 0x3FE) - (line_v_current & 0x3FE)) / 2;
+    if (halfline <= GetHalflinesSinceLineTime() || halfline >= GetHalflinesInField()) {
+        scheduler::RemoveEvent(scheduler::EventType::VIInterrupt);
+        return;
+    }
+    u64 time = line_time + u64(halfline) * cpu_cycles_per_halfline;
+    scheduler::AddEvent(scheduler::EventType::VIInterrupt, s64(time - scheduler::GetTime()), OnInterruptEvent);
+}
+
+void ScheduleNewFieldEvent()
+{
+    u64 time = line_time + u64(GetHalflinesInField()) * cpu_cycles_per_halfline;
+    scheduler::AddEvent(scheduler::EventType::VINewField, s64(time - scheduler::GetTime()), OnNewFieldEvent);
+}
+
+void UpdateVCurrent()
+{
+    /* Until the new field event has fired, the last half-line of the field lasts */
+    u32 halflines = std::min(GetHalflinesSinceLineTime(), GetHalflinesInField() - 1);
+    vi.v_current = line_v_current + 2 * halflines;
+}
+
 u32 ReadReg(u32 addr)
 {
     static_assert(sizeof(vi) >> 2 == 0x10);
     u32 offset = addr >> 2 & 0xF;
+    if (offset == Register::VCurrent) {
+        UpdateVCurrent();
+    }
     u32 ret = std::bit_cast<std::array<u32, 16>>(vi)[offset];
     if constexpr (log_io_vi) {
         LogInfo("VI: {} => ${:08X}", RegOffsetToStr(offset), ret);
@@ -116,22 +199,29 @@ void WriteReg(u32 addr, u32 data)
     }
 
     switch (offset) {
-    case Register::Ctrl: vi.ctrl = data; break;
+    case Register::Ctrl:
+        vi.ctrl = data;
+        ScheduleInterruptEvent();
+        break;
 
     case Register::Origin: vi.origin = data & 0xFF'FFFF; break;
 
     case Register::Width: vi.width = data & 0xFFF; break;
 
-    case Register::VIntr: vi.v_intr = data & 0x3FF; break;
+    case Register::VIntr:
+        vi.v_intr = data & 0x3FF;
+        ScheduleInterruptEvent();
+        break;
 
     case Register::VCurrent: mi::ClearInterrupt(mi::InterruptType::VI); break;
 
     case Register::Burst: vi.burst = data & 0x3FFF'FFFF; break;
 
     case Register::VSync:
+        UpdateVCurrent();
         vi.v_sync = data & 0x3FF ? data & 0x3FF : default_vsync_ntsc; /* todo: pal */
         cpu_cycles_per_halfline = cpu_cycles_per_frame / (vi.v_sync >> 1);
-        scheduler::ChangeEventTime(scheduler::EventType::VINewHalfline, cpu_cycles_per_halfline);
+        RestartHalfline();
         break;
 
     case Register::HSync: vi.h_sync = data & 0x1F'0FFF; break;
@@ -29,6 +29,7 @@ struct Registers {
 };
 
 void AddInitialEvents();
+s64 GetCyclesUntilNextHalfline();
 void Initialize();
 Registers const& ReadAllRegisters();
 u32 ReadReg(u32 addr);
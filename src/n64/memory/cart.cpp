@@ -47,6 +47,17 @@ u8* GetPointerToSram(u32 addr)
     return sram.empty() ? nullptr : sram.data() + (addr & (sram_size - 1));
 }
 
+/* CRC1 and CRC2 of the ROM header, identifying the game */
+u64 GetRomHeaderCrc()
+{
+    if (rom.size() < 0x18) {
+        return 0;
+    }
+    u64 crc;
+    std::memcpy(&crc, rom.data() + 0x10, sizeof(crc));
+    return std::byteswap(crc);
+}
+
 Status LoadRom(std::filesystem::path const& rom_path)
 {
     std::expected<std::vector<u8>, std::string> expected_rom = OpenFile(rom_path);
@@ -11,6 +11,7 @@ namespace n64::cart {
 size_t GetNumberOfBytesUntilRomEnd(u32 addr);
 u8* GetPointerToRom(u32 addr);
 u8* GetPointerToSram(u32 addr);
+u64 GetRomHeaderCrc();
 Status LoadRom(std::filesystem::path const& rom_path);
 Status LoadSram(std::filesystem::path const& sram_path);
 template<std::signed_integral Int> Int ReadDma(u32 addr);
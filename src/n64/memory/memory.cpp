@@ -11,6 +11,7 @@
 #include "rdp/rdp.hpp"
 #include "rdram.hpp"
 #include "rsp/rsp.hpp"
+#include "scheduler.hpp"
 
 #include <bit>
 
@@ -44,9 +45,9 @@ template<std::signed_integral Int> Int Read(u32 addr)
         switch ((addr >> 20) - 0x3F) {
         case 0: /* $03F0'0000 - $03FF'FFFF */ return READ_INTERFACE(rdram, Int, addr);
         case 1: /* $0400'0000 - $040F'FFFF */ return rsp::ReadMemoryCpu<Int>(addr);
-        case 2: /* $0410'0000 - $041F'FFFF */ return READ_INTERFACE(rdp, Int, addr);
+        case 2: /* $0410'0000 - $041F'FFFF */ scheduler::CatchUpRsp(); return READ_INTERFACE(rdp, Int, addr);
         case 3: /* $0420'0000 - $042F'FFFF */ LogWarn("Unexpected cpu read to address ${:08X}", addr); return Int{};
-        case 4: /* $0430'0000 - $043F'FFFF */ return READ_INTERFACE(mi, Int, addr);
+        case 4: /* $0430'0000 - $043F'FFFF */ scheduler::CatchUpRsp(); return READ_INTERFACE(mi, Int, addr);
         case 5: /* $0440'0000 - $044F'FFFF */ return READ_INTERFACE(vi, Int, addr);
         case 6: /* $0450'0000 - $045F'FFFF */ return READ_INTERFACE(ai, Int, addr);
         case 7: /* $0460'0000 - $046F'FFFF */ return READ_INTERFACE(pi, Int, addr);
@@ -78,7 +79,10 @@ template<size_t access_size, typename... MaskT> void Write(u32 addr, s64 data, M
         switch ((addr >> 20) - 0x3F) {
         case 0: /* $03F0'0000 - $03FF'FFFF */ WRITE_INTERFACE(rdram, access_size, addr, data); break;
         case 1: /* $0400'0000 - $040F'FFFF */ rsp::WriteMemoryCpu<access_size>(addr, data); break;
-        case 2: /* $0410'0000 - $041F'FFFF */ WRITE_INTERFACE(rdp, access_size, addr, data); break;
+        case 2: /* $0410'0000 - $041F'FFFF */
+            scheduler::CatchUpRsp();
+            WRITE_INTERFACE(rdp, access_size, addr, data);
+            break;
         case 3: /* $0420'0000 - $042F'FFFF */ LogWarn("Unexpected cpu write to address ${:08X}", addr); break;
         case 4: /* $0430'0000 - $043F'FFFF */ WRITE_INTERFACE(mi, access_size, addr, data); break;
         case 5: /* $0440'0000 - $044F'FFFF */ WRITE_INTERFACE(vi, access_size, addr, data); break;
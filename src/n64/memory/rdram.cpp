@@ -1,9 +1,17 @@
 #include "rdram.hpp"
+#include "fatal_error.hpp"
+#include "platform.hpp"
 #include "vr4300/recompiler.hpp"
 
 #include <bit>
 #include <cstring>
 
+#if PLATFORM_LINUX
+#    include <sys/mman.h>
+#elif PLATFORM_WINDOWS
+#    include <Windows.h>
+#endif
+
 namespace n64::rdram {
 
 struct {
@@ -12,30 +20,58 @@ struct {
 } static reg;
 
 constexpr size_t rdram_expanded_size = 0x80'0000;
+/* RDRAM is placed at the start of a reservation spanning the whole physical address space, the rest of which stays
+   inaccessible. The CPU recompiler relies on this for its fastmem accesses; any access past RDRAM faults. */
+constexpr size_t rdram_reservation_size = 0x2000'0000;
 
-/* Note: could not use std::array here as .data() does not become properly aligned */
-/* TODO: parallel-rdp required 4096 on my system. Investigate further. */
-alignas(4096) static u8 rdram[rdram_expanded_size]; /* TODO: make it dynamic? */
+/* Page-aligned, as required by parallel-rdp */
+static u8* rdram;
+
+static void AllocateMemory()
+{
+#if PLATFORM_LINUX
+    void* reservation =
+      mmap(nullptr, rdram_reservation_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reservation == MAP_FAILED) {
+        FATAL("Failed to reserve {} bytes of address space for RDRAM", rdram_reservation_size);
+    }
+    if (mprotect(reservation, rdram_expanded_size, PROT_READ | PROT_WRITE) != 0) {
+        FATAL("Failed to commit {} bytes of memory for RDRAM", rdram_expanded_size);
+    }
+#elif PLATFORM_WINDOWS
+    void* reservation = VirtualAlloc(nullptr, rdram_reservation_size, MEM_RESERVE, PAGE_NOACCESS);
+    if (!reservation) {
+        FATAL("Failed to reserve {} bytes of address space for RDRAM", rdram_reservation_size);
+    }
+    if (!VirtualAlloc(reservation, rdram_expanded_size, MEM_COMMIT, PAGE_READWRITE)) {
+        FATAL("Failed to commit {} bytes of memory for RDRAM", rdram_expanded_size);
+    }
+#endif
+    rdram = static_cast<u8*>(reservation);
+}
 
 size_t GetNumberOfBytesUntilMemoryEnd(u32 addr)
 {
     /* TODO handle mirroring (for DMA) */
-    return sizeof(rdram) - (addr & (sizeof(rdram) - 1));
+    return rdram_expanded_size - (addr & (rdram_expanded_size - 1));
 }
 
 u8* GetPointerToMemory(u32 addr)
 {
-    return rdram + (addr & (sizeof(rdram) - 1));
+    return rdram + (addr & (rdram_expanded_size - 1));
 }
 
 size_t GetSize()
 {
-    return sizeof(rdram);
+    return rdram_expanded_size;
 }
 
 void Initialize()
 {
-    std::memset(rdram, 0, sizeof(rdram));
+    if (!rdram) {
+        AllocateMemory();
+    }
+    std::memset(rdram, 0, rdram_expanded_size);
     std::memset(&reg, 0, sizeof(reg));
     /* values taken from Peter Lemon RDRAMTest */
     reg.device_type = 0xB419'0010;
@@ -49,7 +85,7 @@ template<std::signed_integral Int> Int Read(u32 addr)
     // RDRAM is stored in LE, word-wise
     if constexpr (sizeof(Int) == 1) addr ^= 3;
     if constexpr (sizeof(Int) == 2) addr ^= 2;
-    u8 const* rdram_src = rdram + (addr & (sizeof(rdram) - 1));
+    u8 const* rdram_src = rdram + (addr & (rdram_expanded_size - 1));
     Int ret;
     if constexpr (sizeof(Int) <= 4) {
         std::memcpy(&ret, rdram_src, sizeof(Int));
@@ -73,7 +109,7 @@ u32 ReadReg(u32 addr)
 u64 RdpReadCommand(u32 addr)
 { // addr is aligned to 8 bytes
     u64 command;
-    std::memcpy(&command, &rdram[addr & (sizeof(rdram) - 1)], 8);
+    std::memcpy(&command, &rdram[addr & (rdram_expanded_size - 1)], 8);
     return command;
 }
 
@@ -89,7 +125,7 @@ template<u32 access_size, typename... MaskT> void Write(u32 addr, s64 data, Mask
     }
     if constexpr (access_size == 1) addr ^= 3;
     if constexpr (access_size == 2) addr ^= 2;
-    addr &= sizeof(rdram) - 1;
+    addr &= rdram_expanded_size - 1;
     u8* rdram_dst = rdram + addr;
     auto to_write = [&] {
         if constexpr (access_size == 1) return u8(data);
@@ -54,6 +54,17 @@ constexpr u32 cmd_buffer_word_capacity = cmd_buffer.size();
 static void LoadExecuteCommands();
 constexpr std::string_view RegOffsetToStr(u32 reg_offset);
 
+/* Also used by the RSP to submit the commands of HLE graphics tasks */
+void ExecuteCommand(u32 cmd_len, u32* cmd)
+{
+    implementation->EnqueueCommand(cmd_len, cmd);
+    if ((cmd[0] >> 24 & 0x3F) == 0x29) { /* full sync command */
+        implementation->OnFullSync();
+        dp.status.pipe_busy = dp.status.start_gclk = 0;
+        mi::RaiseInterrupt(mi::InterruptType::DP);
+    }
+}
+
 void Initialize()
 {
     dp = {};
@@ -100,12 +111,7 @@ void LoadExecuteCommands()
             return;
         }
         if (opcode >= 8) {
-            implementation->EnqueueCommand(cmd_len, &cmd_buffer[queue_word_offset]);
-            if (opcode == 0x29) { /* full sync command */
-                implementation->OnFullSync();
-                dp.status.pipe_busy = dp.status.start_gclk = 0;
-                mi::RaiseInterrupt(mi::InterruptType::DP);
-            }
+            ExecuteCommand(cmd_len, &cmd_buffer[queue_word_offset]);
         }
         queue_word_offset += cmd_len;
     }
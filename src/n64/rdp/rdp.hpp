@@ -10,6 +10,7 @@ struct SDL_Window;
 
 namespace n64::rdp {
 
+void ExecuteCommand(u32 cmd_len, u32* cmd);
 void Initialize();
 u32 ReadReg(u32 addr);
 void WriteReg(u32 addr, u32 data);
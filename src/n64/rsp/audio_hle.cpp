@@ -0,0 +1,588 @@
+#include "hle.hpp"
+#include "log.hpp"
+#include "memory/rdram.hpp"
+#include "vu.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+
+/* High-level emulation of the standard audio microcode (ABI 1). The command list of a task is run natively, with the
+   sample kernels working on eight samples at a time. The working memory of the microcode is kept apart from DMEM, in
+   the same big-endian layout. The state that the microcode keeps in RDRAM between tasks (e.g. of the envelope mixer)
+   is only ever read back by the microcode itself, so its layout here is our own. */
+
+namespace n64::rsp::hle {
+
+enum class AudioCommand {
+    Noop,
+    Adpcm,
+    ClearBuff,
+    EnvMixer,
+    LoadBuff,
+    Resample,
+    SaveBuff,
+    Segment,
+    SetBuff,
+    SetVol,
+    DmemMove,
+    LoadAdpcm,
+    Mixer,
+    Interleave,
+    Polef,
+    SetLoop
+};
+
+/* The residuals of eight ADPCM samples are turned into samples by a product with a lower triangular matrix, plus the
+   contribution of the last two samples; one of these per codebook entry */
+struct AdpcmPredictor {
+    std::array<m128i, 8> rows;
+    std::array<m128i, 2> last_sample_coeffs; /* pairs of (book1[i], book2[i]) */
+};
+
+struct Ramp {
+    s32 value, target, step;
+};
+
+constexpr u8 flag_init = 1;
+constexpr u8 flag_loop = 2; /* ADPCM, RESAMPLE */
+constexpr u8 flag_left = 2; /* SETVOL */
+constexpr u8 flag_vol = 4; /* SETVOL */
+constexpr u8 flag_aux = 8; /* ENVMIXER, SETBUFF, SETVOL */
+constexpr u16 buffer_base = 0x5C0; /* buffer addresses in the command list are relative to this DMEM address */
+
+/* Four-tap interpolation coefficients in Q15, for 64 phases between two samples: the table of the ABI1 microcode */
+constexpr std::array<std::array<s16, 4>, 64> resample_lut = { {
+    { 3129, 26285, 3398, -33 }, { 2873, 26262, 3679, -40 },
+    { 2628, 26217, 3971, -48 }, { 2394, 26150, 4276, -56 },
+    { 2173, 26061, 4592, -65 }, { 1963, 25950, 4920, -74 },
+    { 1764, 25817, 5260, -84 }, { 1576, 25663, 5611, -95 },
+    { 1399, 25487, 5974, -106 }, { 1233, 25291, 6347, -118 },
+    { 1077, 25075, 6732, -130 }, { 932, 24838, 7127, -143 },
+    { 796, 24583, 7532, -156 }, { 671, 24309, 7947, -170 },
+    { 554, 24016, 8371, -184 }, { 446, 23706, 8804, -198 },
+    { 347, 23379, 9246, -212 }, { 257, 23036, 9696, -226 },
+    { 174, 22678, 10153, -240 }, { 99, 22304, 10618, -254 },
+    { 31, 21917, 11088, -268 }, { -30, 21517, 11564, -280 },
+    { -84, 21104, 12045, -293 }, { -132, 20679, 12531, -304 },
+    { -173, 20244, 13020, -314 }, { -210, 19799, 13512, -323 },
+    { -241, 19345, 14006, -330 }, { -267, 18882, 14501, -336 },
+    { -289, 18413, 14997, -340 }, { -306, 17937, 15493, -341 },
+    { -320, 17456, 15988, -340 }, { -330, 16970, 16480, -337 },
+    { -337, 16480, 16970, -330 }, { -340, 15988, 17456, -320 },
+    { -341, 15493, 17937, -306 }, { -340, 14997, 18413, -289 },
+    { -336, 14501, 18882, -267 }, { -330, 14006, 19345, -241 },
+    { -323, 13512, 19799, -210 }, { -314, 13020, 20244, -173 },
+    { -304, 12531, 20679, -132 }, { -293, 12045, 21104, -84 },
+    { -280, 11564, 21517, -30 }, { -268, 11088, 21917, 31 },
+    { -254, 10618, 22304, 99 }, { -240, 10153, 22678, 174 },
+    { -226, 9696, 23036, 257 }, { -212, 9246, 23379, 347 },
+    { -198, 8804, 23706, 446 }, { -184, 8371, 24016, 554 },
+    { -170, 7947, 24309, 671 }, { -156, 7532, 24583, 796 },
+    { -143, 7127, 24838, 932 }, { -130, 6732, 25075, 1077 },
+    { -118, 6347, 25291, 1233 }, { -106, 5974, 25487, 1399 },
+    { -95, 5611, 25663, 1576 }, { -84, 5260, 25817, 1764 },
+    { -74, 4920, 25950, 1963 }, { -65, 4592, 26061, 2173 },
+    { -56, 4276, 26150, 2394 }, { -48, 3971, 26217, 2628 },
+    { -40, 3679, 26262, 2873 }, { -33, 3398, 26285, 3129 },
+} };
+
+alignas(16) static std::array<u8, 0x1000 + 16> buffer; /* + 16: vector accesses at the end do not wrap around */
+static std::array<AdpcmPredictor, 16> adpcm_predictors;
+alignas(16) static std::array<s16, 16 * 16> adpcm_table; /* 16 codebook entries of two books of eight */
+static std::array<u32, 64> segments;
+static std::array<s16, 2> env_vol, env_target; /* left, right */
+static std::array<s32, 2> env_rate;
+static u32 loop_addr;
+static u16 buf_in, buf_out, buf_count;
+static u16 buf_dry_right, buf_wet_left, buf_wet_right;
+static s16 dry_gain, wet_gain;
+
+static void Adpcm(u32 w1, u32 w2);
+constexpr u32 AlignUp(u32 value, u32 alignment);
+static s16 ClampS16(s32 value);
+static void ClearBuff(u32 w1, u32 w2);
+static void DmemMove(u32 w1, u32 w2);
+static void EnvMixer(u32 w1, u32 w2);
+static u32 GetAddress(u32 segmented_addr);
+static void Interleave(u32 w1, u32 w2);
+static void LoadAdpcm(u32 w1, u32 w2);
+static void LoadBuff(u32 w1, u32 w2);
+static m128i LoadFourSamples(u32 addr);
+static m128i LoadSamples(u32 addr);
+static void Mixer(u32 w1, u32 w2);
+static m128i MixSamples(m128i dst, m128i src, m128i gains);
+static void Polef(u32 w1, u32 w2);
+static m128i PredictAdpcm(AdpcmPredictor const& predictor, m128i residuals, s16 l1, s16 l2);
+static s16 ReadSample(u32 addr);
+static void Resample(u32 w1, u32 w2);
+static void SaveBuff(u32 w1, u32 w2);
+static void Segment(u32 w1, u32 w2);
+static void SetBuff(u32 w1, u32 w2);
+static void SetLoop(u32 w1, u32 w2);
+static void SetVol(u32 w1, u32 w2);
+static s16 StepRamp(Ramp& ramp);
+static void StoreSamples(u32 addr, m128i samples);
+static void UpdateAdpcmPredictors();
+static void WriteSample(u32 addr, s16 sample);
+
+void Adpcm(u32 w1, u32 w2)
+{
+    u8 flags = u8(w1 >> 16);
+    u32 address = GetAddress(w2);
+    u32 dmemo = buf_out, dmemi = buf_in;
+    alignas(16) std::array<s16, 16> last_frame{};
+    if (!(flags & flag_init)) {
+        u32 last_frame_addr = flags & flag_loop ? loop_addr : address;
+        for (u32 i = 0; i < 16; ++i) {
+            last_frame[i] = rdram::Read<s16>(last_frame_addr + 2 * i);
+        }
+    }
+    m128i frame_lo = _mm_load_si128(reinterpret_cast<m128i const*>(&last_frame[0]));
+    m128i frame_hi = _mm_load_si128(reinterpret_cast<m128i const*>(&last_frame[8]));
+    StoreSamples(dmemo, frame_lo);
+    StoreSamples(dmemo + 16, frame_hi);
+    dmemo += 32;
+    for (u32 count = AlignUp(buf_count, 32); count > 0; count -= 32) {
+        u8 code = buffer[dmemi++ & 0xFFF];
+        u32 scale = code >> 4;
+        u32 rshift = scale < 12 ? 12 - scale : 0;
+        alignas(16) std::array<s16, 16> residuals;
+        for (u32 i = 0; i < 8; ++i) {
+            u8 byte = buffer[dmemi++ & 0xFFF];
+            residuals[2 * i] = s16(u16(byte & 0xF0) << 8) >> rshift;
+            residuals[2 * i + 1] = s16(u16(byte & 0x0F) << 12) >> rshift;
+        }
+        AdpcmPredictor const& predictor = adpcm_predictors[code & 0xF];
+        frame_lo = PredictAdpcm(predictor,
+          _mm_load_si128(reinterpret_cast<m128i const*>(&residuals[0])),
+          s16(_mm_extract_epi16(frame_hi, 6)),
+          s16(_mm_extract_epi16(frame_hi, 7)));
+        frame_hi = PredictAdpcm(predictor,
+          _mm_load_si128(reinterpret_cast<m128i const*>(&residuals[8])),
+          s16(_mm_extract_epi16(frame_lo, 6)),
+          s16(_mm_extract_epi16(frame_lo, 7)));
+        StoreSamples(dmemo, frame_lo);
+        StoreSamples(dmemo + 16, frame_hi);
+        dmemo += 32;
+    }
+    _mm_store_si128(reinterpret_cast<m128i*>(&last_frame[0]), frame_lo);
+    _mm_store_si128(reinterpret_cast<m128i*>(&last_frame[8]), frame_hi);
+    for (u32 i = 0; i < 16; ++i) {
+        rdram::Write<2>(address + 2 * i, last_frame[i]);
+    }
+}
+
+constexpr u32 AlignUp(u32 value, u32 alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+/* Identified by the data segment of the microcode, which holds the entry points of the command handlers */
+bool CanRunAudioTask(Task const& task)
+{
+    u32 data = task.ucode_data;
+    return u32(rdram::Read<s32>(data)) == 1 && u32(rdram::Read<s32>(data + 0x30)) == 0xF000'0F00
+        && u32(rdram::Read<s32>(data + 0x28)) == 0x1E24'138C;
+}
+
+s16 ClampS16(s32 value)
+{
+    return s16(std::clamp(value, -0x8000, 0x7FFF));
+}
+
+void ClearBuff(u32 w1, u32 w2)
+{
+    u16 dmem = u16(w1) + buffer_base;
+    u32 count = w2 & 0xFFF;
+    for (u32 i = 0; i < AlignUp(count, 16); ++i) {
+        buffer[(dmem + i) & 0xFFF] = 0;
+    }
+}
+
+/* A forward copy, byte by byte, like the microcode; overlapping moves repeat the source */
+void DmemMove(u32 w1, u32 w2)
+{
+    u16 dmemi = u16(w1) + buffer_base;
+    u16 dmemo = u16(w2 >> 16) + buffer_base;
+    u32 count = AlignUp(u16(w2), 16);
+    for (u32 i = 0; i < count; ++i) {
+        buffer[(dmemo + i) & 0xFFF] = buffer[(dmemi + i) & 0xFFF];
+    }
+}
+
+/* Mixes the input into the dry (and with the AUX flag, the wet) buffers of both sides, with the volume of each side
+   ramping exponentially towards its target */
+void EnvMixer(u32 w1, u32 w2)
+{
+    u8 flags = u8(w1 >> 16);
+    u32 address = GetAddress(w2);
+    s16 dry = dry_gain, wet = wet_gain;
+    std::array<Ramp, 2> ramps;
+    std::array<s32, 2> exp_seq, exp_rates;
+    if (flags & flag_init) {
+        for (int i = 0; i < 2; ++i) {
+            ramps[i].value = env_vol[i] * 0x10000;
+            ramps[i].target = env_target[i] * 0x10000;
+            exp_rates[i] = env_rate[i];
+            exp_seq[i] = s32(s64(env_vol[i]) * env_rate[i]);
+        }
+    } else {
+        wet = s16(rdram::Read<s32>(address));
+        dry = s16(rdram::Read<s32>(address + 4));
+        for (u32 i = 0; i < 2; ++i) {
+            ramps[i].target = rdram::Read<s32>(address + 8 + 4 * i);
+            exp_rates[i] = rdram::Read<s32>(address + 16 + 4 * i);
+            exp_seq[i] = rdram::Read<s32>(address + 24 + 4 * i);
+            ramps[i].value = rdram::Read<s32>(address + 32 + 4 * i);
+        }
+    }
+    for (Ramp& ramp : ramps) {
+        ramp.step = ramp.target - ramp.value;
+    }
+
+    for (u32 offset = 0; offset < buf_count; offset += 16) {
+        for (int i = 0; i < 2; ++i) {
+            if (ramps[i].step != 0) {
+                exp_seq[i] = s32(s64(exp_seq[i]) * exp_rates[i] >> 16);
+                ramps[i].step = (exp_seq[i] - ramps[i].value) >> 3;
+            }
+        }
+        alignas(16) std::array<std::array<s16, 8>, 4> gains; /* dry left, dry right, wet left, wet right */
+        for (u32 i = 0; i < 8; ++i) {
+            s16 vol_left = StepRamp(ramps[0]);
+            s16 vol_right = StepRamp(ramps[1]);
+            gains[0][i] = ClampS16((vol_left * dry + 0x4000) >> 15);
+            gains[1][i] = ClampS16((vol_right * dry + 0x4000) >> 15);
+            gains[2][i] = ClampS16((vol_left * wet + 0x4000) >> 15);
+            gains[3][i] = ClampS16((vol_right * wet + 0x4000) >> 15);
+        }
+        m128i samples = LoadSamples(buf_in + offset);
+        std::array<u16, 4> outputs = { buf_out, buf_dry_right, buf_wet_left, buf_wet_right };
+        for (u32 i = 0; i < (flags & flag_aux ? 4u : 2u); ++i) {
+            u32 dst = outputs[i] + offset;
+            m128i gain = _mm_load_si128(reinterpret_cast<m128i const*>(gains[i].data()));
+            StoreSamples(dst, MixSamples(LoadSamples(dst), samples, gain));
+        }
+    }
+
+    rdram::Write<4>(address, wet);
+    rdram::Write<4>(address + 4, dry);
+    for (u32 i = 0; i < 2; ++i) {
+        rdram::Write<4>(address + 8 + 4 * i, ramps[i].target);
+        rdram::Write<4>(address + 16 + 4 * i, exp_rates[i]);
+        rdram::Write<4>(address + 24 + 4 * i, exp_seq[i]);
+        rdram::Write<4>(address + 32 + 4 * i, ramps[i].value);
+    }
+}
+
+u32 GetAddress(u32 segmented_addr)
+{
+    return (segments[segmented_addr >> 24 & 0x3F] + (segmented_addr & 0xFF'FFFF)) & 0xFF'FFFF;
+}
+
+void Interleave(u32 w1, u32 w2)
+{
+    (void)w1;
+    u16 left = u16(w2 >> 16) + buffer_base;
+    u16 right = u16(w2) + buffer_base;
+    for (u32 offset = 0; offset < AlignUp(buf_count, 16); offset += 16) {
+        m128i samples_left = LoadSamples(left + offset);
+        m128i samples_right = LoadSamples(right + offset);
+        StoreSamples(buf_out + 2 * offset, _mm_unpacklo_epi16(samples_left, samples_right));
+        StoreSamples(buf_out + 2 * offset + 16, _mm_unpackhi_epi16(samples_left, samples_right));
+    }
+}
+
+void LoadAdpcm(u32 w1, u32 w2)
+{
+    u32 address = GetAddress(w2);
+    u32 count = std::min(AlignUp(u16(w1), 8) / 2, u32(adpcm_table.size()));
+    for (u32 i = 0; i < count; ++i) {
+        adpcm_table[i] = rdram::Read<s16>(address + 2 * i);
+    }
+    UpdateAdpcmPredictors();
+}
+
+void LoadBuff(u32 w1, u32 w2)
+{
+    (void)w1;
+    u32 address = GetAddress(w2) & ~7;
+    u32 dmem = buf_in & ~3;
+    u32 count = AlignUp(buf_count, 8);
+    for (u32 i = 0; i < count; i += 4) {
+        u32 word = std::byteswap(u32(rdram::Read<s32>(address + i))); /* rsp ram BE */
+        std::memcpy(&buffer[(dmem + i) & 0xFFF], &word, 4);
+    }
+}
+
+m128i LoadFourSamples(u32 addr)
+{
+    addr &= 0xFFE;
+    if (addr <= 0xFF8) {
+        m128i samples = _mm_loadl_epi64(reinterpret_cast<m128i const*>(&buffer[addr]));
+        return _mm_shuffle_epi8(samples, byteswap16_mask);
+    } else {
+        return _mm_setr_epi16(ReadSample(addr), ReadSample(addr + 2), ReadSample(addr + 4), ReadSample(addr + 6), 0, 0, 0,
+          0);
+    }
+}
+
+m128i LoadSamples(u32 addr)
+{
+    m128i samples = _mm_loadu_si128(reinterpret_cast<m128i const*>(&buffer[addr & 0xFFF]));
+    return _mm_shuffle_epi8(samples, byteswap16_mask);
+}
+
+void Mixer(u32 w1, u32 w2)
+{
+    m128i gain = _mm_set1_epi16(s16(w1));
+    u16 dmemi = u16(w2 >> 16) + buffer_base;
+    u16 dmemo = u16(w2) + buffer_base;
+    for (u32 offset = 0; offset < AlignUp(buf_count, 32); offset += 16) {
+        StoreSamples(dmemo + offset, MixSamples(LoadSamples(dmemo + offset), LoadSamples(dmemi + offset), gain));
+    }
+}
+
+/* dst + (src * gains >> 15), clamped; the products are kept at 32 bits, so that the result is exact */
+m128i MixSamples(m128i dst, m128i src, m128i gains)
+{
+    m128i products_lo = _mm_mullo_epi16(src, gains);
+    m128i products_hi = _mm_mulhi_epi16(src, gains);
+    m128i sum_lo = _mm_add_epi32(_mm_srai_epi32(_mm_unpacklo_epi16(dst, dst), 16),
+      _mm_srai_epi32(_mm_unpacklo_epi16(products_lo, products_hi), 15));
+    m128i sum_hi = _mm_add_epi32(_mm_srai_epi32(_mm_unpackhi_epi16(dst, dst), 16),
+      _mm_srai_epi32(_mm_unpackhi_epi16(products_lo, products_hi), 15));
+    return _mm_packs_epi32(sum_lo, sum_hi);
+}
+
+/* A second-order filter over the buffer, with the coefficients in the first codebook entry of the ADPCM table */
+void Polef(u32 w1, u32 w2)
+{
+    if (buf_count == 0) {
+        return;
+    }
+    u8 flags = u8(w1 >> 16);
+    s16 gain = s16(w1);
+    u32 address = GetAddress(w2);
+    s16 l1 = 0, l2 = 0;
+    if (!(flags & flag_init)) {
+        l1 = rdram::Read<s16>(address + 4);
+        l2 = rdram::Read<s16>(address + 6);
+    }
+    s16 const* h1 = &adpcm_table[0];
+    s16 const* h2 = &adpcm_table[8];
+    std::array<s16, 8> h2_scaled;
+    for (u32 i = 0; i < 8; ++i) {
+        h2_scaled[i] = s16(h2[i] * gain >> 14);
+    }
+    u32 dmemi = buf_in, dmemo = buf_out;
+    std::array<s16, 8> frame, out;
+    for (u32 count = AlignUp(buf_count, 16); count > 0; count -= 16) {
+        for (u32 i = 0; i < 8; ++i) {
+            frame[i] = ReadSample(dmemi + 2 * i);
+        }
+        for (u32 i = 0; i < 8; ++i) {
+            s32 accu = frame[i] * gain + h1[i] * l1 + h2[i] * l2;
+            for (u32 k = 0; k < i; ++k) {
+                accu += h2_scaled[k] * frame[i - 1 - k];
+            }
+            out[i] = ClampS16(accu >> 14);
+            WriteSample(dmemo + 2 * i, out[i]);
+        }
+        l1 = out[6];
+        l2 = out[7];
+        dmemi += 16;
+        dmemo += 16;
+    }
+    for (u32 i = 0; i < 4; ++i) {
+        rdram::Write<2>(address + 2 * i, out[4 + i]);
+    }
+}
+
+m128i PredictAdpcm(AdpcmPredictor const& predictor, m128i residuals, s16 l1, s16 l2)
+{
+    std::array<m128i, 8> dots;
+    for (size_t i = 0; i < 8; ++i) {
+        dots[i] = _mm_madd_epi16(predictor.rows[i], residuals);
+    }
+    m128i sums_lo =
+      _mm_hadd_epi32(_mm_hadd_epi32(dots[0], dots[1]), _mm_hadd_epi32(dots[2], dots[3])); /* samples 0-3 */
+    m128i sums_hi =
+      _mm_hadd_epi32(_mm_hadd_epi32(dots[4], dots[5]), _mm_hadd_epi32(dots[6], dots[7])); /* samples 4-7 */
+    m128i last_samples = _mm_set1_epi32(s32(u16(l1) | u32(u16(l2)) << 16));
+    sums_lo = _mm_add_epi32(sums_lo, _mm_madd_epi16(predictor.last_sample_coeffs[0], last_samples));
+    sums_hi = _mm_add_epi32(sums_hi, _mm_madd_epi16(predictor.last_sample_coeffs[1], last_samples));
+    return _mm_packs_epi32(_mm_srai_epi32(sums_lo, 11), _mm_srai_epi32(sums_hi, 11));
+}
+
+s16 ReadSample(u32 addr)
+{
+    return s16(buffer[addr & 0xFFF] << 8 | buffer[(addr + 1) & 0xFFF]);
+}
+
+/* Resamples the input by the given pitch, with four-tap interpolation */
+void Resample(u32 w1, u32 w2)
+{
+    u8 flags = u8(w1 >> 16);
+    u32 pitch = u32(u16(w1)) << 1; /* Q16.16 */
+    u32 address = GetAddress(w2);
+    u32 ipos = (buf_in >> 1) - 4; /* in samples */
+    u32 opos = buf_out >> 1;
+    u32 pitch_accu = 0;
+    if (flags & flag_init) {
+        for (u32 i = 0; i < 4; ++i) {
+            WriteSample(2 * (ipos + i), 0);
+        }
+    } else {
+        for (u32 i = 0; i < 4; ++i) {
+            WriteSample(2 * (ipos + i), rdram::Read<s16>(address + 2 * i));
+        }
+        pitch_accu = u16(rdram::Read<s16>(address + 8));
+    }
+    for (u32 count = AlignUp(buf_count, 16) / 2; count > 0; --count) {
+        m128i coeffs = _mm_loadl_epi64(reinterpret_cast<m128i const*>(resample_lut[pitch_accu >> 10].data()));
+        m128i dots = _mm_madd_epi16(LoadFourSamples(2 * ipos), coeffs);
+        s32 sum = _mm_cvtsi128_si32(_mm_add_epi32(dots, _mm_srli_si128(dots, 4)));
+        WriteSample(2 * opos++, ClampS16(sum >> 15));
+        pitch_accu += pitch;
+        ipos += pitch_accu >> 16;
+        pitch_accu &= 0xFFFF;
+    }
+    for (u32 i = 0; i < 4; ++i) {
+        rdram::Write<2>(address + 2 * i, ReadSample(2 * (ipos + i)));
+    }
+    rdram::Write<2>(address + 8, pitch_accu);
+}
+
+void RunAudioTask(Task const& task)
+{
+    for (u32 i = 0; i < task.data_size; i += 8) {
+        u32 w1 = u32(rdram::Read<s32>(task.data_ptr + i));
+        u32 w2 = u32(rdram::Read<s32>(task.data_ptr + i + 4));
+        switch (AudioCommand(w1 >> 24 & 0x7F)) {
+        case AudioCommand::Noop: break;
+        case AudioCommand::Adpcm: Adpcm(w1, w2); break;
+        case AudioCommand::ClearBuff: ClearBuff(w1, w2); break;
+        case AudioCommand::EnvMixer: EnvMixer(w1, w2); break;
+        case AudioCommand::LoadBuff: LoadBuff(w1, w2); break;
+        case AudioCommand::Resample: Resample(w1, w2); break;
+        case AudioCommand::SaveBuff: SaveBuff(w1, w2); break;
+        case AudioCommand::Segment: Segment(w1, w2); break;
+        case AudioCommand::SetBuff: SetBuff(w1, w2); break;
+        case AudioCommand::SetVol: SetVol(w1, w2); break;
+        case AudioCommand::DmemMove: DmemMove(w1, w2); break;
+        case AudioCommand::LoadAdpcm: LoadAdpcm(w1, w2); break;
+        case AudioCommand::Mixer: Mixer(w1, w2); break;
+        case AudioCommand::Interleave: Interleave(w1, w2); break;
+        case AudioCommand::Polef: Polef(w1, w2); break;
+        case AudioCommand::SetLoop: SetLoop(w1, w2); break;
+        default: LogWarn("Unknown audio command ${:08X} ${:08X}", w1, w2);
+        }
+    }
+}
+
+void SaveBuff(u32 w1, u32 w2)
+{
+    (void)w1;
+    u32 address = GetAddress(w2) & ~7;
+    u32 dmem = buf_out & ~3;
+    u32 count = AlignUp(buf_count, 8);
+    for (u32 i = 0; i < count; i += 4) {
+        u32 word;
+        std::memcpy(&word, &buffer[(dmem + i) & 0xFFF], 4);
+        rdram::Write<4>(address + i, std::byteswap(word)); /* rsp ram BE */
+    }
+}
+
+void Segment(u32 w1, u32 w2)
+{
+    (void)w1;
+    segments[w2 >> 24 & 0x3F] = w2 & 0xFF'FFFF;
+}
+
+void SetBuff(u32 w1, u32 w2)
+{
+    u8 flags = u8(w1 >> 16);
+    if (flags & flag_aux) {
+        buf_dry_right = u16(w1) + buffer_base;
+        buf_wet_left = u16(w2 >> 16) + buffer_base;
+        buf_wet_right = u16(w2) + buffer_base;
+    } else {
+        buf_in = u16(w1) + buffer_base;
+        buf_out = u16(w2 >> 16) + buffer_base;
+        buf_count = u16(w2);
+    }
+}
+
+void SetLoop(u32 w1, u32 w2)
+{
+    (void)w1;
+    loop_addr = GetAddress(w2);
+}
+
+void SetVol(u32 w1, u32 w2)
+{
+    u8 flags = u8(w1 >> 16);
+    if (flags & flag_aux) {
+        dry_gain = s16(w1);
+        wet_gain = s16(w2);
+    } else {
+        int side = flags & flag_left ? 0 : 1;
+        if (flags & flag_vol) {
+            env_vol[side] = s16(w1);
+        } else {
+            env_target[side] = s16(w1);
+            env_rate[side] = s32(w2);
+        }
+    }
+}
+
+s16 StepRamp(Ramp& ramp)
+{
+    ramp.value += ramp.step;
+    bool target_reached = ramp.step <= 0 ? ramp.value <= ramp.target : ramp.value >= ramp.target;
+    if (target_reached) {
+        ramp.value = ramp.target;
+        ramp.step = 0;
+    }
+    return s16(ramp.value >> 16);
+}
+
+void StoreSamples(u32 addr, m128i samples)
+{
+    _mm_storeu_si128(reinterpret_cast<m128i*>(&buffer[addr & 0xFFF]), _mm_shuffle_epi8(samples, byteswap16_mask));
+}
+
+void UpdateAdpcmPredictors()
+{
+    for (u32 entry = 0; entry < 16; ++entry) {
+        s16 const* book1 = &adpcm_table[16 * entry];
+        s16 const* book2 = book1 + 8;
+        AdpcmPredictor& predictor = adpcm_predictors[entry];
+        for (u32 i = 0; i < 8; ++i) {
+            alignas(16) std::array<s16, 8> row{};
+            for (u32 k = 0; k < i; ++k) {
+                row[k] = book2[i - 1 - k];
+            }
+            row[i] = 1 << 11;
+            predictor.rows[i] = _mm_load_si128(reinterpret_cast<m128i const*>(row.data()));
+        }
+        alignas(16) std::array<s16, 16> coeffs;
+        for (u32 i = 0; i < 8; ++i) {
+            coeffs[2 * i] = book1[i];
+            coeffs[2 * i + 1] = book2[i];
+        }
+        predictor.last_sample_coeffs[0] = _mm_load_si128(reinterpret_cast<m128i const*>(&coeffs[0]));
+        predictor.last_sample_coeffs[1] = _mm_load_si128(reinterpret_cast<m128i const*>(&coeffs[8]));
+    }
+}
+
+void WriteSample(u32 addr, s16 sample)
+{
+    buffer[addr & 0xFFF] = u8(sample >> 8);
+    buffer[(addr + 1) & 0xFFF] = u8(sample);
+}
+
+} // namespace n64::rsp::hle
@@ -0,0 +1,1023 @@
+#include "hle.hpp"
+#include "log.hpp"
+#include "memory/rdram.hpp"
+#include "rdp/rdp.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <immintrin.h>
+#include <numbers>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* High-level emulation of the Fast3D family of graphics microcode (Fast3D, F3DEX and F3DEX2). The display list of a
+   task is walked natively. Vertices are transformed, lit and tested against the clip volume with SSE, triangles
+   that cross it are clipped in clip space, and the RDP triangle commands are set up on the host and submitted to the
+   RDP directly, rather than through an output buffer and DPC_START/DPC_END. They are held back until the whole display
+   list has been walked: a task that turns out to need something that is not emulated here (e.g. G_LOAD_UCODE) has
+   then had no effect, and runs on the RSP instead. */
+
+namespace n64::rsp::hle {
+
+enum class Gbi {
+    F3d, /* Fast3D */
+    F3dex, /* F3DEX 1.x */
+    F3dex2
+};
+
+/* The geometry mode bits moved around between the GBI versions */
+struct GeometryModeBits {
+    u32 zbuffer, shade, cull_front, cull_back, fog, lighting, texture_gen, texture_gen_linear, shading_smooth;
+};
+
+struct Matrix {
+    __m128 rows[4]; /* vectors are multiplied from the left, like in the GBI */
+};
+
+struct Light {
+    __m128 color; /* r, g, b, 0; 0-255 */
+    __m128 dir; /* x, y, z, 0; -1-1 */
+};
+
+struct Vertex {
+    __m128 pos; /* clip space x, y, z, w */
+    __m128 color; /* r, g, b, a; 0-255 */
+    __m128 texcoords; /* s, t, 0, 0; in texels * 32, i.e. the s10.5 of the RDP, scaled */
+    u32 clip_codes; /* bits 0-2: x, y, z above the clip volume; 3-5: below it */
+};
+
+struct ScreenVertex {
+    float x, y, z, w; /* in pixels, pixels, RDP depth units, 1/w */
+    float s, t;
+    float r, g, b, a;
+};
+
+constexpr GeometryModeBits gbi1_geometry_mode_bits = {
+    0x1, 0x4, 0x1000, 0x2000, 0x1'0000, 0x2'0000, 0x4'0000, 0x8'0000, 0x200
+};
+constexpr GeometryModeBits gbi2_geometry_mode_bits = {
+    0x1, 0x4, 0x200, 0x400, 0x1'0000, 0x2'0000, 0x4'0000, 0x8'0000, 0x20'0000
+};
+constexpr float guard_band = 2.0f; /* x and y are clipped at this multiple of w, so that the RDP edge formats hold */
+constexpr u32 max_clipped_vertices = 3 + 6;
+constexpr u32 max_commands_per_task = 1 << 22; /* bail out of a display list that loops */
+constexpr u32 othermode_h_persp_tex_en = 1 << 19;
+
+static Gbi gbi;
+static GeometryModeBits const* geometry_mode_bits;
+static std::array<u32, 16> segments;
+static std::array<Vertex, 64> vertices;
+static std::array<Matrix, 32> modelview_stack;
+static u32 modelview_index;
+static Matrix projection, combined;
+static std::array<Light, 8> lights; /* the ambient light follows the directional ones */
+static std::array<Light, 2> lookat;
+static __m128 light_dirs_model[8]; /* directions of the lights and lookat vectors in model space */
+static __m128 lookat_dirs_model[2];
+static u32 num_lights;
+static bool lights_dirty;
+static u32 geometry_mode;
+static u32 othermode_h, othermode_l;
+static __m128 viewport_scale, viewport_translate; /* x, y: pixels; z: RDP depth units */
+static s16 fog_multiplier, fog_offset;
+static struct {
+    bool on;
+    u32 tile, level;
+    float scale_s, scale_t;
+} texture;
+static u32 rdp_half_1;
+static std::array<u32, 18> dl_stack;
+static u32 dl_stack_depth;
+static u32 dl_addr;
+static bool task_done;
+static std::vector<u32> rdp_commands; /* of the current task; each is preceded by its length in words */
+
+static float Dot3(__m128 a, __m128 b);
+static void DrawQuad(u32 w1, u32 divisor);
+static void DrawTriangle(u32 v0, u32 v1, u32 v2);
+static void DrawTriangles(u32 w0, u32 w1, u32 divisor);
+static u32 ClipPolygon(std::array<Vertex, max_clipped_vertices>& polygon, u32 num_vertices, u32 clip_codes);
+static float ClipPlaneDistance(Vertex const& vertex, u32 plane);
+static u32 ComputeClipCodes(__m128 pos);
+static void CullDisplayList(u32 first, u32 last);
+static void EndDisplayList();
+static bool GeometryMode(u32 GeometryModeBits::*bit);
+static u32 GetAddress(u32 segmented_addr);
+static std::optional<Gbi> IdentifyMicrocode(Task const& task);
+static Vertex Lerp(Vertex const& a, Vertex const& b, float t);
+static Light LoadLight(u32 addr);
+static Matrix LoadMatrix(u32 addr);
+static void LoadMatrixCommand(u32 addr, bool projection_matrix, bool load, bool push);
+static void LoadVertices(u32 addr, u32 first, u32 count);
+static void LoadViewport(u32 addr);
+static void ModifyVertex(u32 index, u32 where, u32 value);
+static Matrix Multiply(Matrix const& a, Matrix const& b);
+static void MoveWord(u32 index, u32 offset, u32 data);
+static void PopMatrices(u32 count);
+static ScreenVertex Project(Vertex const& vertex);
+static void QueueRdpCommand(u32 len, u32 const* cmd);
+static void ResetState();
+static void RunDisplayList(u32 addr, bool push);
+static bool RunGbi1Command(u32 w0, u32 w1);
+static bool RunGbi2Command(u32 w0, u32 w1);
+static void RunRdpCommand(u32 w0, u32 w1);
+static void SetOtherMode(u32& mode, u32 shift, u32 len, u32 data);
+static void SetupTriangle(ScreenVertex const* v1, ScreenVertex const* v2, ScreenVertex const* v3);
+static s32 ToS1516(float value);
+static void UpdateLightDirections();
+
+bool CanRunGraphicsTask(Task const& task)
+{
+    return IdentifyMicrocode(task).has_value();
+}
+
+/* Sutherland-Hodgman, against the planes that some vertex is outside of. The result is a convex fan. */
+u32 ClipPolygon(std::array<Vertex, max_clipped_vertices>& polygon, u32 num_vertices, u32 clip_codes)
+{
+    std::array<Vertex, max_clipped_vertices> clipped;
+    for (u32 plane = 0; plane < 6 && num_vertices >= 3; ++plane) {
+        if (!(clip_codes & 1 << plane)) continue;
+        u32 num_clipped = 0;
+        for (u32 i = 0; i < num_vertices; ++i) {
+            Vertex const& cur = polygon[i];
+            Vertex const& next = polygon[(i + 1) % num_vertices];
+            float dist_cur = ClipPlaneDistance(cur, plane);
+            float dist_next = ClipPlaneDistance(next, plane);
+            if (dist_cur >= 0) {
+                clipped[num_clipped++] = cur;
+            }
+            if ((dist_cur >= 0) != (dist_next >= 0) && num_clipped < max_clipped_vertices) {
+                clipped[num_clipped++] = Lerp(cur, next, dist_cur / (dist_cur - dist_next));
+            }
+        }
+        polygon = clipped;
+        num_vertices = num_clipped;
+    }
+    return num_vertices;
+}
+
+/* >= 0 inside. Planes 0-2 are the upper bounds of x, y, z; 3-5 the lower ones, as in the clip codes. */
+float ClipPlaneDistance(Vertex const& vertex, u32 plane)
+{
+    alignas(16) std::array<float, 4> pos;
+    _mm_store_ps(pos.data(), vertex.pos);
+    u32 axis = plane % 3;
+    float limit = pos[3] * (axis == 2 ? 1.0f : guard_band);
+    return plane < 3 ? limit - pos[axis] : limit + pos[axis];
+}
+
+u32 ComputeClipCodes(__m128 pos)
+{
+    __m128 w = _mm_shuffle_ps(pos, pos, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128 limits = _mm_mul_ps(w, _mm_setr_ps(guard_band, guard_band, 1.0f, 0.0f));
+    u32 above = _mm_movemask_ps(_mm_cmpgt_ps(pos, limits)) & 7;
+    u32 below = _mm_movemask_ps(_mm_cmplt_ps(pos, _mm_sub_ps(_mm_setzero_ps(), limits))) & 7;
+    return above | below << 3;
+}
+
+/* Ends the display list if all of the vertices are outside of the same clip plane */
+void CullDisplayList(u32 first, u32 last)
+{
+    u32 clip_codes = 0x3F;
+    for (u32 i = first; i <= last && i < vertices.size(); ++i) {
+        clip_codes &= vertices[i].clip_codes;
+    }
+    if (clip_codes) {
+        EndDisplayList();
+    }
+}
+
+float Dot3(__m128 a, __m128 b)
+{
+    return _mm_cvtss_f32(_mm_dp_ps(a, b, 0x71));
+}
+
+/* Two triangles sharing the edge v0-v2, with the indices packed into the low word */
+void DrawQuad(u32 w1, u32 divisor)
+{
+    u32 v0 = (w1 >> 24 & 0xFF) / divisor, v1 = (w1 >> 16 & 0xFF) / divisor;
+    u32 v2 = (w1 >> 8 & 0xFF) / divisor, v3 = (w1 & 0xFF) / divisor;
+    DrawTriangle(v0, v1, v2);
+    DrawTriangle(v0, v2, v3);
+}
+
+void DrawTriangle(u32 v0, u32 v1, u32 v2)
+{
+    Vertex const& a = vertices[v0 & 63];
+    Vertex const& b = vertices[v1 & 63];
+    Vertex const& c = vertices[v2 & 63];
+    if (a.clip_codes & b.clip_codes & c.clip_codes) {
+        return;
+    }
+    std::array<Vertex, max_clipped_vertices> polygon = { a, b, c };
+    if (!GeometryMode(&GeometryModeBits::shading_smooth)) {
+        /* F3DEX2 takes the flat shade from the first vertex, the older microcode from the last */
+        __m128 flat_color = gbi == Gbi::F3dex2 ? a.color : c.color;
+        for (u32 i = 0; i < 3; ++i) {
+            polygon[i].color = flat_color;
+        }
+    }
+    u32 num_vertices = 3;
+    if (u32 clip_codes = a.clip_codes | b.clip_codes | c.clip_codes) {
+        num_vertices = ClipPolygon(polygon, num_vertices, clip_codes);
+        if (num_vertices < 3) {
+            return;
+        }
+    }
+    std::array<ScreenVertex, max_clipped_vertices> screen;
+    for (u32 i = 0; i < num_vertices; ++i) {
+        if (_mm_cvtss_f32(_mm_shuffle_ps(polygon[i].pos, polygon[i].pos, _MM_SHUFFLE(3, 3, 3, 3))) <= 0.0f) {
+            return;
+        }
+        screen[i] = Project(polygon[i]);
+    }
+    /* Counterclockwise is front facing; y grows downwards on the screen, which flips the sign of the area */
+    float area = 0;
+    for (u32 i = 0; i < num_vertices; ++i) {
+        ScreenVertex const& cur = screen[i];
+        ScreenVertex const& next = screen[(i + 1) % num_vertices];
+        area += cur.x * next.y - next.x * cur.y;
+    }
+    if (area == 0 || (area > 0 && GeometryMode(&GeometryModeBits::cull_back))
+        || (area < 0 && GeometryMode(&GeometryModeBits::cull_front))) {
+        return;
+    }
+    for (u32 i = 1; i + 1 < num_vertices; ++i) {
+        SetupTriangle(&screen[0], &screen[i], &screen[i + 1]);
+    }
+}
+
+/* One triangle in each word, with the indices in the low three bytes */
+void DrawTriangles(u32 w0, u32 w1, u32 divisor)
+{
+    DrawTriangle((w0 >> 16 & 0xFF) / divisor, (w0 >> 8 & 0xFF) / divisor, (w0 & 0xFF) / divisor);
+    DrawTriangle((w1 >> 16 & 0xFF) / divisor, (w1 >> 8 & 0xFF) / divisor, (w1 & 0xFF) / divisor);
+}
+
+void EndDisplayList()
+{
+    if (dl_stack_depth == 0) {
+        task_done = true;
+    } else {
+        dl_addr = dl_stack[--dl_stack_depth];
+    }
+}
+
+bool GeometryMode(u32 GeometryModeBits::*bit)
+{
+    return geometry_mode & geometry_mode_bits->*bit;
+}
+
+u32 GetAddress(u32 segmented_addr)
+{
+    return (segments[segmented_addr >> 24 & 0xF] + (segmented_addr & 0xFF'FFFF)) & 0xFF'FFFF;
+}
+
+/* By the version string in the data segment of the microcode, e.g. "RSP Gfx ucode F3DEX       fifo 2.08". Fast3D
+   has none, but a "RSP SW Version" string. The fifo and xbus versions are the same to us, since the commands do not
+   go through the output buffer. */
+std::optional<Gbi> IdentifyMicrocode(Task const& task)
+{
+    u32 size = std::min(task.ucode_data_size, 0x1000u);
+    std::string data(size, '\0');
+    for (u32 i = 0; i < size; ++i) {
+        data[i] = char(rdram::Read<s8>(task.ucode_data + i));
+    }
+    std::string_view view = data;
+    if (view.find("RSP SW Version: 2.0") != view.npos) {
+        return Gbi::F3d;
+    }
+    size_t pos = view.find("RSP Gfx ucode ");
+    if (pos == view.npos) {
+        return {};
+    }
+    view = view.substr(pos + std::string_view("RSP Gfx ucode ").size());
+    if (!view.starts_with("F3DEX") && !view.starts_with("F3DZEX")) {
+        return {};
+    }
+    size_t version_pos = view.find_first_of("0123456789", view.find(' '));
+    if (version_pos == view.npos) {
+        return {};
+    }
+    switch (view[version_pos]) {
+    case '0':
+    case '1': return Gbi::F3dex;
+    case '2': return Gbi::F3dex2;
+    default: return {};
+    }
+}
+
+Vertex Lerp(Vertex const& a, Vertex const& b, float t)
+{
+    __m128 factor = _mm_set1_ps(t);
+    Vertex v;
+    v.pos = _mm_add_ps(a.pos, _mm_mul_ps(_mm_sub_ps(b.pos, a.pos), factor));
+    v.color = _mm_add_ps(a.color, _mm_mul_ps(_mm_sub_ps(b.color, a.color), factor));
+    v.texcoords = _mm_add_ps(a.texcoords, _mm_mul_ps(_mm_sub_ps(b.texcoords, a.texcoords), factor));
+    v.clip_codes = 0;
+    return v;
+}
+
+/* Light: u8 r, g, b, pad; a copy of the color; s8 x, y, z, pad */
+Light LoadLight(u32 addr)
+{
+    u32 color = u32(rdram::Read<s32>(addr));
+    u32 dir = u32(rdram::Read<s32>(addr + 8));
+    Light light;
+    light.color = _mm_cvtepi32_ps(_mm_setr_epi32(color >> 24, color >> 16 & 0xFF, color >> 8 & 0xFF, 0));
+    light.dir = _mm_cvtepi32_ps(_mm_setr_epi32(s8(dir >> 24), s8(dir >> 16), s8(dir >> 8), 0));
+    light.dir = _mm_mul_ps(light.dir, _mm_set1_ps(1.0f / 127.0f));
+    return light;
+}
+
+/* s15.16: the integer parts of all elements, then the fractional parts */
+Matrix LoadMatrix(u32 addr)
+{
+    Matrix m;
+    for (u32 row = 0; row < 4; ++row) {
+        alignas(16) std::array<s32, 4> elems;
+        for (u32 col = 0; col < 4; ++col) {
+            u32 index = 4 * row + col;
+            u16 integer = u16(rdram::Read<s16>(addr + 2 * index));
+            u16 fraction = u16(rdram::Read<s16>(addr + 32 + 2 * index));
+            elems[col] = s32(integer << 16 | fraction);
+        }
+        m.rows[row] = _mm_mul_ps(_mm_cvtepi32_ps(_mm_load_si128(reinterpret_cast<__m128i const*>(elems.data()))),
+          _mm_set1_ps(1.0f / 65536.0f));
+    }
+    return m;
+}
+
+void LoadMatrixCommand(u32 addr, bool projection_matrix, bool load, bool push)
+{
+    Matrix m = LoadMatrix(GetAddress(addr));
+    if (projection_matrix) {
+        projection = load ? m : Multiply(m, projection);
+    } else {
+        if (push && modelview_index + 1 < modelview_stack.size()) {
+            modelview_stack[modelview_index + 1] = modelview_stack[modelview_index];
+            ++modelview_index;
+        }
+        Matrix& modelview = modelview_stack[modelview_index];
+        modelview = load ? m : Multiply(m, modelview);
+        lights_dirty = true;
+    }
+    combined = Multiply(modelview_stack[modelview_index], projection);
+}
+
+/* Vertex: s16 x, y, z; u16 flag; s16 s, t; u8 r, g, b, a (or s8 nx, ny, nz; u8 a with lighting) */
+void LoadVertices(u32 addr, u32 first, u32 count)
+{
+    if (lights_dirty && GeometryMode(&GeometryModeBits::lighting)) {
+        UpdateLightDirections();
+    }
+    bool lighting = GeometryMode(&GeometryModeBits::lighting);
+    bool texture_gen = GeometryMode(&GeometryModeBits::texture_gen);
+    bool texture_gen_linear = GeometryMode(&GeometryModeBits::texture_gen_linear);
+    bool fog = GeometryMode(&GeometryModeBits::fog);
+    __m128 texture_scale = _mm_setr_ps(texture.scale_s, texture.scale_t, 0, 0);
+    __m128i const xyz_shuffle = _mm_setr_epi8(2, 3, 0, 1, 6, 7, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m128i const st_shuffle = _mm_setr_epi8(10, 11, 8, 9, -1, -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m128i const rgba_shuffle = _mm_setr_epi8(15, 14, 13, 12, -1, -1, -1, -1, 0, 0, 0, 0, 0, 0, 0, 0);
+    addr = GetAddress(addr);
+    for (u32 i = 0; i < count; ++i, addr += 16) {
+        Vertex& vertex = vertices[(first + i) & 63];
+        /* The upper halfword of each word comes first in the vertex */
+        __m128i raw = _mm_setr_epi32(rdram::Read<s32>(addr),
+          rdram::Read<s32>(addr + 4),
+          rdram::Read<s32>(addr + 8),
+          rdram::Read<s32>(addr + 12));
+        __m128 xyz = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_shuffle_epi8(raw, xyz_shuffle)));
+        __m128 st = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_shuffle_epi8(raw, st_shuffle)));
+        __m128i rgba_bytes = _mm_shuffle_epi8(raw, rgba_shuffle);
+
+        __m128 pos = combined.rows[3];
+        pos = _mm_add_ps(pos, _mm_mul_ps(_mm_shuffle_ps(xyz, xyz, _MM_SHUFFLE(0, 0, 0, 0)), combined.rows[0]));
+        pos = _mm_add_ps(pos, _mm_mul_ps(_mm_shuffle_ps(xyz, xyz, _MM_SHUFFLE(1, 1, 1, 1)), combined.rows[1]));
+        pos = _mm_add_ps(pos, _mm_mul_ps(_mm_shuffle_ps(xyz, xyz, _MM_SHUFFLE(2, 2, 2, 2)), combined.rows[2]));
+        vertex.pos = pos;
+        vertex.clip_codes = ComputeClipCodes(pos);
+
+        __m128 color = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(rgba_bytes));
+        if (lighting) {
+            __m128 normal = _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepi8_epi32(rgba_bytes)), _mm_set1_ps(1 / 127.f));
+            __m128 lit = lights[num_lights].color;
+            for (u32 j = 0; j < num_lights; ++j) {
+                __m128 intensity = _mm_max_ps(_mm_dp_ps(normal, light_dirs_model[j], 0x7F), _mm_setzero_ps());
+                lit = _mm_add_ps(lit, _mm_mul_ps(intensity, lights[j].color));
+            }
+            lit = _mm_min_ps(lit, _mm_set1_ps(255.0f));
+            color = _mm_blend_ps(lit, color, 8); /* the alpha stays */
+            if (texture_gen) {
+                float dot_x = Dot3(normal, lookat_dirs_model[0]);
+                float dot_y = Dot3(normal, lookat_dirs_model[1]);
+                if (texture_gen_linear) {
+                    st = _mm_setr_ps(std::acos(-std::clamp(dot_x, -1.0f, 1.0f)) * (0x8000 / std::numbers::pi_v<float>),
+                      std::acos(-std::clamp(dot_y, -1.0f, 1.0f)) * (0x8000 / std::numbers::pi_v<float>),
+                      0,
+                      0);
+                } else {
+                    st = _mm_setr_ps((dot_x + 1.0f) * 0x4000, (dot_y + 1.0f) * 0x4000, 0, 0);
+                }
+            }
+        }
+        if (fog) {
+            alignas(16) std::array<float, 4> p;
+            _mm_store_ps(p.data(), pos);
+            float alpha = p[3] > 0 ? std::clamp(p[2] / p[3] * fog_multiplier + fog_offset, 0.0f, 255.0f) : 0.0f;
+            color = _mm_blend_ps(color, _mm_set1_ps(alpha), 8);
+        }
+        vertex.color = color;
+        vertex.texcoords = _mm_mul_ps(st, texture_scale);
+    }
+}
+
+/* Viewport: s16 scale x, y, z, pad; s16 translation x, y, z, pad. x and y have two fractional bits. */
+void LoadViewport(u32 addr)
+{
+    addr = GetAddress(addr);
+    std::array<float, 8> v;
+    for (u32 i = 0; i < 8; ++i) {
+        v[i] = rdram::Read<s16>(addr + 2 * i);
+    }
+    /* Screen z has ten integer bits (G_MAXZ); the RDP takes 15 */
+    viewport_scale = _mm_setr_ps(v[0] / 4, -v[1] / 4, v[2] * 32, 0);
+    viewport_translate = _mm_setr_ps(v[4] / 4, v[5] / 4, v[6] * 32, 0);
+}
+
+/* G_MODIFYVTX; the screen z of a vertex cannot be overridden here */
+void ModifyVertex(u32 index, u32 where, u32 value)
+{
+    Vertex& vertex = vertices[index & 63];
+    switch (where) {
+    case 0x10: /* G_MWO_POINT_RGBA */
+        vertex.color =
+          _mm_cvtepi32_ps(_mm_setr_epi32(value >> 24, value >> 16 & 0xFF, value >> 8 & 0xFF, value & 0xFF));
+        break;
+
+    case 0x14: /* G_MWO_POINT_ST */ vertex.texcoords = _mm_setr_ps(s16(value >> 16), s16(value), 0, 0); break;
+
+    case 0x18: { /* G_MWO_POINT_XYSCREEN; s13.2 */
+        __m128 w = _mm_shuffle_ps(vertex.pos, vertex.pos, _MM_SHUFFLE(3, 3, 3, 3));
+        __m128 screen = _mm_setr_ps(s16(value >> 16) / 4.0f, s16(value) / 4.0f, 0, 0);
+        __m128 ndc = _mm_div_ps(_mm_sub_ps(screen, viewport_translate), viewport_scale);
+        vertex.pos = _mm_blend_ps(vertex.pos, _mm_mul_ps(ndc, w), 3);
+        vertex.clip_codes = ComputeClipCodes(vertex.pos);
+        break;
+    }
+
+    default: LogWarn("Unhandled G_MODIFYVTX offset ${:02X}", where);
+    }
+}
+
+Matrix Multiply(Matrix const& a, Matrix const& b)
+{
+    Matrix m;
+    for (u32 row = 0; row < 4; ++row) {
+        __m128 r = a.rows[row];
+        m.rows[row] = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(0, 0, 0, 0)), b.rows[0]),
+            _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(1, 1, 1, 1)), b.rows[1])),
+          _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(2, 2, 2, 2)), b.rows[2]),
+            _mm_mul_ps(_mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)), b.rows[3])));
+    }
+    return m;
+}
+
+void MoveWord(u32 index, u32 offset, u32 data)
+{
+    switch (index) {
+    case 0x00: { /* G_MW_MATRIX: one word of the integer or fractional parts of the combined matrix */
+        u32 elem = (offset & 0x1F) >> 1;
+        alignas(16) std::array<float, 4> row;
+        for (u32 i = 0; i < 2; ++i, ++elem) {
+            _mm_store_ps(row.data(), combined.rows[elem / 4]);
+            float& value = row[elem % 4];
+            u16 half = u16(i == 0 ? data >> 16 : data);
+            if (offset & 0x20) {
+                value = std::floor(value) + half / 65536.0f;
+            } else {
+                value = s16(half) + (value - std::floor(value));
+            }
+            combined.rows[elem / 4] = _mm_load_ps(row.data());
+        }
+        break;
+    }
+
+    case 0x02: /* G_MW_NUMLIGHT */
+        num_lights = gbi == Gbi::F3dex2 ? data / 24 : ((data - 0x8000'0000) >> 5) - 1;
+        num_lights = std::min(num_lights, u32(lights.size() - 1));
+        lights_dirty = true;
+        break;
+
+    case 0x06: /* G_MW_SEGMENT */ segments[offset >> 2 & 0xF] = data & 0xFF'FFFF; break;
+
+    case 0x08: /* G_MW_FOG */
+        fog_multiplier = s16(data >> 16);
+        fog_offset = s16(data);
+        break;
+
+    case 0x0A: { /* G_MW_LIGHTCOL; the word at offset 4 is the copy of the color */
+        u32 light_size = gbi == Gbi::F3dex2 ? 24 : 32;
+        if (offset % light_size == 0 && offset / light_size < lights.size()) {
+            lights[offset / light_size].color =
+              _mm_cvtepi32_ps(_mm_setr_epi32(data >> 24, data >> 16 & 0xFF, data >> 8 & 0xFF, 0));
+        }
+        break;
+    }
+
+    case 0x04: /* G_MW_CLIP */
+    case 0x0C: /* G_MW_POINTS, G_MW_FORCEMTX */
+    case 0x0E: /* G_MW_PERSPNORM */ break;
+
+    default: LogWarn("Unhandled G_MOVEWORD index ${:02X}", index);
+    }
+}
+
+void PopMatrices(u32 count)
+{
+    modelview_index -= std::min(count, modelview_index);
+    combined = Multiply(modelview_stack[modelview_index], projection);
+    lights_dirty = true;
+}
+
+ScreenVertex Project(Vertex const& vertex)
+{
+    __m128 inv_w = _mm_div_ps(_mm_set1_ps(1.0f), _mm_shuffle_ps(vertex.pos, vertex.pos, _MM_SHUFFLE(3, 3, 3, 3)));
+    __m128 screen = _mm_add_ps(viewport_translate, _mm_mul_ps(_mm_mul_ps(vertex.pos, inv_w), viewport_scale));
+    screen = _mm_blend_ps(screen, inv_w, 8);
+    alignas(16) std::array<float, 12> v;
+    _mm_store_ps(&v[0], screen);
+    _mm_store_ps(&v[4], vertex.texcoords);
+    _mm_store_ps(&v[8], vertex.color);
+    return { v[0], v[1], v[2], v[3], v[4], v[5], v[8], v[9], v[10], v[11] };
+}
+
+/* The microcode reloads its DMEM state from the data segment at the start of every task */
+void ResetState()
+{
+    Matrix identity = {
+        { _mm_setr_ps(1, 0, 0, 0), _mm_setr_ps(0, 1, 0, 0), _mm_setr_ps(0, 0, 1, 0), _mm_setr_ps(0, 0, 0, 1) }
+    };
+    segments = {};
+    vertices = {};
+    modelview_index = 0;
+    modelview_stack[0] = projection = combined = identity;
+    lights = {};
+    lookat = {};
+    num_lights = 0;
+    lights_dirty = true;
+    geometry_mode = 0;
+    othermode_h = othermode_l = 0;
+    viewport_scale = _mm_setr_ps(160, -120, 0x1FF * 32, 0);
+    viewport_translate = _mm_setr_ps(160, 120, 0x1FF * 32, 0);
+    fog_multiplier = fog_offset = 0;
+    texture = {};
+    rdp_half_1 = 0;
+    dl_stack_depth = 0;
+    task_done = false;
+}
+
+void RunDisplayList(u32 addr, bool push)
+{
+    if (push) {
+        if (dl_stack_depth == dl_stack.size()) {
+            LogWarn("Display list stack overflow");
+            return;
+        }
+        dl_stack[dl_stack_depth++] = dl_addr;
+    }
+    dl_addr = GetAddress(addr);
+}
+
+bool RunGbi1Command(u32 w0, u32 w1)
+{
+    u32 tri_index_divisor = gbi == Gbi::F3d ? 10 : 2;
+    switch (w0 >> 24) {
+    case 0x00: /* G_SPNOOP */
+    case 0xC0: /* G_NOOP */
+    case 0xB3: /* G_RDPHALF_2 */ break;
+
+    case 0x01: /* G_MTX */ {
+        u32 params = w0 >> 16 & 0xFF;
+        LoadMatrixCommand(w1, params & 1, params & 2, params & 4);
+        break;
+    }
+
+    case 0x03: /* G_MOVEMEM */ {
+        u32 index = w0 >> 16 & 0xFF;
+        if (index == 0x80) {
+            LoadViewport(w1);
+        } else if (index == 0x82 || index == 0x84) {
+            lookat[index == 0x82] = LoadLight(GetAddress(w1));
+            lights_dirty = true;
+        } else if (index >= 0x86 && index <= 0x94) {
+            lights[(index - 0x86) >> 1] = LoadLight(GetAddress(w1));
+            lights_dirty = true;
+        } else if (index == 0x9E) { /* G_MV_MATRIX_1; the other three quarters follow in the same matrix */
+            combined = LoadMatrix(GetAddress(w1));
+        } else if (index != 0x98 && index != 0x9A && index != 0x9C) {
+            LogWarn("Unhandled G_MOVEMEM index ${:02X}", index);
+        }
+        break;
+    }
+
+    case 0x04: /* G_VTX */
+        if (gbi == Gbi::F3d) {
+            LoadVertices(w1, w0 >> 16 & 0xF, (w0 >> 20 & 0xF) + 1);
+        } else {
+            LoadVertices(w1, w0 >> 17 & 0x7F, w0 >> 10 & 0x3F);
+        }
+        break;
+
+    case 0x06: /* G_DL */ RunDisplayList(w1, !(w0 >> 16 & 0xFF)); break;
+
+    case 0xAF: /* G_LOAD_UCODE */ return false;
+
+    case 0xB0: /* G_BRANCH_Z */ {
+        if (gbi == Gbi::F3d) return false;
+        Vertex const& vertex = vertices[(w0 & 0xFFF) >> 1 & 63];
+        ScreenVertex screen = Project(vertex);
+        if (screen.w > 0 && s32(screen.z / 32 * 65536) <= s32(w1)) {
+            RunDisplayList(rdp_half_1, false);
+        }
+        break;
+    }
+
+    case 0xB1: /* G_TRI2 */
+        if (gbi == Gbi::F3d) return false;
+        DrawTriangles(w0, w1, 2);
+        break;
+
+    case 0xB2: /* G_MODIFYVTX; G_RDPHALF_CONT in Fast3D */
+        if (gbi != Gbi::F3d) {
+            ModifyVertex((w0 & 0xFFFF) >> 1, w0 >> 16 & 0xFF, w1);
+        }
+        break;
+
+    case 0xB4: /* G_RDPHALF_1 */ rdp_half_1 = w1; break;
+
+    case 0xB5: /* G_QUAD */
+        if (gbi == Gbi::F3d) return false;
+        DrawQuad(w1, 2);
+        break;
+
+    case 0xB6: /* G_CLEARGEOMETRYMODE */
+        geometry_mode &= ~w1;
+        lights_dirty = true;
+        break;
+
+    case 0xB7: /* G_SETGEOMETRYMODE */
+        geometry_mode |= w1;
+        lights_dirty = true;
+        break;
+
+    case 0xB8: /* G_ENDDL */ EndDisplayList(); break;
+
+    case 0xB9: /* G_SETOTHERMODE_L */ SetOtherMode(othermode_l, w0 >> 8 & 0xFF, w0 & 0xFF, w1); break;
+
+    case 0xBA: /* G_SETOTHERMODE_H */ SetOtherMode(othermode_h, w0 >> 8 & 0xFF, w0 & 0xFF, w1); break;
+
+    case 0xBB: /* G_TEXTURE */
+        texture.on = w0 & 0xFF;
+        texture.level = w0 >> 11 & 7;
+        texture.tile = w0 >> 8 & 7;
+        texture.scale_s = (w1 >> 16) / 65536.0f;
+        texture.scale_t = (w1 & 0xFFFF) / 65536.0f;
+        break;
+
+    case 0xBC: /* G_MOVEWORD */ MoveWord(w0 & 0xFF, w0 >> 8 & 0xFFFF, w1); break;
+
+    case 0xBD: /* G_POPMTX */ PopMatrices(1); break;
+
+    case 0xBE: /* G_CULLDL */
+        if (gbi == Gbi::F3d) {
+            CullDisplayList((w0 & 0xFFFF) / 40, (w1 & 0xFFFF) / 40 - 1);
+        } else {
+            CullDisplayList((w0 & 0xFFFF) >> 1, (w1 & 0xFFFF) >> 1);
+        }
+        break;
+
+    case 0xBF: /* G_TRI1 */
+        DrawTriangle((w1 >> 16 & 0xFF) / tri_index_divisor,
+          (w1 >> 8 & 0xFF) / tri_index_divisor,
+          (w1 & 0xFF) / tri_index_divisor);
+        break;
+
+    default:
+        if (w0 >> 24 >= 0xE4) {
+            RunRdpCommand(w0, w1);
+        } else {
+            LogWarn("Unhandled graphics command ${:08X} ${:08X}", w0, w1);
+        }
+    }
+    return true;
+}
+
+bool RunGbi2Command(u32 w0, u32 w1)
+{
+    switch (w0 >> 24) {
+    case 0x00: /* G_NOOP */
+    case 0xE0: /* G_SPNOOP */
+    case 0xF1: /* G_RDPHALF_2 */
+    case 0xD6: /* G_DMA_IO */ break;
+
+    case 0x01: /* G_VTX */ {
+        u32 count = w0 >> 12 & 0xFF;
+        LoadVertices(w1, (w0 >> 1 & 0x7F) - count, count);
+        break;
+    }
+
+    case 0x02: /* G_MODIFYVTX */ ModifyVertex((w0 & 0xFFFF) >> 1, w0 >> 16 & 0xFF, w1); break;
+
+    case 0x03: /* G_CULLDL */ CullDisplayList((w0 & 0xFFFF) >> 1, (w1 & 0xFFFF) >> 1); break;
+
+    case 0x04: /* G_BRANCH_Z */ {
+        Vertex const& vertex = vertices[(w0 & 0xFFF) >> 1 & 63];
+        ScreenVertex screen = Project(vertex);
+        if (screen.w > 0 && s32(screen.z / 32 * 65536) <= s32(w1)) {
+            RunDisplayList(rdp_half_1, false);
+        }
+        break;
+    }
+
+    case 0x05: /* G_TRI1 */ DrawTriangle((w0 >> 16 & 0xFF) >> 1, (w0 >> 8 & 0xFF) >> 1, (w0 & 0xFF) >> 1); break;
+
+    case 0x06: /* G_TRI2 */
+    case 0x07: /* G_QUAD */ DrawTriangles(w0, w1, 2); break;
+
+    case 0xD7: /* G_TEXTURE */
+        texture.on = w0 >> 1 & 0x7F;
+        texture.level = w0 >> 11 & 7;
+        texture.tile = w0 >> 8 & 7;
+        texture.scale_s = (w1 >> 16) / 65536.0f;
+        texture.scale_t = (w1 & 0xFFFF) / 65536.0f;
+        break;
+
+    case 0xD8: /* G_POPMTX */ PopMatrices(w1 >> 6); break;
+
+    case 0xD9: /* G_GEOMETRYMODE */
+        geometry_mode = (geometry_mode & (w0 | 0xFF00'0000)) | w1;
+        lights_dirty = true;
+        break;
+
+    case 0xDA: /* G_MTX */ {
+        u32 params = (w0 & 0xFF) ^ 1; /* G_MTX_PUSH is inverted in the command */
+        LoadMatrixCommand(w1, params & 4, params & 2, params & 1);
+        break;
+    }
+
+    case 0xDB: /* G_MOVEWORD */ MoveWord(w0 >> 16 & 0xFF, w0 & 0xFFFF, w1); break;
+
+    case 0xDC: /* G_MOVEMEM */ {
+        u32 index = w0 & 0xFF;
+        u32 offset = (w0 >> 8 & 0xFF) * 8;
+        if (index == 8) { /* G_MV_VIEWPORT */
+            LoadViewport(w1);
+        } else if (index == 10) { /* G_MV_LIGHT; the lookat vectors come first */
+            if (offset < 48) {
+                lookat[offset / 24] = LoadLight(GetAddress(w1));
+            } else if (offset / 24 - 2 < lights.size()) {
+                lights[offset / 24 - 2] = LoadLight(GetAddress(w1));
+            }
+            lights_dirty = true;
+        } else if (index == 14) { /* G_MV_MATRIX */
+            combined = LoadMatrix(GetAddress(w1));
+        } else {
+            LogWarn("Unhandled G_MOVEMEM index ${:02X}", index);
+        }
+        break;
+    }
+
+    case 0xDD: /* G_LOAD_UCODE */ return false;
+
+    case 0xDE: /* G_DL */ RunDisplayList(w1, !(w0 >> 16 & 0xFF)); break;
+
+    case 0xDF: /* G_ENDDL */ EndDisplayList(); break;
+
+    case 0xE1: /* G_RDPHALF_1 */ rdp_half_1 = w1; break;
+
+    case 0xE2: /* G_SETOTHERMODE_L */ {
+        u32 len = (w0 & 0xFF) + 1;
+        SetOtherMode(othermode_l, 32 - (w0 >> 8 & 0xFF) - len, len, w1);
+        break;
+    }
+
+    case 0xE3: /* G_SETOTHERMODE_H */ {
+        u32 len = (w0 & 0xFF) + 1;
+        SetOtherMode(othermode_h, 32 - (w0 >> 8 & 0xFF) - len, len, w1);
+        break;
+    }
+
+    default:
+        if (w0 >> 24 >= 0xE4) {
+            RunRdpCommand(w0, w1);
+        } else {
+            LogWarn("Unhandled graphics command ${:08X} ${:08X}", w0, w1);
+        }
+    }
+    return true;
+}
+
+/* Returns false if the task cannot be emulated at a high level; it has then had no effect, and should run on the RSP */
+bool RunGraphicsTask(Task const& task)
+{
+    gbi = *IdentifyMicrocode(task);
+    geometry_mode_bits = gbi == Gbi::F3dex2 ? &gbi2_geometry_mode_bits : &gbi1_geometry_mode_bits;
+    ResetState();
+    rdp_commands.clear();
+    dl_addr = task.data_ptr & 0xFF'FFFF;
+    for (u32 i = 0; i < max_commands_per_task && !task_done; ++i) {
+        u32 w0 = u32(rdram::Read<s32>(dl_addr));
+        u32 w1 = u32(rdram::Read<s32>(dl_addr + 4));
+        dl_addr += 8;
+        bool ok = gbi == Gbi::F3dex2 ? RunGbi2Command(w0, w1) : RunGbi1Command(w0, w1);
+        if (!ok) {
+            LogWarn("Graphics command ${:08X} ${:08X} cannot be emulated at a high level; running the task on the RSP",
+              w0,
+              w1);
+            return false;
+        }
+    }
+    if (!task_done) {
+        LogWarn("The display list did not end within {} commands; running the task on the RSP", max_commands_per_task);
+        return false;
+    }
+    for (size_t i = 0; i < rdp_commands.size(); i += 1 + rdp_commands[i]) {
+        rdp::ExecuteCommand(rdp_commands[i], &rdp_commands[i + 1]);
+    }
+    return true;
+}
+
+void QueueRdpCommand(u32 len, u32 const* cmd)
+{
+    rdp_commands.push_back(len);
+    rdp_commands.insert(rdp_commands.end(), cmd, cmd + len);
+}
+
+/* Commands $E4-$FF go to the RDP as they are, apart from the segmented addresses of the image commands, and the
+   texture rectangles, which take their texture coordinates from the two following commands */
+void RunRdpCommand(u32 w0, u32 w1)
+{
+    u32 opcode = w0 >> 24;
+    if (opcode == 0xE4 || opcode == 0xE5) {
+        std::array<u32, 4> cmd = { w0, w1, u32(rdram::Read<s32>(dl_addr + 4)), u32(rdram::Read<s32>(dl_addr + 12)) };
+        dl_addr += 16;
+        QueueRdpCommand(4, cmd.data());
+        return;
+    }
+    if (opcode >= 0xFD) { /* texture, depth and color image */
+        w1 = GetAddress(w1);
+    } else if (opcode == 0xEF) { /* other modes */
+        othermode_h = w0 & 0xFF'FFFF;
+        othermode_l = w1;
+    }
+    std::array<u32, 2> cmd = { w0, w1 };
+    QueueRdpCommand(2, cmd.data());
+}
+
+void SetOtherMode(u32& mode, u32 shift, u32 len, u32 data)
+{
+    u32 mask = u32(((u64(1) << len) - 1) << shift);
+    mode = (mode & ~mask) | (data & mask);
+    std::array<u32, 2> cmd = { 0xEF00'0000 | (othermode_h & 0xFF'FFFF), othermode_l };
+    QueueRdpCommand(2, cmd.data());
+}
+
+/* Edge, shade, texture and depth coefficients of an RDP triangle command. The attributes are planes over the
+   screen, given at the top vertex, stepped along the major edge (DxDe) and across it (DxDx). */
+void SetupTriangle(ScreenVertex const* v1, ScreenVertex const* v2, ScreenVertex const* v3)
+{
+    if (v1->y > v2->y) std::swap(v1, v2);
+    if (v2->y > v3->y) std::swap(v2, v3);
+    if (v1->y > v2->y) std::swap(v1, v2);
+
+    bool shade = GeometryMode(&GeometryModeBits::shade);
+    bool tex = texture.on;
+    bool zbuffer = GeometryMode(&GeometryModeBits::zbuffer);
+
+    float y1 = std::floor(v1->y * 4) / 4, y2 = std::floor(v2->y * 4) / 4, y3 = std::floor(v3->y * 4) / 4;
+    float hx = v3->x - v1->x, hy = y3 - y1;
+    float mx = v2->x - v1->x, my = y2 - y1;
+    float lx = v3->x - v2->x, ly = y3 - y2;
+    float nz = hx * my - hy * mx;
+    float attr_factor = std::abs(nz) > 0 ? -1.0f / nz : 0.0f;
+    float ish = std::abs(hy) > 0 ? hx / hy : 0.0f;
+    float ism = std::abs(my) > 0 ? mx / my : 0.0f;
+    float isl = std::abs(ly) > 0 ? lx / ly : 0.0f;
+    float fy = std::floor(y1) - y1;
+
+    std::array<u32, 44> cmd;
+    u32 len = 0;
+    u32 opcode = 0x08 | shade << 2 | tex << 1 | zbuffer;
+    u32 lft = nz < 0;
+    auto y_fixed = [](float y) { return u32(s32(y * 4)) & 0x3FFF; };
+    cmd[len++] = opcode << 24 | lft << 23 | texture.level << 19 | texture.tile << 16 | y_fixed(y3);
+    cmd[len++] = y_fixed(y2) << 16 | y_fixed(y1);
+    cmd[len++] = ToS1516(v2->x);
+    cmd[len++] = ToS1516(isl);
+    cmd[len++] = ToS1516(v1->x + fy * ish);
+    cmd[len++] = ToS1516(ish);
+    cmd[len++] = ToS1516(v1->x + fy * ism);
+    cmd[len++] = ToS1516(ism);
+
+    /* Four attributes: the starting values, and their derivatives in x, along the edge, and in y */
+    auto emit_attributes = [&](std::array<float, 4> const& a1, std::array<float, 4> const& a2,
+                             std::array<float, 4> const& a3) {
+        std::array<s32, 4> value, dadx, dade, dady;
+        for (u32 i = 0; i < 4; ++i) {
+            float ma = a2[i] - a1[i], ha = a3[i] - a1[i];
+            float nx = hy * ma - my * ha;
+            float ny = mx * ha - hx * ma;
+            float dx = nx * attr_factor, dy = ny * attr_factor;
+            float de = dy + dx * ish;
+            value[i] = ToS1516(a1[i] + fy * de);
+            dadx[i] = ToS1516(dx);
+            dade[i] = ToS1516(de);
+            dady[i] = ToS1516(dy);
+        }
+        auto integers = [](std::array<s32, 4> const& v, u32 i) {
+            return u32(v[i] & 0xFFFF'0000) | u32(v[i + 1]) >> 16;
+        };
+        auto fractions = [](std::array<s32, 4> const& v, u32 i) { return u32(v[i]) << 16 | u32(v[i + 1] & 0xFFFF); };
+        for (auto const* v : { &value, &dadx }) {
+            cmd[len++] = integers(*v, 0);
+            cmd[len++] = integers(*v, 2);
+        }
+        for (auto const* v : { &value, &dadx }) {
+            cmd[len++] = fractions(*v, 0);
+            cmd[len++] = fractions(*v, 2);
+        }
+        for (auto const* v : { &dade, &dady }) {
+            cmd[len++] = integers(*v, 0);
+            cmd[len++] = integers(*v, 2);
+        }
+        for (auto const* v : { &dade, &dady }) {
+            cmd[len++] = fractions(*v, 0);
+            cmd[len++] = fractions(*v, 2);
+        }
+    };
+
+    if (shade) {
+        emit_attributes({ v1->r, v1->g, v1->b, v1->a }, { v2->r, v2->g, v2->b, v2->a }, { v3->r, v3->g, v3->b, v3->a });
+    }
+    if (tex) {
+        std::array<ScreenVertex const*, 3> v = { v1, v2, v3 };
+        std::array<std::array<float, 4>, 3> stw;
+        if (othermode_h & othermode_h_persp_tex_en) {
+            /* The RDP divides s and t by w; normalize w to its largest value, for the most precision */
+            float w_factor = 1.0f / std::max({ v1->w, v2->w, v3->w });
+            for (u32 i = 0; i < 3; ++i) {
+                float w = v[i]->w * w_factor;
+                stw[i] = { v[i]->s * w, v[i]->t * w, w * 0x7FFF, 0 };
+            }
+        } else {
+            for (u32 i = 0; i < 3; ++i) {
+                stw[i] = { v[i]->s, v[i]->t, 0x7FFF, 0 };
+            }
+        }
+        emit_attributes(stw[0], stw[1], stw[2]);
+    }
+    if (zbuffer) {
+        float mz = v2->z - v1->z, hz = v3->z - v1->z;
+        float dzdx = (hy * mz - my * hz) * attr_factor;
+        float dzdy = (mx * hz - hx * mz) * attr_factor;
+        float dzde = dzdy + dzdx * ish;
+        cmd[len++] = ToS1516(v1->z + fy * dzde);
+        cmd[len++] = ToS1516(dzdx);
+        cmd[len++] = ToS1516(dzde);
+        cmd[len++] = ToS1516(dzdy);
+    }
+    QueueRdpCommand(len, cmd.data());
+}
+
+s32 ToS1516(float value)
+{
+    return s32(std::clamp(value * 65536.0f, -2147483648.0f, 2147483520.0f));
+}
+
+/* Lighting is done in model space; the directions are brought there with the transposed modelview matrix */
+void UpdateLightDirections()
+{
+    Matrix const& modelview = modelview_stack[modelview_index];
+    auto to_model_space = [&](__m128 dir) {
+        __m128 v = _mm_setr_ps(Dot3(modelview.rows[0], dir),
+          Dot3(modelview.rows[1], dir),
+          Dot3(modelview.rows[2], dir),
+          0);
+        float length = std::sqrt(Dot3(v, v));
+        return length > 0 ? _mm_div_ps(v, _mm_set1_ps(length)) : v;
+    };
+    for (u32 i = 0; i < num_lights; ++i) {
+        light_dirs_model[i] = to_model_space(lights[i].dir);
+    }
+    for (u32 i = 0; i < 2; ++i) {
+        lookat_dirs_model[i] = to_model_space(lookat[i].dir);
+    }
+    lights_dirty = false;
+}
+
+} // namespace n64::rsp::hle
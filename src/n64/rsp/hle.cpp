@@ -0,0 +1,59 @@
+#include "hle.hpp"
+#include "interface/mi.hpp"
+#include "n64_build_options.hpp"
+#include "rsp.hpp"
+
+#include <bit>
+#include <cstring>
+#include <utility>
+
+namespace n64::rsp::hle {
+
+static void FinishTask();
+static Task ReadTask();
+
+/* Like the microcode at the end of a task: signal TASKDONE (SIG2), and BREAK */
+void FinishTask()
+{
+    sp.status.sig |= 4;
+    sp.status.halted = sp.status.broke = true;
+    if (sp.status.intbreak) {
+        mi::RaiseInterrupt(mi::InterruptType::SP);
+    }
+}
+
+Task ReadTask()
+{
+    static_assert(sizeof(Task) == 0x1000 - task_dmem_addr);
+    Task task;
+    std::memcpy(&task, &dmem[task_dmem_addr], sizeof(Task));
+    u32* words = reinterpret_cast<u32*>(&task);
+    for (size_t i = 0; i < sizeof(Task) / 4; ++i) {
+        words[i] = std::byteswap(words[i]); /* rsp ram BE */
+    }
+    return task;
+}
+
+/* Called when the CPU has started the RSP at the boot microcode. Returns false if the task is not one that is emulated
+   at a high level, and should run on the RSP. */
+bool RunTask()
+{
+    if (pc != 0) {
+        return false;
+    }
+    Task task = ReadTask();
+    if (enable_rsp_audio_hle && task.type == std::to_underlying(TaskType::Audio) && CanRunAudioTask(task)) {
+        RunAudioTask(task);
+        FinishTask();
+        return true;
+    }
+    /* A task that has yielded on the RSP has its state in the yield buffer, and must resume there */
+    if (enable_graphics_hle && task.type == std::to_underlying(TaskType::Graphics)
+        && !(task.flags & task_flag_yielded) && CanRunGraphicsTask(task) && RunGraphicsTask(task)) {
+        FinishTask();
+        return true;
+    }
+    return false;
+}
+
+} // namespace n64::rsp::hle
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "numtypes.hpp"
+
+namespace n64::rsp::hle {
+
+/* The OSTask structure, which osSpTaskStart places at the end of DMEM before starting the boot microcode */
+struct Task {
+    u32 type;
+    u32 flags;
+    u32 ucode_boot, ucode_boot_size;
+    u32 ucode, ucode_size;
+    u32 ucode_data, ucode_data_size;
+    u32 dram_stack, dram_stack_size;
+    u32 output_buff, output_buff_size;
+    u32 data_ptr, data_size;
+    u32 yield_data_ptr, yield_data_size;
+};
+
+enum class TaskType : u32 {
+    Graphics = 1,
+    Audio = 2
+};
+
+constexpr u32 task_dmem_addr = 0xFC0;
+constexpr u32 task_flag_yielded = 2;
+
+bool CanRunAudioTask(Task const& task);
+bool CanRunGraphicsTask(Task const& task);
+void RunAudioTask(Task const& task);
+bool RunGraphicsTask(Task const& task);
+bool RunTask();
+
+inline bool enable_graphics_hle; /* run known graphics microcode tasks natively; set per game */
+
+} // namespace n64::rsp::hle
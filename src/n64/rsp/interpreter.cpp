@@ -1,9 +1,12 @@
 #include "interpreter.hpp"
 #include "decoder.hpp"
+#include "hle.hpp"
 #include "interface/mi.hpp"
 #include "rdp/rdp.hpp"
 #include "rsp.hpp"
 
+#include <utility>
+
 namespace n64::rsp {
 
 void InterpretOneInstruction()
@@ -30,6 +33,7 @@ void OnSingleStep()
 u32 RunInterpreter(u32 rsp_cycles)
 {
     if (sp.status.halted) return 0;
+    if (std::exchange(task_start_pending, false) && hle::RunTask()) return 0;
     cycle_counter = 0;
     if (sp.status.sstep) {
         OnSingleStep();
@@ -1,13 +1,27 @@
 #include "recompiler.hpp"
 #include "build_options.hpp"
-#include "bump_allocator.hpp"
 #include "decoder.hpp"
 #include "fatal_error.hpp"
+#include "free_list_allocator.hpp"
+#include "hle.hpp"
 #include "interpreter.hpp"
+#include "jit_code_cache.hpp"
+#include "log.hpp"
+#include "mips/gpr_liveness.hpp"
 #include "n64_build_options.hpp"
 #include "register_allocator.hpp"
 #include "rsp.hpp"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
 using namespace asmjit;
 using namespace asmjit::x86;
 
@@ -15,6 +29,9 @@ namespace n64::rsp {
 
 constexpr u32 pool_size = 0x100;
 constexpr size_t num_pools = 0x1000 / pool_size;
+constexpr size_t code_cache_size = 16_MiB;
+constexpr size_t max_block_code_size = 64_KiB; // the code cache is flushed before compiling unless this much is free
+constexpr u32 max_block_instructions = 128; // see AtBlockEnd
 
 using Block = void (*)(s32 const* gpr_mid_ptr);
 
@@ -22,27 +39,76 @@ struct Pool {
     std::array<Block, 64> blocks;
 };
 
-static BumpAllocator allocator;
+// The blocks compiled for an IMEM image other than the current one. Games swap their graphics and audio microcode into
+// IMEM every frame; once a microcode comes back, its blocks are bound again instead of being recompiled.
+struct Microcode {
+    std::array<Pool*, num_pools> pools;
+    std::array<u16, num_pools> spanning_block_pools;
+    std::array<u8, 0x1000> imem; // compared on a hash match, as different images may hash alike
+};
+
+static FreeListAllocator<Pool> allocator;
 static asmjit::CodeHolder code_holder;
+static JitCodeCache code_cache;
 static asmjit::FileLogger jit_logger(stdout);
-static asmjit::JitRuntime jit_runtime;
 static std::vector<Pool*> pools;
+static std::array<u16, num_pools> spanning_block_pools; // bit n of entry i: a block starting in pool n extends into i
+static std::unordered_map<u64, Microcode> microcodes; // key: hash of the IMEM image
+static std::unordered_set<u64> microcode_hashes_seen;
+static std::optional<u64> imem_hash; // of the image that 'pools' were compiled from; unknown after a write by the CPU
+static std::array<u8, 0x1000> imem_image; // the image that 'pools' were compiled from, if 'imem_hash' is known
+static mips::GprLiveness gpr_liveness;
 static bool block_has_branch_instr;
 
+static void AnalyzeGprLiveness();
+static bool AtBlockEnd(u32 addr);
 static void Compile(Block& block);
 static void EmitBranchCheck();
 static void EmitInstruction();
 static void FinalizeBlock(Block& block);
-static void FlushPc(int pc_offset);
+static void FlushCodeCache();
+void FlushPc(int pc_offset);
 static Block& GetBlock(u32 addr);
+static u64 HashImem();
+static bool ImemMatches(std::array<u8, 0x1000> const& image);
 static void RecordBlockCycles();
-static void ResetPool(Pool*& pool);
+static void ReleasePools(std::span<Pool*> pools_to_release);
+static void ResetPool(u32 pool_index);
+static void StashMicrocode();
+
+// Over the instructions that Compile emits: up to the end of the block (see AtBlockEnd), or up to the delay slot of
+// the first branch that the block cannot go on past
+void AnalyzeGprLiveness()
+{
+    std::array<u32, max_block_instructions> instrs;
+    size_t num_instrs = 0;
+    u32 addr = pc;
+    mips::BranchKind prev_branch_kind = mips::BranchKind::None;
+    do {
+        u32 instr = FetchInstruction(addr);
+        instrs[num_instrs++] = instr;
+        addr = (addr + 4) & 0xFFC;
+        mips::BranchKind branch_kind = mips::GetBranchKind(instr, mips::Isa::Rsp);
+        if (prev_branch_kind == mips::BranchKind::Terminal
+            || (prev_branch_kind == mips::BranchKind::Conditional && branch_kind != mips::BranchKind::None)) {
+            break;
+        }
+        prev_branch_kind = branch_kind;
+    } while (!AtBlockEnd(addr));
+    gpr_liveness.Analyze(std::span(instrs).first(num_instrs), mips::Isa::Rsp);
+}
+
+// Blocks run on through pools and past conditional branches, but not beyond the end of IMEM, where the pc wraps
+// around, nor beyond a maximum length.
+bool AtBlockEnd(u32 addr)
+{
+    return addr == 0 || ((addr - pc) & 0xFFF) >= 4 * max_block_instructions;
+}
 
 void BlockEpilog()
 {
     RecordBlockCycles();
     reg_alloc.BlockEpilog();
-    c.ret();
 }
 
 void BlockEpilogWithJmp(void* func)
@@ -64,40 +130,48 @@ void BlockEpilogWithPcFlush(int pc_offset)
     BlockEpilog();
 }
 
+// The code holder is set up once, and reinitialized for each following block; the assembler stays attached to it.
+// Blocks are emitted straight to machine code; the register allocator sets up and tears down the stack frame.
 void BlockProlog()
 {
-    code_holder.reset();
-    asmjit::Error err = code_holder.init(jit_runtime.environment(), jit_runtime.cpuFeatures());
-    if (err) {
-        FATAL("Failed to init asmjit code holder; returned {}", asmjit::DebugUtils::errorAsString(err));
-    }
-    err = code_holder.attach(&c);
-    if (err) {
-        FATAL("Failed to attach asmjit compiler to code holder; returned {}", asmjit::DebugUtils::errorAsString(err));
-    }
-    if constexpr (enable_rsp_jit_error_handler) {
-        static AsmjitLogErrorHandler asmjit_log_error_handler;
-        code_holder.setErrorHandler(&asmjit_log_error_handler);
+    if (code_holder.isInitialized()) {
+        asmjit::Error err = code_holder.reinit();
+        if (err) {
+            FATAL("Failed to reinit asmjit code holder; returned {}", asmjit::DebugUtils::errorAsString(err));
+        }
+    } else {
+        asmjit::Error err = code_holder.init(Environment::host(), CpuInfo::host().features());
+        if (err) {
+            FATAL("Failed to init asmjit code holder; returned {}", asmjit::DebugUtils::errorAsString(err));
+        }
+        err = code_holder.attach(&c);
+        if (err) {
+            FATAL("Failed to attach asmjit assembler to code holder; returned {}",
+              asmjit::DebugUtils::errorAsString(err));
+        }
+        if constexpr (enable_rsp_jit_error_handler) {
+            static AsmjitLogErrorHandler asmjit_log_error_handler;
+            code_holder.setErrorHandler(&asmjit_log_error_handler);
+        }
+        if constexpr (log_rsp_jit_blocks) {
+            jit_logger.addFlags(FormatFlags::kMachineCode);
+            code_holder.setLogger(&jit_logger);
+        }
     }
     if constexpr (log_rsp_jit_blocks) {
-        jit_logger.addFlags(FormatFlags::kMachineCode);
-        code_holder.setLogger(&jit_logger);
         jit_logger.log("======== RSP BLOCK BEGIN ========\n");
     }
-    FuncNode* func_node = c.addFunc(FuncSignature::build<void>());
-    func_node->frame().setAvxEnabled();
-    func_node->frame().setAvxCleanup();
-    if constexpr (platform.avx512) {
-        func_node->frame().setAvx512Enabled();
-    }
     reg_alloc.BlockProlog();
 }
 
 void Compile(Block& block)
 {
+    auto compile_start = std::chrono::steady_clock::now();
     branched = block_has_branch_instr = false;
     block_cycles = 0;
     jit_pc = pc;
+    AnalyzeGprLiveness();
+    reg_alloc.SetGprLiveness(&gpr_liveness);
 
     BlockProlog();
 
@@ -110,10 +184,23 @@ void Compile(Block& block)
         EmitBranchCheck();
     }
 
-    while (!branched && (jit_pc & 255)) {
-        branched |= last_instr_was_branch; // If the branch delay slot instruction fits within the block boundary,
-                                           // include it before stopping
+    while (!branched && !AtBlockEnd(jit_pc)) {
+        // If the branch delay slot instruction fits within the block boundary, include it before stopping. Past the
+        // delay slot of a conditional branch, the block goes on with the path on which the branch is not taken.
+        bool in_delay_slot = last_instr_was_branch;
+        bool falls_through = in_delay_slot
+                          && mips::GetBranchKind(FetchInstruction((jit_pc - 4) & 0xFFC), mips::Isa::Rsp)
+                               == mips::BranchKind::Conditional;
+        branched |= in_delay_slot && !falls_through;
         EmitInstruction();
+        if (falls_through) {
+            if (last_instr_was_branch) {
+                branched = true; // a branch in the delay slot
+            } else if (!AtBlockEnd(jit_pc)) {
+                EmitBranchCheck();
+                block_has_branch_instr = false;
+            }
+        }
     }
 
     if (!last_instr_was_branch && block_has_branch_instr) {
@@ -122,6 +209,18 @@ void Compile(Block& block)
 
     BlockEpilogWithPcFlush(0);
     FinalizeBlock(block);
+
+    // Register the block with the pools that it extends into, so that it is dropped once any of them is invalidated
+    u32 num_instrs = ((jit_pc - pc) & 0xFFF) / 4;
+    u32 first_pool = pc >> 8, last_pool = (pc + 4 * num_instrs - 1) >> 8;
+    for (u32 i = first_pool + 1; i <= last_pool; ++i) {
+        spanning_block_pools[i] |= u16(1 << first_pool);
+    }
+
+    ++recompiler_stats.compiled_blocks;
+    recompiler_stats.compiled_instrs += num_instrs;
+    recompiler_stats.compile_time_total_ns +=
+      u64(std::chrono::nanoseconds(std::chrono::steady_clock::now() - compile_start).count());
 }
 
 void EmitBranchCheck()
@@ -151,6 +250,7 @@ void EmitInstruction()
 {
     block_cycles++;
     last_instr_was_branch = false;
+    reg_alloc.BeginInstruction(((jit_pc - pc) & 0xFFF) / 4);
     u32 instr = FetchInstruction(jit_pc);
     decode_and_emit_rsp(instr);
     jit_pc = (jit_pc + 4) & 0xFFC;
@@ -168,15 +268,31 @@ void EmitLink(u32 reg)
 
 void FinalizeBlock(Block& block)
 {
-    c.endFunc();
-    asmjit::Error err = c.finalize();
-    if (err) {
-        FATAL("Failed to finalize code block; returned {}", asmjit::DebugUtils::errorAsString(err));
+    block = reinterpret_cast<Block>(code_cache.add(code_holder));
+    if (!block) {
+        FATAL("Compiled block of {} bytes does not fit in the code cache", code_holder.codeSize());
+    }
+    recompiler_stats.code_cache_bytes_used = code_cache.used();
+}
+
+// See the comment on vr4300::FlushCodeCache
+void FlushCodeCache()
+{
+    for (Pool*& pool : pools) {
+        if (pool) {
+            pool = nullptr;
+            ++recompiler_stats.pools_released;
+        }
     }
-    err = jit_runtime.add(&block, &code_holder);
-    if (err) {
-        FATAL("Failed to add code to asmjit runtime! Returned {}", err);
+    for (auto const& [hash, microcode] : microcodes) {
+        recompiler_stats.pools_released += u64(std::ranges::count_if(microcode.pools, [](Pool* pool) { return pool; }));
     }
+    microcodes.clear();
+    allocator.reset();
+    spanning_block_pools = {};
+    code_cache.flush();
+    recompiler_stats.code_cache_bytes_used = 0;
+    ++recompiler_stats.code_cache_flushes;
 }
 
 void FlushPc(int pc_offset)
@@ -195,16 +311,52 @@ Block& GetBlock(u32 addr)
     static_assert(std::has_single_bit(num_pools));
     Pool*& pool = pools[addr >> 8]; // each pool 6 bits, each instruction 2 bits
     if (!pool) {
-        pool = allocator.acquire<Pool>(); // TODO: check if OOM
+        pool = allocator.acquire();
+        if (!pool) {
+            FlushCodeCache();
+            pool = allocator.acquire();
+        }
+        ++recompiler_stats.pools_acquired;
     }
     assert(pool);
     return pool->blocks[addr >> 2 & 63];
 }
 
+// FNV-1a over doublewords, folding the high half of the hash into the low one so that all bits of IMEM take part
+u64 HashImem()
+{
+    u64 hash = 0xCBF2'9CE4'8422'2325;
+    for (u32 i = 0; i < 0x1000; i += 8) {
+        u64 dword;
+        std::memcpy(&dword, imem + i, 8);
+        hash = (hash ^ dword) * 0x100'0000'01B3;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+bool ImemMatches(std::array<u8, 0x1000> const& image)
+{
+    return std::memcmp(image.data(), imem, image.size()) == 0;
+}
+
 Status InitRecompiler()
 {
+    if (!code_cache.base()) {
+        Status status = code_cache.allocate(code_cache_size);
+        if (!status.Ok()) {
+            return status;
+        }
+    }
+    code_cache.flush();
+    recompiler_stats.code_cache_bytes_used = 0;
+    recompiler_stats.code_cache_capacity = code_cache.capacity();
     allocator.allocate(16_MiB);
     pools.resize(num_pools, nullptr);
+    spanning_block_pools = {};
+    microcodes.clear();
+    microcode_hashes_seen.clear();
+    imem_hash.reset();
     return OkStatus();
 }
 
@@ -212,22 +364,37 @@ void Invalidate(u32 addr)
 {
     if (cpu_impl == CpuImpl::Recompiler) {
         assert(addr < 0x1000);
-        Pool*& pool = pools[addr >> 8]; // each pool 6 bits, each instruction 2 bits
-        ResetPool(pool);
+        ResetPool(addr >> 8); // each pool 6 bits, each instruction 2 bits
+        imem_hash.reset();
     }
 }
 
-void InvalidateRange(u32 addr_lo, u32 addr_hi)
+// IMEM is hashed as a whole after every DMA into it. A microcode is often loaded in several parts, or together with
+// overlays; each resulting image is cached by itself, and the blocks of the previous image are kept aside.
+void OnDmaToImem()
 {
-    if (cpu_impl == CpuImpl::Recompiler) {
-        assert(addr_lo <= addr_hi);
-        assert(addr_hi <= 0x1000);
-        u32 pool_lo = addr_lo >> 8;
-        u32 pool_hi = addr_hi >> 8;
-        for (u32 i = pool_lo; i <= pool_hi; ++i) {
-            ResetPool(pools[i]);
+    if (cpu_impl != CpuImpl::Recompiler) {
+        return;
+    }
+    u64 hash = HashImem();
+    if (imem_hash == hash && ImemMatches(imem_image)) {
+        return; // the microcode was loaded again
+    }
+    StashMicrocode();
+    imem_hash = hash;
+    std::memcpy(imem_image.data(), imem, imem_image.size());
+    if (auto it = microcodes.find(hash); it != microcodes.end()) {
+        if (ImemMatches(it->second.imem)) {
+            std::ranges::copy(it->second.pools, pools.begin());
+            spanning_block_pools = it->second.spanning_block_pools;
+            ++recompiler_stats.microcode_cache_hits;
+        } else { // a different image with the same hash; its blocks are dropped, and the new image is compiled anew
+            ReleasePools(it->second.pools);
         }
+        microcodes.erase(it);
     }
+    microcode_hashes_seen.insert(hash);
+    recompiler_stats.microcodes_seen = microcode_hashes_seen.size();
 }
 
 void RecordBlockCycles()
@@ -236,26 +403,63 @@ void RecordBlockCycles()
     c.add(JitPtr(cycle_counter), block_cycles);
 }
 
-void ResetPool(Pool*& pool)
+void ReleasePools(std::span<Pool*> pools_to_release)
 {
-    if (pool) {
-        for (Block block : pool->blocks) {
-            if (block) {
-                jit_runtime.release(block);
-            }
+    for (Pool*& pool : pools_to_release) {
+        if (pool) {
+            allocator.release(pool);
+            pool = nullptr;
+            ++recompiler_stats.pools_released;
         }
+    }
+}
+
+void ResetPool(u32 pool_index)
+{
+    // Blocks that extend into this pool from earlier ones go as well, together with the rest of their pools
+    u16 start_pools = std::exchange(spanning_block_pools[pool_index], 0);
+    for (u32 i = 0; start_pools; ++i, start_pools >>= 1) {
+        if (start_pools & 1) {
+            ResetPool(i);
+        }
+    }
+    Pool*& pool = pools[pool_index];
+    if (pool) {
+        allocator.release(pool); // the code of the blocks stays in the code cache until it is flushed
         pool = nullptr;
+        ++recompiler_stats.pools_released;
     }
 }
 
+// Keeps the blocks of the current IMEM image aside, unless the image is not known, or there are no blocks to keep
+void StashMicrocode()
+{
+    bool has_blocks = std::ranges::any_of(pools, [](Pool* pool) { return pool; });
+    if (imem_hash && has_blocks) {
+        Microcode& microcode = microcodes[*imem_hash];
+        ReleasePools(microcode.pools); // of a different image with the same hash, if any
+        std::ranges::copy(pools, microcode.pools.begin());
+        microcode.spanning_block_pools = spanning_block_pools;
+        microcode.imem = imem_image;
+    } else {
+        ReleasePools(pools);
+    }
+    std::ranges::fill(pools, nullptr);
+    spanning_block_pools = {};
+}
+
 u32 RunRecompiler(u32 rsp_cycles)
 {
     if (sp.status.halted) return 0;
+    if (std::exchange(task_start_pending, false) && hle::RunTask()) return 0;
     cycle_counter = 0;
     if (sp.status.sstep) {
         OnSingleStep();
     } else {
         while (cycle_counter < rsp_cycles && !sp.status.halted && !sp.status.sstep) {
+            if (code_cache.available() < max_block_code_size) [[unlikely]] {
+                FlushCodeCache();
+            }
             Block& block = GetBlock(pc);
             if (!block) {
                 Compile(block);
@@ -275,8 +479,23 @@ u32 RunRecompiler(u32 rsp_cycles)
 
 void TearDownRecompiler()
 {
+    if (log_jit_compile_stats && recompiler_stats.compiled_instrs > 0) {
+        LogInfo("Compiled {} RSP blocks of {} instructions in {:.1f} ms; {:.0f} ns per instruction",
+          recompiler_stats.compiled_blocks,
+          recompiler_stats.compiled_instrs,
+          double(recompiler_stats.compile_time_total_ns) / 1e6,
+          double(recompiler_stats.compile_time_total_ns) / double(recompiler_stats.compiled_instrs));
+        LogInfo("Saw {} distinct RSP microcodes; {} microcode loads reused cached blocks",
+          recompiler_stats.microcodes_seen,
+          recompiler_stats.microcode_cache_hits);
+    }
+    code_holder.reset();
+    code_cache.deallocate();
     allocator.deallocate();
     pools.clear();
+    microcodes.clear();
+    microcode_hashes_seen.clear();
+    imem_hash.reset();
 }
 
 } // namespace n64::rsp
@@ -19,6 +19,19 @@
 
 namespace n64::rsp {
 
+struct RecompilerStats {
+    u64 code_cache_bytes_used;
+    u64 code_cache_capacity;
+    u64 code_cache_flushes;
+    u64 compile_time_total_ns;
+    u64 compiled_blocks;
+    u64 compiled_instrs; /* with compile_time_total_ns, gives the compile time per instruction */
+    u64 microcode_cache_hits; /* DMAs into IMEM that brought back a microcode whose blocks were still cached */
+    u64 microcodes_seen; /* distinct IMEM images loaded by DMA */
+    u64 pools_acquired;
+    u64 pools_released;
+};
+
 void BlockEpilog();
 void BlockEpilogWithPcFlushAndJmp(void* func, int pc_offset = 0);
 void BlockEpilogWithPcFlush(int pc_offset);
@@ -26,17 +39,18 @@ void EmitBranchTaken(u32 target);
 void EmitBranchTaken(HostGpr32 target);
 Status InitRecompiler();
 void Invalidate(u32 addr);
-void InvalidateRange(u32 addr_lo, u32 addr_hi);
 void EmitLink(u32 reg);
+void OnDmaToImem();
 u32 RunRecompiler(u32 cpu_cycles);
 void TearDownRecompiler();
 
-inline JitCompiler c;
+inline JitAssembler c;
 inline RegisterAllocator reg_alloc{ c, gpr.view(), std::span<m128i const, 32>{ vpr } };
 inline u32 jit_pc;
 inline u32 block_cycles;
 inline bool last_instr_was_branch;
 inline bool branched;
+inline RecompilerStats recompiler_stats;
 
 inline ptrdiff_t get_offset_to_guest_gpr_base_ptr(void const* obj)
 {
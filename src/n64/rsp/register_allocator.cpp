@@ -16,14 +16,14 @@ constexpr int register_stack_space = gprs_stack_space + vprs_stack_space;
 
 static_assert(!IsVolatile(guest_gpr_mid_ptr_reg));
 
-RegisterAllocator::RegisterAllocator(JitCompiler& compiler,
+RegisterAllocator::RegisterAllocator(JitAssembler& assembler,
   std::span<s32 const, 32> guest_gprs,
   std::span<m128i const, 32> guest_vprs)
   : state_gpr{ this },
     state_vpr{ this },
     guest_gprs{ guest_gprs },
     guest_vprs{ guest_vprs },
-    c{ compiler },
+    c{ assembler },
     gpr_mid_ptr{ guest_gprs.data() + guest_gprs.size() / 2 },
     vpr_mid_ptr{ guest_vprs.data() + guest_vprs.size() / 2 },
     gpr_stack_space_setup{},
@@ -33,6 +33,12 @@ RegisterAllocator::RegisterAllocator(JitCompiler& compiler,
     state_vpr.FillBindings(reg_alloc_volatile_vprs, reg_alloc_nonvolatile_vprs);
 }
 
+// See vr4300::RegisterAllocator::BeginInstruction
+void RegisterAllocator::BeginInstruction(u32 index)
+{
+    state_gpr.BeginInstruction(index);
+}
+
 void RegisterAllocator::BlockEpilog()
 {
     state_gpr.FlushAndRestoreAll();
@@ -329,6 +335,11 @@ void RegisterAllocator::SaveHost(HostVpr128 host) const
     }
 }
 
+void RegisterAllocator::SetGprLiveness(mips::GprLiveness const* liveness)
+{
+    state_gpr.SetLiveness(liveness);
+}
+
 void RegisterAllocator::SetupGprStackSpace()
 {
     if (!std::exchange(gpr_stack_space_setup, true)) {
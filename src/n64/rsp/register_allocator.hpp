@@ -1,6 +1,7 @@
 #pragma once
 
 #include "jit_common.hpp"
+#include "mips/gpr_liveness.hpp"
 #include "mips/register_allocator_state.hpp"
 #include "numtypes.hpp"
 #include "platform.hpp"
@@ -171,7 +172,7 @@ class RegisterAllocator {
     RegisterAllocatorStateVpr state_vpr;
     std::span<s32 const, 32> guest_gprs;
     std::span<m128i const, 32> guest_vprs;
-    JitCompiler& c;
+    JitAssembler& c;
     s32 const* gpr_mid_ptr;
     m128i const* vpr_mid_ptr;
     bool gpr_stack_space_setup;
@@ -185,10 +186,11 @@ class RegisterAllocator {
     void Reset();
 
 public:
-    RegisterAllocator(JitCompiler& compiler,
+    RegisterAllocator(JitAssembler& assembler,
       std::span<s32 const, 32> guest_gprs,
       std::span<m128i const, 32> guest_vprs);
 
+    void BeginInstruction(u32 index);
     void BlockEpilog();
     void BlockEpilogWithJmp(void* func);
     void BlockProlog();
@@ -220,6 +222,7 @@ public:
     void RestoreHost(HostVpr128 host) const;
     void SaveHost(HostGpr32 host) const;
     void SaveHost(HostVpr128 host) const;
+    void SetGprLiveness(mips::GprLiveness const* liveness);
     void SetupGprStackSpace();
 };
 
@@ -4,6 +4,7 @@
 #include "memory/rdram.hpp"
 #include "n64_build_options.hpp"
 #include "rsp/recompiler.hpp"
+#include "rsp/rsp_thread.hpp"
 #include "scheduler.hpp"
 #include "vr4300/recompiler.hpp"
 
@@ -64,6 +65,11 @@ u8* GetPointerToMemory(u32 addr)
 
 template<DmaType dma_type> void InitDma()
 {
+    if (enable_rsp_thread && OnRspThread()) {
+        /* DMAs access RDRAM and the scheduler, which belong to the CPU thread */
+        RunOnCpuThread(InitDma<dma_type>);
+        return;
+    }
     in_progress_dma_type = dma_type;
     sp.status.dma_busy = 1;
     sp.dma_busy |= 1;
@@ -105,13 +111,10 @@ template<DmaType dma_type> void InitDma()
     scheduler::AddEvent(scheduler::EventType::SpDmaFinish, cpu_cycles_until_finish, OnDmaFinish);
 
     auto dram_start = sp.dma_ramaddr;
-    auto sp_start = sp.dma_spaddr & 0x1FFF;
-    bool sp_full_cycle{};
 
     auto AlignAddresses = [&] {
         sp.dma_spaddr = sp.dma_spaddr & 0x1000 | sp.dma_spaddr + 4 & 0xFFF; // stay within DMEM or IMEM
         sp.dma_ramaddr += 4; // TODO: ensure no overflow
-        sp_full_cycle |= sp.dma_spaddr == sp_start;
     };
 
     auto DstPtr = [] {
@@ -160,19 +163,9 @@ template<DmaType dma_type> void InitDma()
     }
 
     if constexpr (dma_type == DmaType::RdToSp) {
-        if (rsp::cpu_impl == CpuImpl::Recompiler && (sp.dma_spaddr & 0x1000)) {
-            if (sp_full_cycle) {
-                rsp::InvalidateRange(0, 0x1000);
-            } else if (sp_start < (sp.dma_spaddr & 0x1FFF)) {
-                rsp::InvalidateRange(sp_start - 0x1000, sp.dma_spaddr - 0x1000);
-            } else {
-                if (sp.dma_spaddr != 0x1000) {
-                    rsp::InvalidateRange(0, sp.dma_spaddr - 0x1000);
-                }
-                rsp::InvalidateRange(sp_start - 0x1000, 0x1000);
-            }
+        if (sp.dma_spaddr & 0x1000) {
+            rsp::OnDmaToImem();
         }
-
     } else {
         // TODO: handle case where skip > 0
         vr4300::InvalidateRange(dram_start, sp.dma_ramaddr);
@@ -196,6 +189,7 @@ void NotifyIllegalInstrCode(u32 instr_code)
 
 void OnDmaFinish()
 {
+    scheduler::CatchUpRsp();
     if (sp.status.dma_full) {
         sp.status.dma_full = 0;
         sp.dma_full &= ~1;
@@ -241,6 +235,7 @@ void PerformBranch()
 void PowerOn()
 {
     jump_is_pending = false;
+    task_start_pending = false;
     pc = 0;
     mem.fill(0);
     std::memset(&sp, 0, sizeof(sp));
@@ -259,6 +254,7 @@ template<std::signed_integral Int> Int ReadDMEM(u32 addr)
 
 template<std::signed_integral Int> Int ReadMemoryCpu(u32 addr)
 { /* CPU precondition; the address is always aligned */
+    scheduler::CatchUpRsp();
     if (addr < 0x0404'0000) {
         Int ret;
         std::memcpy(&ret, mem.data() + (addr & 0x1FFF), sizeof(Int));
@@ -384,6 +380,7 @@ template<size_t access_size> void WriteMemoryCpu(u32 addr, s64 data)
         if constexpr (access_size == 4) return s32(data);
         if constexpr (access_size == 8) return s32(data >> 32);
     }();
+    scheduler::CatchUpRsp();
     if (addr < 0x0404'0000) {
         addr &= 0x1FFC;
         to_write = std::byteswap(to_write);
@@ -443,7 +440,9 @@ void WriteReg(u32 addr, u32 data)
         case Register::Status: {
             if ((data & 3) == 1) {
                 /* CLR_HALT: Start running RSP code from the current RSP PC (clear the HALTED flag) */
+                task_start_pending |= sp.status.halted;
                 sp.status.halted = 0;
+                scheduler::OnRspStarted();
             } else if ((data & 3) == 2) {
                 /* 	SET_HALT: Pause running RSP code (set the HALTED flag) */
                 sp.status.halted = 1;
@@ -53,6 +53,7 @@ inline u32 cycle_counter;
 inline s32 lo_dummy, hi_dummy;
 inline bool in_branch_delay_slot;
 inline bool jump_is_pending;
+inline bool task_start_pending; /* the CPU has started the RSP; checked for an HLE task at the next step */
 
 inline CpuImpl cpu_impl;
 
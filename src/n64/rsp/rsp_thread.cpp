@@ -0,0 +1,227 @@
+#include "rsp_thread.hpp"
+#include "hle.hpp"
+#include "platform.hpp"
+#include "rsp.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if PLATFORM_X64
+#    include <immintrin.h>
+#endif
+
+namespace n64::rsp {
+
+struct DeferredInterrupt {
+    mi::InterruptType interrupt_type;
+    bool raise;
+};
+
+/* The bits of 'state'. Who owns the RSP, the requests between the two threads, and the RSP cycles handed to the RSP
+   thread and not yet taken by it, are kept in a single word, so that the threads see them change together. */
+constexpr u32 rsp_owned = 1u << 31; /* else, the CPU thread owns the RSP: it is halted, or the CPU is accessing it */
+constexpr u32 sync_request = 1u << 30; /* by the CPU thread: give the RSP back, after the remaining cycles have run */
+constexpr u32 cpu_work_request = 1u << 29; /* by the RSP thread, with the RSP given to the CPU: run 'cpu_work' */
+constexpr u32 stop_request = 1u << 28;
+constexpr u32 cycle_budget_mask = stop_request - 1;
+
+/* The RSP cycles that the CPU may be ahead of the RSP by, before the CPU thread waits for the RSP thread */
+constexpr u32 max_cycle_skew = 2048;
+constexpr int spins_before_sleeping = 4096;
+
+static std::jthread thread;
+static std::atomic<u32> state; /* the owner has the RSP state (sp, mem, registers) and the RDP command interface */
+static void (*cpu_work)(); /* see 'cpu_work_request' */
+static std::atomic<bool> has_deferred_interrupts;
+static std::mutex deferred_interrupts_mutex; /* guards 'deferred_interrupts' */
+static std::vector<DeferredInterrupt> deferred_interrupts;
+static std::vector<DeferredInterrupt> interrupts_to_apply; /* CPU thread only */
+
+static u32 DoCpuWork(u32 current_state);
+static void ThreadMain(u32 (*run)(u32));
+static void WaitWhileStateIs(u32 value);
+
+/* Called by the CPU thread after each step of the CPU */
+void AddThreadCycles(u32 rsp_cycles)
+{
+    u32 s = state.load(std::memory_order_acquire);
+    while (true) {
+        if (s & cpu_work_request) {
+            s = DoCpuWork(s);
+        }
+        if (!(s & rsp_owned)) {
+            if (sp.status.halted) {
+                return;
+            }
+            /* HLE tasks write RDRAM, which invalidates compiled CPU code; they run here, not on the RSP thread */
+            if (std::exchange(task_start_pending, false) && hle::RunTask()) {
+                return;
+            }
+            state.store(rsp_owned | rsp_cycles, std::memory_order_release);
+            state.notify_all();
+            return;
+        }
+        if (state.compare_exchange_weak(s, s + rsp_cycles, std::memory_order_release, std::memory_order_acquire)) {
+            s += rsp_cycles;
+            break;
+        }
+    }
+    state.notify_all();
+    /* Should the RSP thread give the RSP to the CPU thread meanwhile, its request is served at the next step */
+    while ((s & rsp_owned) && (s & cycle_budget_mask) > max_cycle_skew) {
+        WaitWhileStateIs(s);
+        s = state.load(std::memory_order_acquire);
+    }
+}
+
+void ApplyDeferredInterrupts()
+{
+    if (!has_deferred_interrupts.load(std::memory_order_acquire)) {
+        return;
+    }
+    {
+        std::lock_guard lock{ deferred_interrupts_mutex };
+        interrupts_to_apply.swap(deferred_interrupts);
+        has_deferred_interrupts.store(false, std::memory_order_relaxed);
+    }
+    for (DeferredInterrupt interrupt : interrupts_to_apply) {
+        interrupt.raise ? mi::RaiseInterrupt(interrupt.interrupt_type) : mi::ClearInterrupt(interrupt.interrupt_type);
+    }
+    interrupts_to_apply.clear();
+}
+
+void DeferInterrupt(mi::InterruptType interrupt_type, bool raise)
+{
+    std::lock_guard lock{ deferred_interrupts_mutex };
+    deferred_interrupts.push_back({ interrupt_type, raise });
+    has_deferred_interrupts.store(true, std::memory_order_release);
+}
+
+/* Called by the CPU thread, which has been given the RSP with 'cpu_work_request'. Gives the RSP back. */
+u32 DoCpuWork(u32 current_state)
+{
+    cpu_work();
+    /* The RSP thread waits for the RSP, and leaves 'state' alone until then */
+    u32 new_state = (current_state & ~cpu_work_request) | rsp_owned;
+    state.store(new_state, std::memory_order_release);
+    state.notify_all();
+    return new_state;
+}
+
+/* Called by the RSP thread: gives the RSP to the CPU thread, which runs 'work', and waits for it to be given back */
+void RunOnCpuThread(void (*work)())
+{
+    cpu_work = work;
+    u32 s = state.load(std::memory_order_relaxed);
+    while (!state.compare_exchange_weak(s, (s & ~rsp_owned) | cpu_work_request, std::memory_order_release)) {
+    }
+    state.notify_all();
+    while (!((s = state.load(std::memory_order_acquire)) & rsp_owned)) {
+        WaitWhileStateIs(s);
+    }
+}
+
+void StartThread(u32 (*run)(u32 rsp_cycles))
+{
+    state.store(0);
+    thread = std::jthread(ThreadMain, run);
+}
+
+void StopThread()
+{
+    if (!thread.joinable()) {
+        return;
+    }
+    SyncThread();
+    state.store(stop_request, std::memory_order_release);
+    state.notify_all();
+    thread.join();
+    state.store(0);
+    ApplyDeferredInterrupts();
+}
+
+/* Called by the CPU thread before it accesses state of the RSP: waits for the RSP thread to run the cycles that it has
+   been handed, and to give the RSP back. Interrupts raised by the RSP until then are applied. */
+void SyncThread()
+{
+    if (OnRspThread() || !thread.joinable()) {
+        return;
+    }
+    u32 s = state.load(std::memory_order_acquire);
+    while (true) {
+        if (s & cpu_work_request) {
+            s = DoCpuWork(s);
+        }
+        if (!(s & rsp_owned)) {
+            break;
+        }
+        if (!(s & sync_request)) {
+            u32 new_state = s | sync_request;
+            if (!state.compare_exchange_weak(s, new_state, std::memory_order_release, std::memory_order_acquire)) {
+                continue;
+            }
+            s |= sync_request;
+            state.notify_all();
+        }
+        WaitWhileStateIs(s);
+        s = state.load(std::memory_order_acquire);
+    }
+    ApplyDeferredInterrupts();
+}
+
+void ThreadMain(u32 (*run)(u32))
+{
+    on_rsp_thread = true;
+    u32 cycle_overrun = 0;
+    u32 s = state.load(std::memory_order_acquire);
+    while (!(s & stop_request)) {
+        if (!(s & rsp_owned) || !(s & (cycle_budget_mask | sync_request))) {
+            WaitWhileStateIs(s);
+            s = state.load(std::memory_order_acquire);
+            continue;
+        }
+        u32 cycles = s & cycle_budget_mask;
+        if (cycles == 0) { /* all cycles have run, and the CPU thread wants the RSP */
+            if (state.compare_exchange_weak(s, 0, std::memory_order_release, std::memory_order_acquire)) {
+                state.notify_all();
+                s = 0;
+            }
+            continue;
+        }
+        if (!state.compare_exchange_weak(s, s & ~cycle_budget_mask, std::memory_order_acq_rel)) {
+            continue;
+        }
+        state.notify_all(); /* the CPU thread may be waiting for the budget to shrink */
+        if (cycle_overrun < cycles) {
+            cycle_overrun = run(cycles - cycle_overrun);
+        } else {
+            cycle_overrun -= cycles;
+        }
+        if (sp.status.halted) {
+            /* Cycles handed over since are dropped, and a sync request is answered by the CPU thread owning the RSP */
+            cycle_overrun = 0;
+            state.store(0, std::memory_order_release);
+            state.notify_all();
+        }
+        s = state.load(std::memory_order_acquire);
+    }
+}
+
+/* Spins for a short while, as the other thread usually answers quickly, before sleeping */
+void WaitWhileStateIs(u32 value)
+{
+    for (int i = 0; i < spins_before_sleeping; ++i) {
+        if (state.load(std::memory_order_acquire) != value) {
+            return;
+        }
+#if PLATFORM_X64
+        _mm_pause();
+#endif
+    }
+    state.wait(value, std::memory_order_acquire);
+}
+
+} // namespace n64::rsp
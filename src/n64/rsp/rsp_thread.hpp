@@ -0,0 +1,30 @@
+#pragma once
+
+#include "interface/mi.hpp"
+#include "numtypes.hpp"
+
+/* Running the RSP on a thread of its own (see 'enable_rsp_thread'). The CPU thread hands the RSP its cycles, and the
+   RSP thread runs them behind it. The two meet only where the CPU can observe or change the state of the RSP (SP and
+   DP registers, DMEM/IMEM, the SP DMA, the frame buffer at the end of a field); there, the CPU waits for the RSP to run
+   the cycles that it has been handed, and to give the RSP state back to it. Interrupts raised by the RSP are queued,
+   and applied by the CPU thread. SP DMAs access RDRAM and the scheduler, which belong to the CPU thread; the RSP
+   thread gives the RSP to the CPU thread for them, and waits. */
+
+namespace n64::rsp {
+
+void AddThreadCycles(u32 rsp_cycles);
+void ApplyDeferredInterrupts();
+void DeferInterrupt(mi::InterruptType interrupt_type, bool raise);
+void RunOnCpuThread(void (*work)());
+void StartThread(u32 (*run)(u32 rsp_cycles));
+void StopThread();
+void SyncThread();
+
+inline thread_local bool on_rsp_thread;
+
+inline bool OnRspThread()
+{
+    return on_rsp_thread;
+}
+
+} // namespace n64::rsp
@@ -34,6 +34,7 @@ static std::array<ICacheLine, 512> i_cache; /* 16 KB */
 static u8* rdram_ptr;
 
 static void FillCacheLine(auto& cache_line, u32 paddr);
+static void HandleBypassedDCacheOp(DCacheLine& cache_line, u32 op, u32 paddr);
 static void WritebackCacheLine(auto& cache_line, u32 new_paddr);
 
 void cache(u32 rs, u32 rt, s16 imm)
@@ -141,7 +142,11 @@ void cache(u32 rs, u32 rt, s16 imm)
         HandleOp(cache_line);
     } else if (cache == 1) { /* D-Cache */
         DCacheLine& cache_line = d_cache[virt_addr >> 4 & 0x1FF];
-        HandleOp(cache_line);
+        if (DataAccessesBypassDCache()) {
+            HandleBypassedDCacheOp(cache_line, op, paddr);
+        } else {
+            HandleOp(cache_line);
+        }
     }
 }
 
@@ -162,6 +167,35 @@ void FillCacheLine(auto& cache_line, u32 paddr)
     AdvancePipeline(40);
 }
 
+/* With the data accesses bypassing the D-cache (see 'DataAccessesBypassDCache'), RDRAM is always up to date, and the
+   data in the cache lines is stale. Writing a line back would overwrite newer data, so the ops that write back only
+   invalidate, and lines are never made dirty. */
+void HandleBypassedDCacheOp(DCacheLine& cache_line, u32 op, u32 paddr)
+{
+    switch (op) {
+    case 0: /* Index_Invalidate */
+    case 4: /* Hit_Invalidate */
+    case 5: /* Hit_Write_Back_Invalidate */
+        if (op == 0 || (paddr & ~0xFFF) == cache_line.ptag) {
+            cache_line.valid = cache_line.dirty = false;
+        }
+        break;
+
+    case 1: /* Index_Load_Tag */
+        cop0.tag_lo.ptag = cache_line.ptag >> 12;
+        cop0.tag_lo.pstate = cache_line.valid << 1;
+        break;
+
+    case 2: /* Index_Store_Tag */
+        cache_line.ptag = cop0.tag_lo.ptag << 12;
+        cache_line.valid = cop0.tag_lo.pstate >> 1;
+        cache_line.dirty = false;
+        break;
+
+    default: break; /* Create_Dirty_Exclusive, Hit_Write_Back */
+    }
+}
+
 void InitCache()
 {
     rdram_ptr = rdram::GetPointerToMemory(0);
@@ -264,6 +298,7 @@ void WritebackCacheLine(auto& cache_line, u32 new_paddr)
         and not the physical address translated by using TLB */
     auto rdram_offset = cache_line.ptag | new_paddr & 0xFFF & ~(sizeof(cache_line.data) - 1);
     std::memcpy(rdram_ptr + rdram_offset, cache_line.data, sizeof(cache_line.data));
+    InvalidateRange(rdram_offset, rdram_offset + sizeof(cache_line.data) - 1);
     if constexpr (sizeof(cache_line) == sizeof(DCacheLine)) {
         cache_line.dirty = false;
     }
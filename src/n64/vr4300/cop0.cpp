@@ -2,6 +2,7 @@
 #include "always_false.hpp"
 #include "exceptions.hpp"
 #include "mmu.hpp"
+#include "recompiler.hpp"
 #include "scheduler.hpp"
 #include "vr4300.hpp"
 #include "vr4300/interpreter.hpp"
@@ -131,6 +132,7 @@ template<bool raw> void Cop0Registers::Set(size_t reg_index, std::signed_integra
     case Cop0Reg::entry_hi:
         if constexpr (raw) Write(entry_hi, value);
         else WriteMasked(entry_hi, value, 0xC000'00FF'FFFF'E0FF);
+        OnWriteToEntryHi();
         break;
 
     case Cop0Reg::compare:
@@ -215,6 +217,7 @@ void OnWriteToStatus()
 {
     can_exec_cop0_instrs = operating_mode == OperatingMode::Kernel || cop0.status.cu0;
     SetVaddrToPaddrFuncs();
+    OnModeContextChange();
     CheckInterrupts();
 }
 
@@ -19,7 +19,7 @@ void OnCop0Unusable()
 {
     reg_alloc.DestroyVolatile(host_gpr_arg[0]);
     c.xor_(host_gpr_arg[0].r32(), host_gpr_arg[0].r32());
-    BlockEpilogWithPcFlushAndJmp((void*)CoprocessorUnusableException);
+    BlockEpilogWithException((void*)CoprocessorUnusableException);
     branched = true;
 }
 
@@ -154,15 +154,11 @@ template<size_t size> void WriteCop0(Gpq src, u32 idx)
         break;
     case Cop0Reg::entry_hi: WriteMasked(cop0.entry_hi, 0xC000'00FF'FFFF'E0FF); break;
     case Cop0Reg::compare: {
-        Label l_noexception = c.newLabel();
         c.lea(rax, ptr(src, src));
         c.mov(JitPtr(cop0.compare), rax);
         FlushPc();
         reg_alloc.Call((void*)OnWriteToCompare);
-        c.cmp(JitPtr(exception_occurred), 0);
-        c.je(l_noexception);
-        BlockEpilog();
-        c.bind(l_noexception);
+        EmitExceptionCheck();
     } break;
     case Cop0Reg::status:
         branched = true;
@@ -171,13 +167,9 @@ template<size_t size> void WriteCop0(Gpq src, u32 idx)
         break;
     case Cop0Reg::cause: {
         WriteMasked(cop0.cause, 0x300);
-        Label l_noexception = c.newLabel();
         FlushPc();
         reg_alloc.Call((void*)OnWriteToCause);
-        c.cmp(JitPtr(exception_occurred), 0);
-        c.je(l_noexception);
-        BlockEpilog();
-        c.bind(l_noexception);
+        EmitExceptionCheck();
     } break;
     case Cop0Reg::epc: Write(cop0.epc); break;
     case Cop0Reg::config: WriteMasked(cop0.config, 0xF00'800F); break;
@@ -193,7 +185,6 @@ template<size_t size> void WriteCop0(Gpq src, u32 idx)
 
 void cache(u32 rs, u32 rt, s16 imm)
 {
-    Label l_no_exception = c.newLabel();
     FlushPc();
     reg_alloc.FlushAll(); // flush nonvolatiles as well, since cache reads gpr[rs]
     Gpd arg0 = host_gpr_arg[0].r32(), arg1 = host_gpr_arg[1].r32(), arg2 = host_gpr_arg[2].r32();
@@ -202,24 +193,13 @@ void cache(u32 rs, u32 rt, s16 imm)
     imm ? c.mov(arg2, imm) : c.xor_(arg2, arg2);
     jit_call_no_stack_alignment(c,
       (void*)vr4300::cache); // todo: this used instead of reg_alloc.Call, since we have args
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_no_exception);
-    BlockEpilog();
-
-    c.bind(l_no_exception);
+    EmitExceptionCheck();
 }
 
 void dmfc0(u32 rt, u32 rd)
 {
-    if (can_exec_cop0_instrs) {
-        Label l_noexception = c.newLabel();
-        c.cmp(JitPtr(operating_mode), OperatingMode::Kernel);
-        c.je(l_noexception);
-        c.cmp(JitPtr(addressing_mode), AddressingMode::Dword);
-        c.je(l_noexception);
-        BlockEpilogWithPcFlushAndJmp((void*)ReservedInstructionException);
-
-        c.bind(l_noexception);
+    if (compile_context.can_exec_cop0_instrs) {
+        if (!CheckDwordOpCondJit()) return;
         if (rt) {
             Gpq ht = reg_alloc.GetDirtyGpr(rt);
             ReadCop0<8>(ht, rd);
@@ -231,15 +211,8 @@ void dmfc0(u32 rt, u32 rd)
 
 void dmtc0(u32 rt, u32 rd)
 {
-    if (can_exec_cop0_instrs) {
-        Label l_noexception = c.newLabel();
-        c.cmp(JitPtr(operating_mode), OperatingMode::Kernel);
-        c.je(l_noexception);
-        c.cmp(JitPtr(addressing_mode), AddressingMode::Dword);
-        c.je(l_noexception);
-        BlockEpilogWithPcFlushAndJmp((void*)ReservedInstructionException);
-
-        c.bind(l_noexception);
+    if (compile_context.can_exec_cop0_instrs) {
+        if (!CheckDwordOpCondJit()) return;
         Gpq ht = reg_alloc.GetGpr(rt);
         WriteCop0<8>(ht, rd);
     } else {
@@ -251,13 +224,13 @@ void eret()
 {
     branched = true;
     c.mov(JitPtr(branch_state), BranchState::NoBranch);
-    BlockEpilogWithPcFlushAndJmp(
-      (void*)vr4300::eret); // pc flush needed since exception handler may be called, and it reads the pc
+    FlushPc(); // pc flush needed since exception handler may be called, and it reads the pc
+    BlockEpilogWithDispatch((void*)vr4300::eret);
 }
 
 void mfc0(u32 rt, u32 rd)
 {
-    if (can_exec_cop0_instrs) {
+    if (compile_context.can_exec_cop0_instrs) {
         if (!rt) return;
         Gpq ht = reg_alloc.GetDirtyGpr(rt);
         ReadCop0<4>(ht, rd);
@@ -268,7 +241,7 @@ void mfc0(u32 rt, u32 rd)
 
 void mtc0(u32 rt, u32 rd)
 {
-    if (can_exec_cop0_instrs) {
+    if (compile_context.can_exec_cop0_instrs) {
         Gpq ht = reg_alloc.GetGpr(rt);
         WriteCop0<4>(ht, rd);
     } else {
@@ -279,48 +252,32 @@ void mtc0(u32 rt, u32 rd)
 bool tlbr()
 {
     FlushPc();
-    Label l_noexception = c.newLabel();
     reg_alloc.Call((void*)vr4300::tlbr);
-    c.test(al, al);
-    c.jz(l_noexception);
-    BlockEpilog();
-    c.bind(l_noexception);
+    EmitExceptionCheck();
     return true; // todo: interpreter version returns bool based on exception. not needed here
 }
 
 bool tlbwi()
 {
     FlushPc();
-    Label l_noexception = c.newLabel();
     reg_alloc.Call((void*)vr4300::tlbwi);
-    c.test(al, al);
-    c.jz(l_noexception);
-    BlockEpilog();
-    c.bind(l_noexception);
+    EmitExceptionCheck();
     return true; // todo: interpreter version returns bool based on exception. not needed here
 }
 
 bool tlbwr()
 {
     FlushPc();
-    Label l_noexception = c.newLabel();
     reg_alloc.Call((void*)vr4300::tlbwr);
-    c.test(al, al);
-    c.jz(l_noexception);
-    BlockEpilog();
-    c.bind(l_noexception);
+    EmitExceptionCheck();
     return true; // todo: interpreter version returns bool based on exception. not needed here
 }
 
 bool tlbp()
 {
     FlushPc();
-    Label l_noexception = c.newLabel();
     reg_alloc.Call((void*)vr4300::tlbp);
-    c.test(al, al);
-    c.jz(l_noexception);
-    BlockEpilog();
-    c.bind(l_noexception);
+    EmitExceptionCheck();
     return true; // todo: interpreter version returns bool based on exception. not needed here
 }
 
@@ -4,6 +4,7 @@
 #include "exceptions.hpp"
 #include "mmu.hpp"
 #include "platform.hpp"
+#include "recompiler.hpp"
 #include "vr4300.hpp"
 #include "vr4300/interpreter.hpp"
 
@@ -314,6 +315,13 @@ template<bool update_flags> bool TestExceptions()
     }
 }
 
+void OnWriteToFcr31()
+{
+    std::fesetround(guest_to_host_rounding_mode[fcr31.rm]);
+    OnModeContextChange();
+    TestExceptions<false>();
+}
+
 bool GetAndTestExceptions()
 {
     int const exc = std::fetestexcept(FE_ALL_EXCEPT);
@@ -467,8 +475,7 @@ void ctc1(u32 fs, u32 rt)
         if (fs == 31) {
             fcr31 =
               std::bit_cast<FCR31>(u32(gpr[rt]) & fcr31_write_mask | std::bit_cast<u32>(fcr31) & ~fcr31_write_mask);
-            std::fesetround(guest_to_host_rounding_mode[fcr31.rm]);
-            TestExceptions<false>();
+            OnWriteToFcr31();
         }
     } else {
         CoprocessorUnusableException(1);
@@ -146,6 +146,7 @@ void InitCop1();
 bool IsValidInput(std::floating_point auto f);
 template<std::signed_integral Int> bool IsValidInputCvtRound(std::floating_point auto f);
 bool IsValidOutput(std::floating_point auto& f);
+void OnWriteToFcr31();
 template<bool update_flags = true> bool TestExceptions();
 
 } // namespace n64::vr4300
@@ -21,26 +21,22 @@ void OnCop1Unusable();
 template<ComputeInstr1Op instr, std::floating_point Float> static void Compute(u32 fs, u32 fd);
 template<ComputeInstr2Op instr, std::floating_point Float> static void Compute(u32 fs, u32 ft, u32 fd);
 template<FpuNum From, FpuNum To> static void Convert(u32 fs, u32 fd);
+static void EmitGetAndTestExceptions(void* get_and_test_exceptions, Label l_exception);
 template<RoundInstr instr, FpuNum From, FpuNum To> static void Round(u32 fs, u32 fd);
 
 void CallCop1InterpreterImpl(auto impl, u32 fs, u32 fd)
 {
-    Label l_noexception = c.newLabel();
     FlushPc();
     reg_alloc.ReserveArgs(2);
     fs ? c.mov(host_gpr_arg[0].r32(), fs) : c.xor_(host_gpr_arg[0].r32(), host_gpr_arg[0].r32());
     fd ? c.mov(host_gpr_arg[1].r32(), fd) : c.xor_(host_gpr_arg[1].r32(), host_gpr_arg[1].r32());
     reg_alloc.Call((void*)impl);
     reg_alloc.FreeArgs(2);
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_noexception);
-    BlockEpilog();
-    c.bind(l_noexception);
+    EmitExceptionCheck();
 }
 
 void CallCop1InterpreterImpl(auto impl, u32 fs, u32 ft, u32 fd)
 {
-    Label l_noexception = c.newLabel();
     FlushPc();
     reg_alloc.ReserveArgs(3);
     fs ? c.mov(host_gpr_arg[0].r32(), fs) : c.xor_(host_gpr_arg[0].r32(), host_gpr_arg[0].r32());
@@ -48,15 +44,12 @@ void CallCop1InterpreterImpl(auto impl, u32 fs, u32 ft, u32 fd)
     fd ? c.mov(host_gpr_arg[2].r32(), fd) : c.xor_(host_gpr_arg[2].r32(), host_gpr_arg[2].r32());
     reg_alloc.Call(impl);
     reg_alloc.FreeArgs(3);
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_noexception);
-    BlockEpilog();
-    c.bind(l_noexception);
+    EmitExceptionCheck();
 }
 
 bool CheckCop1Usable()
 {
-    if (cop0.status.cu1) {
+    if (compile_context.cop1_usable) {
         c.and_(JitPtr(fcr31), 0xFFFC'0FFF); // clear all exceptions
         c.vstmxcsr(dword_ptr(x86::rsp, -8));
         c.and_(dword_ptr(x86::rsp, -8), ~0x3D);
@@ -79,7 +72,7 @@ template<bool cond, bool likely> void Cop1Branch(s16 imm)
     c.bind(l_branch);
     EmitBranchTaken(jit_pc + 4 + (imm << 2));
     c.bind(l_end);
-    last_instr_was_branch = true;
+    last_emitted_instr_was_branch = true;
 }
 
 Gpq GetGpr(u32 idx)
@@ -96,7 +89,7 @@ void OnCop1Unusable()
 {
     reg_alloc.DestroyVolatile(host_gpr_arg[0]);
     c.mov(host_gpr_arg[0].r32(), 1);
-    BlockEpilogWithPcFlushAndJmp((void*)CoprocessorUnusableException);
+    BlockEpilogWithException((void*)CoprocessorUnusableException);
     branched = true;
 }
 
@@ -105,7 +98,7 @@ void OnInvalidFormat()
     if (!CheckCop1Usable()) return;
     c.bts(JitPtr(fcr31), FCR31BitIndex::CauseUnimplemented);
     block_cycles++;
-    BlockEpilogWithPcFlushAndJmp((void*)FloatingPointException);
+    BlockEpilogWithException((void*)FloatingPointException);
     branched = true;
 }
 
@@ -131,7 +124,7 @@ void bc1tl(s16 imm)
 
 void cfc1(u32 fs, u32 rt)
 {
-    if (!cop0.status.cu1) return OnCop1Unusable();
+    if (!compile_context.cop1_usable) return OnCop1Unusable();
     Gpq ht = GetDirtyGpr(rt);
     if (fs == 31) c.movsxd(ht, JitPtr(fcr31));
     else if (fs == 0) c.mov(ht.r32(), 0xA00);
@@ -140,25 +133,19 @@ void cfc1(u32 fs, u32 rt)
 
 void ctc1(u32 fs, u32 rt)
 {
-    if (!cop0.status.cu1) return OnCop1Unusable();
+    if (!compile_context.cop1_usable) return OnCop1Unusable();
     if (fs != 31) return;
-    reg_alloc.ReserveArgs(1);
-    Label l_no_exception = c.newLabel();
     Gpd ht = GetGpr(rt).r32();
     c.mov(eax, ht);
     c.and_(eax, fcr31_write_mask);
     c.and_(JitPtr(fcr31), ~fcr31_write_mask);
     c.or_(JitPtr(fcr31), eax);
-    c.and_(eax, 3);
-    c.shl(eax, 2);
-    c.mov(host_gpr_arg[0].r32(), JitPtrOffset(guest_to_host_rounding_mode, rax, 4));
-    reg_alloc.Call((void*)fesetround);
-    reg_alloc.Call((void*)TestExceptions<false>);
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_no_exception);
-    BlockEpilog();
-    c.bind(l_no_exception);
-    reg_alloc.FreeArgs(1);
+    FlushPc();
+    reg_alloc.Call((void*)OnWriteToFcr31);
+    EmitExceptionCheck();
+    // The rest of the block was compiled for the previous exception enables; see GetModeContext
+    BlockEpilogWithPcFlush(4);
+    branched = true;
 }
 
 void dcfc1()
@@ -166,7 +153,7 @@ void dcfc1()
     if (!CheckCop1Usable()) return;
     c.bts(JitPtr(fcr31), FCR31BitIndex::CauseUnimplemented);
     block_cycles++;
-    BlockEpilogWithPcFlushAndJmp((void*)FloatingPointException);
+    BlockEpilogWithException((void*)FloatingPointException);
     branched = true;
 }
 
@@ -177,8 +164,8 @@ void dctc1()
 
 void dmfc1(u32 fs, u32 rt)
 {
-    if (!cop0.status.cu1) return OnCop1Unusable();
-    if (!cop0.status.fr) fs &= ~1;
+    if (!compile_context.cop1_usable) return OnCop1Unusable();
+    if (!compile_context.fr) fs &= ~1;
     Gpq hrt = GetDirtyGpr(rt);
     c.mov(hrt, JitPtrOffset(fpr, fs * 8, 8));
     block_cycles++;
@@ -186,8 +173,8 @@ void dmfc1(u32 fs, u32 rt)
 
 void dmtc1(u32 fs, u32 rt)
 {
-    if (!cop0.status.cu1) return OnCop1Unusable();
-    if (!cop0.status.fr) fs &= ~1;
+    if (!compile_context.cop1_usable) return OnCop1Unusable();
+    if (!compile_context.fr) fs &= ~1;
     Gpq hrt = GetGpr(rt);
     c.mov(JitPtrOffset(fpr, fs * 8, 8), hrt);
     block_cycles++;
@@ -195,20 +182,14 @@ void dmtc1(u32 fs, u32 rt)
 
 void ldc1(u32 base, u32 ft, s16 imm)
 {
-    if (!cop0.status.cu1) return OnCop1Unusable();
-    if (!cop0.status.fr) ft &= ~1;
+    if (!compile_context.cop1_usable) return OnCop1Unusable();
+    if (!compile_context.fr) ft &= ~1;
     FlushPc();
-    Label l_no_exception = c.newLabel();
     reg_alloc.ReserveArgs(1);
     Gpq hbase = GetGpr(base);
     c.lea(host_gpr_arg[0], ptr(hbase, imm));
     reg_alloc.Call((void*)ReadVirtual<s64>);
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_no_exception);
-
-    BlockEpilog();
-
-    c.bind(l_no_exception);
+    EmitExceptionCheck();
     c.mov(JitPtrOffset(fpr, ft * 8, 8), rax);
 
     block_cycles++;
@@ -217,20 +198,14 @@ void ldc1(u32 base, u32 ft, s16 imm)
 
 void lwc1(u32 base, u32 ft, s16 imm)
 {
-    if (!cop0.status.cu1) return OnCop1Unusable();
+    if (!compile_context.cop1_usable) return OnCop1Unusable();
     FlushPc();
-    Label l_no_exception = c.newLabel();
     reg_alloc.ReserveArgs(1);
     Gpq hbase = GetGpr(base);
     c.lea(host_gpr_arg[0], ptr(hbase, imm));
     reg_alloc.Call((void*)ReadVirtual<s32>);
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_no_exception);
-
-    BlockEpilog();
-
-    c.bind(l_no_exception);
-    if (cop0.status.fr || !(ft & 1)) {
+    EmitExceptionCheck();
+    if (compile_context.fr || !(ft & 1)) {
         c.mov(JitPtrOffset(fpr, ft * 8, 4), eax);
     } else {
         c.mov(JitPtrOffset(fpr, (ft & ~1) * 8 + 4, 4), eax);
@@ -244,7 +219,7 @@ void mfc1(u32 fs, u32 rt)
 {
     if (!CheckCop1Usable()) return;
     Gpq hrt = GetDirtyGpr(rt);
-    if (cop0.status.fr || !(fs & 1)) {
+    if (compile_context.fr || !(fs & 1)) {
         c.movsxd(hrt, JitPtrOffset(fpr, fs * 8, 4));
     } else {
         c.movsxd(hrt, JitPtrOffset(fpr, (fs & ~1) * 8 + 4, 4));
@@ -256,7 +231,7 @@ void mtc1(u32 fs, u32 rt)
 {
     if (!CheckCop1Usable()) return;
     Gpd hrt = GetGpr(rt).r32();
-    if (cop0.status.fr || !(fs & 1)) {
+    if (compile_context.fr || !(fs & 1)) {
         c.mov(JitPtrOffset(fpr, fs * 8, 4), hrt);
     } else {
         c.mov(JitPtrOffset(fpr, (fs & ~1) * 8 + 4, 4), hrt);
@@ -266,45 +241,33 @@ void mtc1(u32 fs, u32 rt)
 
 void sdc1(u32 base, u32 ft, s16 imm)
 {
-    if (!cop0.status.cu1) return OnCop1Unusable();
-    if (!cop0.status.fr) ft &= ~1;
+    if (!compile_context.cop1_usable) return OnCop1Unusable();
+    if (!compile_context.fr) ft &= ~1;
     FlushPc();
-    Label l_end = c.newLabel();
     reg_alloc.ReserveArgs(2);
     Gpq hbase = GetGpr(base);
     c.lea(host_gpr_arg[0], ptr(hbase, imm));
     c.mov(host_gpr_arg[1], JitPtrOffset(fpr, ft * 8, 8));
     reg_alloc.Call((void*)WriteVirtual<8>);
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_end);
-
-    BlockEpilog();
-
-    c.bind(l_end);
+    EmitExceptionCheck();
     block_cycles++;
     reg_alloc.FreeArgs(2);
 }
 
 void swc1(u32 base, u32 ft, s16 imm)
 {
-    if (!cop0.status.cu1) return OnCop1Unusable();
+    if (!compile_context.cop1_usable) return OnCop1Unusable();
     FlushPc();
-    Label l_end = c.newLabel();
     reg_alloc.ReserveArgs(2);
     Gpq hbase = GetGpr(base);
     c.lea(host_gpr_arg[0], ptr(hbase, imm));
-    if (cop0.status.fr || !(ft & 1)) {
+    if (compile_context.fr || !(ft & 1)) {
         c.movsxd(host_gpr_arg[1], JitPtrOffset(fpr, ft * 8, 4));
     } else {
         c.movsxd(host_gpr_arg[1], JitPtrOffset(fpr, (ft & ~1) * 8 + 4, 4));
     }
     reg_alloc.Call((void*)WriteVirtual<4>);
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_end);
-
-    BlockEpilog();
-
-    c.bind(l_end);
+    EmitExceptionCheck();
     block_cycles++;
     reg_alloc.FreeArgs(2);
 }
@@ -315,7 +278,7 @@ template<FpuFmt fmt> void compare(u32 fs, u32 ft, u8 cond)
         return OnInvalidFormat();
     }
     if (!CheckCop1Usable()) return;
-    if (!cop0.status.fr) fs &= ~1;
+    if (!compile_context.fr) fs &= ~1;
     reg_alloc.Reserve(rcx, rdx);
     Label l_no_nans = c.newLabel(), l_exception = c.newLabel(), l_end = c.newLabel();
 
@@ -333,19 +296,18 @@ template<FpuFmt fmt> void compare(u32 fs, u32 ft, u8 cond)
     c.vstmxcsr(dword_ptr(x86::rsp, -8));
     c.mov(eax, dword_ptr(x86::rsp, -8));
     c.and_(eax, 1); // invalid exception
-    c.mov(ecx, eax);
-    c.shl(ecx, FCR31BitIndex::CauseInvalid);
-    c.or_(JitPtr(fcr31), ecx);
-    c.bt(JitPtr(fcr31), FCR31BitIndex::EnableInvalid);
-    c.setc(cl);
-    c.mov(edx, ecx);
-    c.not_(edx);
-    c.and_(edx, 1);
-    c.shl(edx, FCR31BitIndex::FlagInvalid);
-    c.or_(JitPtr(fcr31), edx);
-    c.and_(eax, ecx);
-    c.and_(eax, 1);
-    c.jnz(l_exception);
+    c.shl(eax, FCR31BitIndex::CauseInvalid);
+    c.or_(JitPtr(fcr31), eax);
+    // Whether the invalid exception is enabled is known from the block's mode context; see GetModeContext
+    bool invalid_enabled =
+      compile_context.fpu_exception_enables >> (FCR31BitIndex::EnableInvalid - FCR31BitIndex::EnableInexact) & 1;
+    if (invalid_enabled) {
+        c.test(eax, eax);
+        c.jnz(l_exception);
+    } else {
+        c.shr(eax, FCR31BitIndex::CauseInvalid - FCR31BitIndex::FlagInvalid);
+        c.or_(JitPtr(fcr31), eax);
+    }
     if (cond & 1) {
         c.bts(JitPtr(fcr31), FCR31BitIndex::Condition);
     } else {
@@ -353,8 +315,10 @@ template<FpuFmt fmt> void compare(u32 fs, u32 ft, u8 cond)
     }
     c.jmp(l_end);
 
-    c.bind(l_exception);
-    BlockEpilogWithPcFlushAndJmp((void*)FloatingPointException);
+    if (invalid_enabled) {
+        c.bind(l_exception);
+        BlockEpilogWithException((void*)FloatingPointException);
+    }
 
     c.bind(l_no_nans);
     u8 cond12 = cond >> 1 & 3;
@@ -503,14 +467,14 @@ template<FpuFmt fmt> void div(u32 fs, u32 ft, u32 fd)
 template<FpuFmt fmt> void mov(u32 fs, u32 fd)
 {
     if constexpr (OneOf(fmt, FpuFmt::Float32, FpuFmt::Float64)) {
-        if (cop0.status.cu1) {
-            if (!cop0.status.fr) fs &= ~1;
+        if (compile_context.cop1_usable) {
+            if (!compile_context.fr) fs &= ~1;
             c.mov(rax, JitPtrOffset(fpr, 8 * fs, 8));
             c.mov(JitPtrOffset(fpr, 8 * fd, 8), rax);
         } else {
             reg_alloc.DestroyVolatile(host_gpr_arg[0]);
             c.mov(host_gpr_arg[0].r32(), 1);
-            BlockEpilogWithPcFlushAndJmp((void*)CoprocessorUnusableException);
+            BlockEpilogWithException((void*)CoprocessorUnusableException);
             branched = true;
         }
     } else {
@@ -558,7 +522,7 @@ template<ComputeInstr1Op instr, std::floating_point Float> void Compute(u32 fs,
 {
     using enum ComputeInstr1Op;
     if (!CheckCop1Usable()) return;
-    if (!cop0.status.fr) fs &= ~1;
+    if (!compile_context.fr) fs &= ~1;
     Label l_epilog = c.newLabel(), l_end = c.newLabel();
 
     FlushPc();
@@ -597,9 +561,7 @@ template<ComputeInstr1Op instr, std::floating_point Float> void Compute(u32 fs,
         }
     }
     c.vmovq(qword_ptr(x86::rsp), xmm0);
-    reg_alloc.Call((void*)GetAndTestExceptions);
-    c.test(al, al);
-    c.jnz(l_epilog);
+    EmitGetAndTestExceptions((void*)GetAndTestExceptions, l_epilog);
     c.mov(host_gpr_arg[0], x86::rsp);
     reg_alloc.Call((void*)IsValidOutput<Float>);
     c.test(al, al);
@@ -615,7 +577,7 @@ template<ComputeInstr1Op instr, std::floating_point Float> void Compute(u32 fs,
 
     c.bind(l_epilog);
     c.add(x86::rsp, 16);
-    BlockEpilog();
+    BlockEpilogToExceptionVector();
 
     c.bind(l_end);
 }
@@ -624,7 +586,7 @@ template<ComputeInstr2Op instr, std::floating_point Float> void Compute(u32 fs,
 {
     using enum ComputeInstr2Op;
     if (!CheckCop1Usable()) return;
-    if (!cop0.status.fr) fs &= ~1;
+    if (!compile_context.fr) fs &= ~1;
     Label l_epilog = c.newLabel(), l_end = c.newLabel();
 
     FlushPc();
@@ -680,9 +642,7 @@ template<ComputeInstr2Op instr, std::floating_point Float> void Compute(u32 fs,
         }
     }
     c.vmovq(qword_ptr(x86::rsp), xmm0);
-    reg_alloc.Call((void*)GetAndTestExceptions);
-    c.test(al, al);
-    c.jnz(l_epilog);
+    EmitGetAndTestExceptions((void*)GetAndTestExceptions, l_epilog);
     c.mov(host_gpr_arg[0], x86::rsp);
     reg_alloc.Call((void*)IsValidOutput<Float>);
     c.test(al, al);
@@ -698,15 +658,31 @@ template<ComputeInstr2Op instr, std::floating_point Float> void Compute(u32 fs,
 
     c.bind(l_epilog);
     c.add(x86::rsp, 16);
-    BlockEpilog();
+    BlockEpilogToExceptionVector();
 
     c.bind(l_end);
 }
+
+// Host exceptions are rare, so MXCSR is checked inline, and the interpreter function that converts them into guest
+// exceptions is only called if any were raised. Jumps to 'l_exception' if the guest takes an exception.
+void EmitGetAndTestExceptions(void* get_and_test_exceptions, Label l_exception)
+{
+    Label l_no_exceptions = c.newLabel();
+    reg_alloc.FlushAllVolatile(); // so that the register state is the same on both paths
+    c.vstmxcsr(dword_ptr(x86::rsp, -8));
+    c.test(dword_ptr(x86::rsp, -8), 0x3D); // all exception flags but denormal, as with FE_ALL_EXCEPT
+    c.jz(l_no_exceptions);
+    reg_alloc.Call(get_and_test_exceptions);
+    c.test(al, al);
+    c.jnz(l_exception);
+    c.bind(l_no_exceptions);
+}
+
 /*
  template<FpuNum From, FpuNum To> static void Convert(u32 fs, u32 fd)
 {
     if (!CheckCop1Usable()) return;
-    if (!cop0.status.fr) fs &= ~1;
+    if (!compile_context.fr) fs &= ~1;
     Label l_epilog = c.newLabel(), l_end = c.newLabel();
 
  FlushPc();
@@ -761,7 +737,7 @@ template<ComputeInstr2Op instr, std::floating_point Float> void Compute(u32 fs,
 
     c.bind(l_epilog);
     c.add(x86::rsp, 16);
-    BlockEpilog();
+    BlockEpilogToExceptionVector();
 
     c.bind(l_end);
     block_cycles += 4;
@@ -771,7 +747,7 @@ template<RoundInstr instr, FpuNum From, FpuNum To> void Round(u32 fs, u32 fd)
 {
     using enum RoundInstr;
     if (!CheckCop1Usable()) return;
-    if (!cop0.status.fr) fs &= ~1;
+    if (!compile_context.fr) fs &= ~1;
     Label l_epilog = c.newLabel(), l_end = c.newLabel();
 
     FlushPc();
@@ -796,14 +772,12 @@ template<RoundInstr instr, FpuNum From, FpuNum To> void Round(u32 fs, u32 fd)
     if constexpr (sizeof(To) == 4) {
         c.vcvttss2si(eax, xmm0);
         c.mov(dword_ptr(x86::rsp, 8), eax);
-        reg_alloc.Call((void*)GetAndTestExceptionsConvFloatToWord);
+        EmitGetAndTestExceptions((void*)GetAndTestExceptionsConvFloatToWord, l_epilog);
     } else {
         c.vcvttsd2si(rax, xmm0);
         c.mov(qword_ptr(x86::rsp, 8), rax);
-        reg_alloc.Call((void*)GetAndTestExceptions);
+        EmitGetAndTestExceptions((void*)GetAndTestExceptions, l_epilog);
     }
-    c.test(al, al);
-    c.jnz(l_epilog);
     c.mov(host_gpr_arg[0], x86::rsp);
     // TODO: this doesn't compile
     // reg_alloc.Call((void*)IsValidOutput<To>);
@@ -827,7 +801,7 @@ template<RoundInstr instr, FpuNum From, FpuNum To> void Round(u32 fs, u32 fd)
 
     c.bind(l_epilog);
     c.add(x86::rsp, 16);
-    BlockEpilog();
+    BlockEpilogToExceptionVector();
 
     c.bind(l_end);
     block_cycles += 4;
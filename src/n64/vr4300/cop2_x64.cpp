@@ -15,7 +15,7 @@ void Cop2Prolog()
     c.bt(JitPtr(cop0.status), 30); // cu2
     c.jc(l_noexception);
     c.mov(host_gpr_arg[0].r32(), 2);
-    BlockEpilogWithPcFlushAndJmp((void*)CoprocessorUnusableException);
+    BlockEpilogWithException((void*)CoprocessorUnusableException);
     c.bind(l_noexception);
 }
 
@@ -31,8 +31,8 @@ void cfc2(u32 rt)
 void cop2_reserved()
 {
     Cop2Prolog();
-    BlockEpilogWithPcFlushAndJmp((void*)ReservedInstructionCop2Exception);
-    // compiler_exception_occurred = true; // TODO
+    BlockEpilogWithException((void*)ReservedInstructionCop2Exception);
+    branched = true;
 }
 
 void ctc2(u32 rt)
@@ -45,7 +45,7 @@ void ctc2(u32 rt)
 void dcfc2()
 {
     Cop2Prolog();
-    BlockEpilogWithPcFlushAndJmp((void*)ReservedInstructionCop2Exception);
+    BlockEpilogWithException((void*)ReservedInstructionCop2Exception);
     branched = true;
 }
 
@@ -0,0 +1,110 @@
+#include "fastmem.hpp"
+#include "platform.hpp"
+#include "recompiler.hpp"
+
+#if PLATFORM_X64 && PLATFORM_LINUX
+#    include <csignal>
+#    include <ucontext.h>
+#elif PLATFORM_X64 && PLATFORM_WINDOWS
+#    include <Windows.h>
+#endif
+
+namespace n64::vr4300 {
+
+#if PLATFORM_X64 && PLATFORM_LINUX
+
+static struct sigaction prev_sigsegv_action;
+static bool handler_installed;
+
+static void OnSigsegv(int sig, siginfo_t* info, void* ucontext_raw)
+{
+    ucontext_t* ucontext = static_cast<ucontext_t*>(ucontext_raw);
+    u8 const* fault_pc = reinterpret_cast<u8 const*>(ucontext->uc_mcontext.gregs[REG_RIP]);
+    if (u8 const* resume_pc = OnFastmemFault(fault_pc)) {
+        ucontext->uc_mcontext.gregs[REG_RIP] = reinterpret_cast<greg_t>(resume_pc);
+        return;
+    }
+    if (prev_sigsegv_action.sa_flags & SA_SIGINFO) {
+        prev_sigsegv_action.sa_sigaction(sig, info, ucontext_raw);
+    } else if (prev_sigsegv_action.sa_handler != SIG_DFL && prev_sigsegv_action.sa_handler != SIG_IGN) {
+        prev_sigsegv_action.sa_handler(sig);
+    } else {
+        // Returning re-executes the faulting instruction, which now faults with the default action in place
+        sigaction(SIGSEGV, &prev_sigsegv_action, nullptr);
+    }
+}
+
+Status InstallFastmemFaultHandler()
+{
+    if (handler_installed) {
+        return OkStatus();
+    }
+    struct sigaction action {};
+    action.sa_sigaction = OnSigsegv;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGSEGV, &action, &prev_sigsegv_action) != 0) {
+        return FailureStatus("Failed to install SIGSEGV handler for fastmem");
+    }
+    handler_installed = true;
+    return OkStatus();
+}
+
+void UninstallFastmemFaultHandler()
+{
+    if (handler_installed) {
+        sigaction(SIGSEGV, &prev_sigsegv_action, nullptr);
+        handler_installed = false;
+    }
+}
+
+#elif PLATFORM_X64 && PLATFORM_WINDOWS
+
+static void* exception_handler;
+
+static LONG NTAPI OnAccessViolation(EXCEPTION_POINTERS* info)
+{
+    if (info->ExceptionRecord->ExceptionCode != EXCEPTION_ACCESS_VIOLATION) {
+        return EXCEPTION_CONTINUE_SEARCH;
+    }
+    u8 const* fault_pc = reinterpret_cast<u8 const*>(info->ContextRecord->Rip);
+    if (u8 const* resume_pc = OnFastmemFault(fault_pc)) {
+        info->ContextRecord->Rip = reinterpret_cast<DWORD64>(resume_pc);
+        return EXCEPTION_CONTINUE_EXECUTION;
+    }
+    return EXCEPTION_CONTINUE_SEARCH;
+}
+
+Status InstallFastmemFaultHandler()
+{
+    if (!exception_handler) {
+        exception_handler = AddVectoredExceptionHandler(1, OnAccessViolation);
+        if (!exception_handler) {
+            return FailureStatus("Failed to install fastmem exception handler; error {}", GetLastError());
+        }
+    }
+    return OkStatus();
+}
+
+void UninstallFastmemFaultHandler()
+{
+    if (exception_handler) {
+        RemoveVectoredExceptionHandler(exception_handler);
+        exception_handler = nullptr;
+    }
+}
+
+#else
+
+Status InstallFastmemFaultHandler()
+{
+    return UnimplementedStatus();
+}
+
+void UninstallFastmemFaultHandler()
+{
+}
+
+#endif
+
+} // namespace n64::vr4300
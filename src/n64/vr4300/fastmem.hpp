@@ -0,0 +1,12 @@
+#pragma once
+
+#include "status.hpp"
+
+namespace n64::vr4300 {
+
+// Installs a process-wide handler for access violations, which hands faults raised by fastmem accesses in compiled
+// code over to the recompiler (see OnFastmemFault). Any other fault is passed on to the previously installed handler.
+Status InstallFastmemFaultHandler();
+void UninstallFastmemFaultHandler();
+
+} // namespace n64::vr4300
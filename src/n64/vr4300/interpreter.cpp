@@ -7,6 +7,8 @@
 
 namespace n64::vr4300 {
 
+static void InterpretInstruction();
+
 void Cop3()
 {
     if (cop0.status.cu3) {
@@ -22,6 +24,40 @@ void DiscardBranch()
     branch_state = BranchState::NoBranch;
 }
 
+void InterpretInstruction()
+{
+    AdvancePipeline(1);
+    exception_occurred = false;
+    last_instr_was_branch = false;
+    u32 instr = FetchInstruction(pc);
+    if (exception_occurred) return;
+    decode_and_interpret_cpu(instr);
+    if (exception_occurred) return;
+    if (last_instr_was_branch) {
+        pc += 4;
+    } else {
+        if (branch_state == BranchState::DelaySlotTaken) {
+            PerformBranch();
+        } else {
+            branch_state = BranchState::NoBranch;
+            pc += 4;
+        }
+    }
+}
+
+/* Interprets instructions up to the next change of control flow (a taken branch once its delay slot has been
+   executed, or an exception), or up to the next 256-byte boundary. Used by the recompiler to run code whose block is
+   still being compiled. */
+void InterpretBlock()
+{
+    while (true) {
+        u64 prev_pc = pc;
+        InterpretInstruction();
+        if (exception_occurred) return;
+        if (branch_state == BranchState::NoBranch && (pc != prev_pc + 4 || !(pc & 255))) return;
+    }
+}
+
 void Link(u32 reg)
 {
     gpr.set(reg, pc + 8);
@@ -41,26 +77,11 @@ void ResetBranch()
 u32 RunInterpreter(u32 cpu_cycles)
 {
     cycle_counter = 0;
-    while (cycle_counter < cpu_cycles) {
-        AdvancePipeline(1);
-        exception_occurred = false;
-        last_instr_was_branch = false;
-        u32 instr = FetchInstruction(pc);
-        if (exception_occurred) continue;
-        decode_and_interpret_cpu(instr);
-        if (exception_occurred) continue;
-        if (last_instr_was_branch) {
-            pc += 4;
-        } else {
-            if (branch_state == BranchState::DelaySlotTaken) {
-                PerformBranch();
-            } else {
-                branch_state = BranchState::NoBranch;
-                pc += 4;
-            }
-        }
+    cycles_to_run = cpu_cycles;
+    while (cycle_counter < cycles_to_run) {
+        InterpretInstruction();
     }
-    return cycle_counter - cpu_cycles;
+    return cycle_counter - cycles_to_run;
 }
 
 void TakeBranch(u64 target_address)
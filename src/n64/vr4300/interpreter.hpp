@@ -10,6 +10,7 @@ namespace n64::vr4300 {
 
 void Cop3();
 void DiscardBranch();
+void InterpretBlock();
 void Link(u32 reg);
 void OnBranchNotTaken();
 void ResetBranch();
@@ -1,11 +1,14 @@
 #include "mips/types.hpp"
+#include "n64_build_options.hpp"
 #include "numtypes.hpp"
 #include "vr4300/cop0.hpp"
 #include "vr4300/exceptions.hpp"
+#include "vr4300/mmu.hpp"
 #include "vr4300/recompiler.hpp"
 #include "vr4300/vr4300.hpp"
 
 #include <concepts>
+#include <optional>
 #include <utility>
 
 namespace n64::vr4300::x64 {
@@ -15,9 +18,14 @@ using namespace asmjit::x86;
 
 template<mips::Cond cc, bool likely> static void branch(u32 rs, u32 rt, s16 imm);
 template<mips::Cond cc, bool likely> static void branch(u32 rs, s16 imm);
+template<std::integral Int, MemOp mem_op>
+static bool emit_fastmem_address(u32 rs, Gpq hs, s16 imm, Label l_slow, Label l_tlb);
+template<std::integral Int, MemOp mem_op> static void emit_fastmem_tlb_address(Gpq hs, s16 imm, Label l_slow);
 template<std::integral Int, bool linked> static void load(u32 rs, u32 rt, s16 imm);
+template<std::integral Int> static void load_fastmem(u32 rs, u32 rt, s16 imm);
 template<std::integral Int> static void store(u32 rs, u32 rt, s16 imm);
 template<std::integral Int> static void store_conditional(u32 rs, u32 rt, s16 imm);
+template<std::integral Int> static void store_fastmem(u32 rs, u32 rt, s16 imm);
 template<mips::Cond cc> static void trap(u32 rs, s16 imm);
 template<mips::Cond cc> static void trap(u32 rs, u32 rt);
 
@@ -33,13 +41,10 @@ static Gpq GetDirtyGpr(u32 gpr)
 
 void add(u32 rs, u32 rt, u32 rd)
 {
-    Label l_noexception = c.newLabel();
     Gpq hs = GetGpr(rs), ht = GetGpr(rt);
     c.mov(eax, hs.r32());
     c.add(eax, ht.r32());
-    c.jno(l_noexception);
-    BlockEpilogWithPcFlushAndJmp((void*)IntegerOverflowException);
-    c.bind(l_noexception);
+    c.jo(ColdBlockEpilogWithException((void*)IntegerOverflowException));
     if (rd) {
         Gpq hd = GetDirtyGpr(rd);
         c.movsxd(hd, eax);
@@ -48,13 +53,10 @@ void add(u32 rs, u32 rt, u32 rd)
 
 void addi(u32 rs, u32 rt, s16 imm)
 {
-    Label l_noexception = c.newLabel();
     Gpq hs = GetGpr(rs);
     c.mov(eax, hs.r32());
     c.add(eax, imm);
-    c.jno(l_noexception);
-    BlockEpilogWithPcFlushAndJmp((void*)IntegerOverflowException);
-    c.bind(l_noexception);
+    c.jo(ColdBlockEpilogWithException((void*)IntegerOverflowException));
     if (rt) {
         Gpq ht = GetDirtyGpr(rt);
         c.movsxd(ht, eax);
@@ -144,7 +146,7 @@ void bgezal(u32 rs, s16 imm)
 
     c.bind(l_end);
 
-    last_instr_was_branch = true;
+    last_emitted_instr_was_branch = true;
 }
 
 void bgezall(u32 rs, s16 imm)
@@ -212,20 +214,17 @@ void bnel(u32 rs, u32 rt, s16 imm)
 
 void break_()
 {
-    BlockEpilogWithPcFlushAndJmp((void*)BreakpointException);
+    BlockEpilogWithException((void*)BreakpointException);
     branched = true;
 }
 
 void dadd(u32 rs, u32 rt, u32 rd)
 {
     if (!CheckDwordOpCondJit()) return;
-    Label l_noexception = c.newLabel();
     Gpq hs = GetGpr(rs), ht = GetGpr(rt);
     c.mov(rax, hs);
     c.add(rax, ht);
-    c.jno(l_noexception);
-    BlockEpilogWithPcFlushAndJmp((void*)IntegerOverflowException);
-    c.bind(l_noexception);
+    c.jo(ColdBlockEpilogWithException((void*)IntegerOverflowException));
     if (rd) {
         Gpq hd = GetDirtyGpr(rd);
         c.mov(hd, rax);
@@ -235,13 +234,10 @@ void dadd(u32 rs, u32 rt, u32 rd)
 void daddi(u32 rs, u32 rt, s16 imm)
 {
     if (!CheckDwordOpCondJit()) return;
-    Label l_noexception = c.newLabel();
     Gpq hs = GetGpr(rs);
     c.mov(rax, hs);
     c.add(rax, imm);
-    c.jno(l_noexception);
-    BlockEpilogWithPcFlushAndJmp((void*)IntegerOverflowException);
-    c.bind(l_noexception);
+    c.jo(ColdBlockEpilogWithException((void*)IntegerOverflowException));
     if (rt) {
         Gpq ht = GetDirtyGpr(rt);
         c.mov(ht, rax);
@@ -523,13 +519,10 @@ void dsrlv(u32 rs, u32 rt, u32 rd)
 void dsub(u32 rs, u32 rt, u32 rd)
 {
     if (!CheckDwordOpCondJit()) return;
-    Label l_noexception = c.newLabel();
     Gpq hs = GetGpr(rs), ht = GetGpr(rt);
     c.mov(rax, hs);
     c.sub(rax, ht);
-    c.jno(l_noexception);
-    BlockEpilogWithPcFlushAndJmp((void*)IntegerOverflowException);
-    c.bind(l_noexception);
+    c.jo(ColdBlockEpilogWithException((void*)IntegerOverflowException));
     if (rd) {
         Gpq hd = GetDirtyGpr(rd);
         c.mov(hd, rax);
@@ -558,7 +551,7 @@ void j(u32 instr)
     EmitBranchTaken((jit_pc + 4) & 0xFFFF'FFFF'F000'0000 | instr << 2 & 0xFFF'FFFF);
 
     c.bind(l_end);
-    last_instr_was_branch = true;
+    last_emitted_instr_was_branch = true;
 }
 
 void jal(u32 instr)
@@ -576,7 +569,7 @@ void jal(u32 instr)
     EmitBranchTaken((jit_pc + 4) & 0xFFFF'FFFF'F000'0000 | instr << 2 & 0xFFF'FFFF);
 
     c.bind(l_end);
-    last_instr_was_branch = true;
+    last_emitted_instr_was_branch = true;
 }
 
 void jalr(u32 rs, u32 rd)
@@ -600,7 +593,7 @@ void jalr(u32 rs, u32 rd)
     }
 
     c.bind(l_end);
-    last_instr_was_branch = true;
+    last_emitted_instr_was_branch = true;
 }
 
 void jr(u32 rs)
@@ -612,7 +605,7 @@ void jr(u32 rs)
     EmitBranchTaken(hs);
 
     c.bind(l_end);
-    last_instr_was_branch = true;
+    last_emitted_instr_was_branch = true;
 }
 
 void lb(u32 rs, u32 rt, s16 imm)
@@ -636,7 +629,6 @@ void ldl(u32 rs, u32 rt, s16 imm)
 {
     if (!CheckDwordOpCondJit()) return;
 
-    Label l_noexception = c.newLabel();
     FlushPc();
     reg_alloc.ReserveArgs(1);
     Gpq hs = GetGpr(rs);
@@ -645,12 +637,7 @@ void ldl(u32 rs, u32 rt, s16 imm)
     reg_alloc.CallWithStackAlignment((void*)ReadVirtual<s64, Alignment::UnalignedLeft>);
     reg_alloc.FreeArgs(1);
     c.pop(rcx);
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_noexception);
-
-    BlockEpilog();
-
-    c.bind(l_noexception);
+    EmitExceptionCheck();
     if (rt) {
         reg_alloc.Reserve(rcx, rdx);
         Gpq ht = GetDirtyGpr(rt);
@@ -670,7 +657,6 @@ void ldr(u32 rs, u32 rt, s16 imm)
 {
     if (!CheckDwordOpCondJit()) return;
 
-    Label l_noexception = c.newLabel();
     FlushPc();
     reg_alloc.ReserveArgs(1);
     Gpq hs = GetGpr(rs);
@@ -679,12 +665,7 @@ void ldr(u32 rs, u32 rt, s16 imm)
     reg_alloc.CallWithStackAlignment((void*)ReadVirtual<s64, Alignment::UnalignedRight>);
     reg_alloc.FreeArgs(1);
     c.pop(rcx);
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_noexception);
-
-    BlockEpilog();
-
-    c.bind(l_noexception);
+    EmitExceptionCheck();
     if (rt) {
         reg_alloc.Reserve(rcx, rdx);
         Gpq ht = GetDirtyGpr(rt);
@@ -736,7 +717,6 @@ void lw(u32 rs, u32 rt, s16 imm)
 
 void lwl(u32 rs, u32 rt, s16 imm)
 {
-    Label l_noexception = c.newLabel();
 
     FlushPc();
     reg_alloc.ReserveArgs(1);
@@ -745,12 +725,7 @@ void lwl(u32 rs, u32 rt, s16 imm)
     c.push(host_gpr_arg[0]);
     reg_alloc.CallWithStackAlignment((void*)ReadVirtual<s32, Alignment::UnalignedLeft>);
     reg_alloc.FreeArgs(1);
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_noexception);
-
-    BlockEpilog();
-
-    c.bind(l_noexception);
+    EmitExceptionCheck();
     if (rt) {
         reg_alloc.Reserve(rcx, rdx);
         Gpq ht = GetDirtyGpr(rt);
@@ -769,7 +744,6 @@ void lwl(u32 rs, u32 rt, s16 imm)
 
 void lwr(u32 rs, u32 rt, s16 imm)
 {
-    Label l_noexception = c.newLabel();
 
     FlushPc();
     reg_alloc.ReserveArgs(1);
@@ -778,12 +752,7 @@ void lwr(u32 rs, u32 rt, s16 imm)
     c.push(host_gpr_arg[0]);
     reg_alloc.CallWithStackAlignment((void*)ReadVirtual<s32, Alignment::UnalignedRight>);
     reg_alloc.FreeArgs(1);
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_noexception);
-
-    BlockEpilog();
-
-    c.bind(l_noexception);
+    EmitExceptionCheck();
     if (rt) {
         reg_alloc.Reserve(rcx, rdx);
         Gpq ht = GetDirtyGpr(rt);
@@ -916,7 +885,6 @@ void sd(u32 rs, u32 rt, s16 imm)
 void sdl(u32 rs, u32 rt, s16 imm)
 {
     if (!CheckDwordOpCondJit()) return;
-    Label l_end = c.newLabel();
     FlushPc();
     reg_alloc.ReserveArgs(2);
     Gpq hs = GetGpr(rs), ht = GetGpr(rt);
@@ -925,18 +893,12 @@ void sdl(u32 rs, u32 rt, s16 imm)
     c.sarx(host_gpr_arg[1], ht, rax);
     reg_alloc.Call((void*)WriteVirtual<8, Alignment::UnalignedLeft>);
     reg_alloc.FreeArgs(2);
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_end);
-
-    BlockEpilog();
-
-    c.bind(l_end);
+    EmitExceptionCheck();
 }
 
 void sdr(u32 rs, u32 rt, s16 imm)
 {
     if (!CheckDwordOpCondJit()) return;
-    Label l_end = c.newLabel();
     FlushPc();
     reg_alloc.ReserveArgs(2);
     Gpq hs = GetGpr(rs), ht = GetGpr(rt);
@@ -946,12 +908,7 @@ void sdr(u32 rs, u32 rt, s16 imm)
     c.shlx(host_gpr_arg[1], ht, rax);
     reg_alloc.Call((void*)WriteVirtual<8, Alignment::UnalignedRight>);
     reg_alloc.FreeArgs(2);
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_end);
-
-    BlockEpilog();
-
-    c.bind(l_end);
+    EmitExceptionCheck();
 }
 
 void sh(u32 rs, u32 rt, s16 imm)
@@ -1058,13 +1015,10 @@ void srlv(u32 rs, u32 rt, u32 rd)
 
 void sub(u32 rs, u32 rt, u32 rd)
 {
-    Label l_noexception = c.newLabel();
     Gpq hs = GetGpr(rs), ht = GetGpr(rt);
     c.mov(eax, hs.r32());
     c.sub(eax, ht.r32());
-    c.jno(l_noexception);
-    BlockEpilogWithPcFlushAndJmp((void*)IntegerOverflowException);
-    c.bind(l_noexception);
+    c.jo(ColdBlockEpilogWithException((void*)IntegerOverflowException));
     if (rd) {
         Gpq hd = GetDirtyGpr(rd);
         c.movsxd(hd, eax);
@@ -1087,7 +1041,7 @@ void subu(u32 rs, u32 rt, u32 rd)
 
 void syscall()
 {
-    BlockEpilogWithPcFlushAndJmp((void*)SyscallException);
+    BlockEpilogWithException((void*)SyscallException);
     branched = true;
 }
 
@@ -1104,7 +1058,6 @@ void sw(u32 rs, u32 rt, s16 imm)
 
 void swl(u32 rs, u32 rt, s16 imm)
 {
-    Label l_end = c.newLabel();
     FlushPc();
     reg_alloc.ReserveArgs(2);
     Gpq hs = GetGpr(rs), ht = GetGpr(rt);
@@ -1114,17 +1067,11 @@ void swl(u32 rs, u32 rt, s16 imm)
     c.shrx(host_gpr_arg[1], ht, rax);
     reg_alloc.Call((void*)WriteVirtual<4, Alignment::UnalignedLeft>);
     reg_alloc.FreeArgs(2);
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_end);
-
-    BlockEpilog();
-
-    c.bind(l_end);
+    EmitExceptionCheck();
 }
 
 void swr(u32 rs, u32 rt, s16 imm)
 {
-    Label l_end = c.newLabel();
     FlushPc();
     reg_alloc.ReserveArgs(2);
     Gpq hs = GetGpr(rs), ht = GetGpr(rt);
@@ -1134,12 +1081,7 @@ void swr(u32 rs, u32 rt, s16 imm)
     c.shlx(host_gpr_arg[1], ht, rax);
     reg_alloc.Call((void*)WriteVirtual<4, Alignment::UnalignedRight>);
     reg_alloc.FreeArgs(2);
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_end);
-
-    BlockEpilog();
-
-    c.bind(l_end);
+    EmitExceptionCheck();
 }
 
 void teq(u32 rs, u32 rt)
@@ -1238,7 +1180,7 @@ template<mips::Cond cc, bool likely> void branch(u32 rs, u32 rt, s16 imm)
     c.bind(l_branch);
     EmitBranchTaken(jit_pc + 4 + (imm << 2));
     c.bind(l_end);
-    last_instr_was_branch = true;
+    last_emitted_instr_was_branch = true;
 }
 
 template<mips::Cond cc, bool likely> void branch(u32 rs, s16 imm)
@@ -1255,12 +1197,104 @@ template<mips::Cond cc, bool likely> void branch(u32 rs, s16 imm)
     c.bind(l_branch);
     EmitBranchTaken(jit_pc + 4 + (imm << 2));
     c.bind(l_end);
-    last_instr_was_branch = true;
+    last_emitted_instr_was_branch = true;
+}
+
+// Leaves the host address of an aligned RDRAM access through kseg0/kseg1 in rax, with the RDRAM byte order applied.
+// Aligned accesses through other segments branch to 'l_tlb', misaligned ones to 'l_slow', as do stores to pages
+// holding compiled code. An access outside of RDRAM faults once performed (see rdram.cpp). Only rax is written to; the
+// slow path can still recompute the address from 'hs'. If the IR knows the value of 'rs', the checks are done at
+// compile time instead. Returns false if they were, and the access was found to be through kseg0/kseg1. kseg0/kseg1
+// are only accessible in kernel mode; in the other modes, all aligned accesses branch to 'l_tlb', from where the slow
+// path raises the address error.
+template<std::integral Int, MemOp mem_op> bool emit_fastmem_address(u32 rs, Gpq hs, s16 imm, Label l_slow, Label l_tlb)
+{
+    bool kernel_mode = compile_context.operating_mode == OperatingMode::Kernel;
+    if (std::optional<s64> base = GetConstantGpr(rs); base && kernel_mode) {
+        u64 vaddr = u64(*base) + u64(s64(imm));
+        if (!(vaddr & (sizeof(Int) - 1)) && s64(vaddr) >> 30 == -2) {
+            u32 offset = u32(vaddr) & 0x1FFF'FFFF;
+            if constexpr (mem_op == MemOp::Write) {
+                u32 page = offset / code_page_size;
+                c.bt(JitPtrOffset(code_page_bitmap, s32(page / 32 * 4), 4), page & 31);
+                c.jc(l_slow);
+            }
+            if constexpr (sizeof(Int) == 1) offset ^= 3;
+            if constexpr (sizeof(Int) == 2) offset ^= 2;
+            c.mov(eax, offset);
+            c.add(rax, JitPtr(&fastmem_base));
+            return false;
+        }
+    }
+    c.lea(rax, ptr(hs, imm));
+    if constexpr (sizeof(Int) > 1) {
+        c.test(al, sizeof(Int) - 1);
+        c.jnz(l_slow);
+    }
+    if (!kernel_mode) {
+        c.jmp(l_tlb);
+        return true;
+    }
+    c.sar(rax, 30);
+    c.cmp(rax, -2);
+    c.jne(l_tlb);
+    c.lea(eax, ptr(hs, imm));
+    c.and_(eax, 0x1FFF'FFFF);
+    if constexpr (mem_op == MemOp::Write) {
+        c.shr(eax, 12);
+        c.bt(JitPtr(code_page_bitmap, 4), eax);
+        c.jc(l_slow);
+        c.lea(eax, ptr(hs, imm));
+        c.and_(eax, 0x1FFF'FFFF);
+    }
+    // RDRAM is stored in LE, word-wise
+    if constexpr (sizeof(Int) == 1) c.xor_(eax, 3);
+    if constexpr (sizeof(Int) == 2) c.xor_(eax, 2);
+    c.add(rax, JitPtr(&fastmem_base));
+    return true;
+}
+
+// Like emit_fastmem_address, for an aligned access through a TLB-mapped segment: looks the page up in fastmem_tlb
+// (see mmu.hpp), and branches to 'l_slow' if it holds no translation that permits the access. Stores to pages holding
+// compiled code take the slow path as well. Only rax is written to.
+template<std::integral Int, MemOp mem_op> void emit_fastmem_tlb_address(Gpq hs, s16 imm, Label l_slow)
+{
+    static constexpr u32 permission = mem_op == MemOp::Write ? fastmem_tlb_writable : fastmem_tlb_readable;
+    auto emit_load_entry = [hs, imm] {
+        c.lea(eax, ptr(hs, imm));
+        c.shr(eax, 12);
+        c.mov(eax, ptr(guest_gpr_mid_ptr_reg, rax, 2, s32(get_offset_to_guest_gpr_base_ptr(fastmem_tlb.data())), 4));
+    };
+    // Only sign-extended 32-bit addresses are held
+    c.lea(rax, ptr(hs, imm));
+    c.sar(rax, 31);
+    c.inc(rax);
+    c.cmp(rax, 1);
+    c.ja(l_slow);
+    emit_load_entry();
+    c.test(al, permission);
+    c.jz(l_slow);
+    c.and_(eax, ~0xFFF);
+    c.lea(eax, ptr(rax, hs, 0, imm)); // physical address
+    if constexpr (mem_op == MemOp::Write) {
+        // The page number leaves no room for the physical address, which is looked up again
+        c.shr(eax, 12);
+        c.bt(JitPtr(code_page_bitmap, 4), eax);
+        c.jc(l_slow);
+        emit_load_entry();
+        c.and_(eax, ~0xFFF);
+        c.lea(eax, ptr(rax, hs, 0, imm));
+    }
+    if constexpr (sizeof(Int) == 1) c.xor_(eax, 3);
+    if constexpr (sizeof(Int) == 2) c.xor_(eax, 2);
+    c.add(rax, JitPtr(&fastmem_base));
 }
 
 template<std::integral Int, bool linked> void load(u32 rs, u32 rt, s16 imm)
 {
-    Label l_noexception = c.newLabel();
+    if constexpr (enable_cpu_fastmem && !linked) {
+        return load_fastmem<Int>(rs, rt, imm);
+    }
 
     FlushPc();
     reg_alloc.ReserveArgs(1);
@@ -1276,12 +1310,7 @@ template<std::integral Int, bool linked> void load(u32 rs, u32 rt, s16 imm)
         c.mov(JitPtr(cop0.ll_addr), ecx);
     }
 
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_noexception);
-
-    BlockEpilog();
-
-    c.bind(l_noexception);
+    EmitExceptionCheck();
     if (rt) {
         Gpq ht = GetDirtyGpr(rt);
         if constexpr (std::same_as<Int, s8>) c.movsx(ht, al);
@@ -1294,9 +1323,70 @@ template<std::integral Int, bool linked> void load(u32 rs, u32 rt, s16 imm)
     }
 }
 
+// The slow path is placed out of line. It is entered either from the checks in emit_fastmem_address, or, once the
+// access has faulted, through the jmp that the nop at the patch site is replaced with.
+template<std::integral Int> void load_fastmem(u32 rs, u32 rt, s16 imm)
+{
+    static constexpr u8 nop5[] = { 0x0F, 0x1F, 0x44, 0x00, 0x00 };
+    Label l_patch_site = c.newLabel(), l_access = c.newLabel(), l_slow = c.newLabel(), l_resume = c.newLabel();
+    Label l_tlb = c.newLabel();
+    Gpq hs = GetGpr(rs);
+    Gpq ht = rt ? GetDirtyGpr(rt) : rax;
+    c.bind(l_patch_site);
+    c.embed(nop5, sizeof(nop5));
+    bool needs_tlb_path = emit_fastmem_address<Int, MemOp::Read>(rs, hs, imm, l_slow, l_tlb);
+    c.bind(l_access);
+    if constexpr (std::same_as<Int, s8>) c.movsx(ht, byte_ptr(rax));
+    if constexpr (std::same_as<Int, u8>) c.movzx(ht.r32(), byte_ptr(rax));
+    if constexpr (std::same_as<Int, s16>) c.movsx(ht, word_ptr(rax));
+    if constexpr (std::same_as<Int, u16>) c.movzx(ht.r32(), word_ptr(rax));
+    if constexpr (std::same_as<Int, s32>) c.movsxd(ht, dword_ptr(rax));
+    if constexpr (std::same_as<Int, u32>) c.mov(ht.r32(), dword_ptr(rax));
+    if constexpr (sizeof(Int) == 8) {
+        c.mov(ht, qword_ptr(rax));
+        c.rol(ht, 32);
+    }
+    c.bind(l_resume);
+
+    Section* hot_section = ColdCodeBegin();
+    Label l_exception = c.newLabel();
+    if (needs_tlb_path) {
+        c.bind(l_tlb);
+        emit_fastmem_tlb_address<Int, MemOp::Read>(hs, imm, l_slow);
+        c.jmp(l_access);
+    }
+    c.bind(l_slow);
+    FlushPc();
+    c.lea(rax, ptr(hs, imm));
+    reg_alloc.SaveVolatiles();
+    c.mov(host_gpr_arg[0], rax);
+    reg_alloc.CallWithoutFlush((void*)ReadVirtual<std::make_signed_t<Int>>);
+    reg_alloc.RestoreVolatiles();
+    c.cmp(JitPtr(exception_occurred), 0);
+    c.jne(l_exception);
+    if (rt) {
+        if constexpr (std::same_as<Int, s8>) c.movsx(ht, al);
+        if constexpr (std::same_as<Int, u8>) c.movzx(ht.r32(), al);
+        if constexpr (std::same_as<Int, s16>) c.movsx(ht, ax);
+        if constexpr (std::same_as<Int, u16>) c.movzx(ht.r32(), ax);
+        if constexpr (std::same_as<Int, s32>) c.movsxd(ht, eax);
+        if constexpr (std::same_as<Int, u32>) c.mov(ht.r32(), eax);
+        if constexpr (sizeof(Int) == 8) c.mov(ht, rax);
+    }
+    c.jmp(l_resume);
+    c.bind(l_exception);
+    BlockEpilogToExceptionVector();
+    ColdCodeEnd(hot_section);
+
+    AddFastmemSite(l_patch_site, l_access, l_slow);
+}
+
 template<std::integral Int> void store(u32 rs, u32 rt, s16 imm)
 {
-    Label l_end = c.newLabel();
+    if constexpr (enable_cpu_fastmem) {
+        return store_fastmem<Int>(rs, rt, imm);
+    }
+
     FlushPc();
     reg_alloc.ReserveArgs(2);
     Gpq hs = reg_alloc.GetGpr(rs), ht = reg_alloc.GetGpr(rt);
@@ -1304,12 +1394,7 @@ template<std::integral Int> void store(u32 rs, u32 rt, s16 imm)
     c.mov(host_gpr_arg[1], ht);
     reg_alloc.Call((void*)WriteVirtual<sizeof(Int)>);
     reg_alloc.FreeArgs(2);
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_end);
-
-    BlockEpilog();
-
-    c.bind(l_end);
+    EmitExceptionCheck();
 }
 
 template<std::integral Int> void store_conditional(u32 rs, u32 rt, s16 imm)
@@ -1336,14 +1421,56 @@ template<std::integral Int> void store_conditional(u32 rs, u32 rt, s16 imm)
         Gpq ht = GetDirtyGpr(rt);
         c.mov(ht.r32(), 1);
     }
-    c.cmp(JitPtr(exception_occurred), 0);
-    c.je(l_end);
-
-    BlockEpilog();
+    EmitExceptionCheck();
 
     c.bind(l_end);
 }
 
+// See load_fastmem. Stores to pages holding compiled code take the slow path, which invalidates the code.
+template<std::integral Int> void store_fastmem(u32 rs, u32 rt, s16 imm)
+{
+    static constexpr u8 nop5[] = { 0x0F, 0x1F, 0x44, 0x00, 0x00 };
+    Label l_patch_site = c.newLabel(), l_access = c.newLabel(), l_slow = c.newLabel(), l_resume = c.newLabel();
+    Label l_tlb = c.newLabel();
+    Gpq hs = GetGpr(rs), ht = GetGpr(rt);
+    c.bind(l_patch_site);
+    c.embed(nop5, sizeof(nop5));
+    bool needs_tlb_path = emit_fastmem_address<Int, MemOp::Write>(rs, hs, imm, l_slow, l_tlb);
+    c.bind(l_access);
+    if constexpr (sizeof(Int) == 1) c.mov(byte_ptr(rax), ht.r8());
+    if constexpr (sizeof(Int) == 2) c.mov(word_ptr(rax), ht.r16());
+    if constexpr (sizeof(Int) == 4) c.mov(dword_ptr(rax), ht.r32());
+    if constexpr (sizeof(Int) == 8) {
+        // The low word is stored first, so that a fault happens before 'ht' is modified
+        c.mov(dword_ptr(rax, 4), ht.r32());
+        c.rol(ht, 32);
+        c.mov(dword_ptr(rax), ht.r32());
+        c.rol(ht, 32);
+    }
+    c.bind(l_resume);
+
+    Section* hot_section = ColdCodeBegin();
+    if (needs_tlb_path) {
+        c.bind(l_tlb);
+        emit_fastmem_tlb_address<Int, MemOp::Write>(hs, imm, l_slow);
+        c.jmp(l_access);
+    }
+    c.bind(l_slow);
+    FlushPc();
+    c.lea(rax, ptr(hs, imm));
+    reg_alloc.SaveVolatiles();
+    c.mov(host_gpr_arg[1], ht);
+    c.mov(host_gpr_arg[0], rax);
+    reg_alloc.CallWithoutFlush((void*)WriteVirtual<sizeof(Int)>);
+    reg_alloc.RestoreVolatiles();
+    c.cmp(JitPtr(exception_occurred), 0);
+    c.je(l_resume);
+    BlockEpilogToExceptionVector();
+    ColdCodeEnd(hot_section);
+
+    AddFastmemSite(l_patch_site, l_access, l_slow);
+}
+
 template<mips::Cond cc> void trap(u32 rs, s16 imm)
 {
     Label l_notrap = c.newLabel();
@@ -1355,7 +1482,7 @@ template<mips::Cond cc> void trap(u32 rs, s16 imm)
     if constexpr (cc == mips::Cond::Lt) c.jge(l_notrap);
     if constexpr (cc == mips::Cond::Ltu) c.jae(l_notrap);
     if constexpr (cc == mips::Cond::Ne) c.je(l_notrap);
-    BlockEpilogWithPcFlushAndJmp((void*)TrapException);
+    BlockEpilogWithException((void*)TrapException);
     c.bind(l_notrap);
     branched = true;
 }
@@ -1371,7 +1498,7 @@ template<mips::Cond cc> void trap(u32 rs, u32 rt)
     if constexpr (cc == mips::Cond::Lt) c.jge(l_notrap);
     if constexpr (cc == mips::Cond::Ltu) c.jae(l_notrap);
     if constexpr (cc == mips::Cond::Ne) c.je(l_notrap);
-    BlockEpilogWithPcFlushAndJmp((void*)TrapException);
+    BlockEpilogWithException((void*)TrapException);
     c.bind(l_notrap);
     branched = true;
 }
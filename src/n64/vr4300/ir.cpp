@@ -0,0 +1,522 @@
+#include "ir.hpp"
+#include "mips/disassembler.hpp"
+#include "mips/gpr_liveness.hpp"
+
+#include <algorithm>
+#include <format>
+#include <utility>
+
+namespace n64::vr4300 {
+
+struct AluResult {
+    std::optional<s64> value;
+    bool sign_extended;
+    u32 copy_of;
+};
+
+static AluResult EvaluateAlu(IrInstr const& instr, std::span<IrValue const> values);
+static std::optional<u64> GetStaticBranchTarget(IrInstr const& instr);
+static bool IsLikelyBranch(u32 word);
+
+void IrBlock::Append(u32 word)
+{
+    u32 index = u32(instrs_.size());
+    u8 rs = word >> 21 & 31, rt = word >> 16 & 31, rd = word >> 11 & 31;
+    IrInstr instr = {
+        .vaddr = vaddr_ + 4 * index,
+        .word = word,
+        .op = IrOp::Opaque,
+        .dword = false,
+        .may_exit = false,
+        .dead = false,
+        .dst = IrInstr::none,
+        .src = { IrInstr::none, IrInstr::none },
+        .copy_of = IrInstr::none,
+    };
+    std::optional<u8> src0, src1, dst;
+    auto set = [&](IrOp op, std::optional<u8> s0, std::optional<u8> s1, std::optional<u8> d, bool dword = false) {
+        instr.op = op;
+        instr.dword = dword;
+        src0 = s0, src1 = s1, dst = d;
+    };
+
+    switch (word >> 26) {
+    case 0x00: // SPECIAL
+        switch (word & 63) {
+        case 0x00: /* SLL */
+        case 0x02: /* SRL */
+        case 0x03: /* SRA */ set(IrOp::Alu, rt, {}, rd); break;
+        case 0x04: /* SLLV */
+        case 0x06: /* SRLV */
+        case 0x07: /* SRAV */ set(IrOp::Alu, rt, rs, rd); break;
+        case 0x08: /* JR */ set(IrOp::Branch, rs, {}, {}); break;
+        case 0x09: /* JALR */ set(IrOp::Branch, rs, {}, rd); break;
+        case 0x0C: /* SYSCALL */
+        case 0x0D: /* BREAK */ set(IrOp::Trap, {}, {}, {}); break;
+        case 0x0F: /* SYNC */ set(IrOp::Alu, {}, {}, {}); break;
+        case 0x10: /* MFHI */
+        case 0x12: /* MFLO */ set(IrOp::Alu, {}, {}, rd); break;
+        case 0x11: /* MTHI */
+        case 0x13: /* MTLO */ set(IrOp::Alu, rs, {}, {}); break;
+        case 0x14: /* DSLLV */
+        case 0x16: /* DSRLV */
+        case 0x17: /* DSRAV */ set(IrOp::Alu, rt, rs, rd, true); break;
+        case 0x18: /* MULT */
+        case 0x19: /* MULTU */
+        case 0x1A: /* DIV */
+        case 0x1B: /* DIVU */ set(IrOp::Alu, rs, rt, {}); break;
+        case 0x1C: /* DMULT */
+        case 0x1D: /* DMULTU */
+        case 0x1E: /* DDIV */
+        case 0x1F: /* DDIVU */ set(IrOp::Alu, rs, rt, {}, true); break;
+        case 0x20: /* ADD */
+        case 0x21: /* ADDU */
+        case 0x22: /* SUB */
+        case 0x23: /* SUBU */
+        case 0x24: /* AND */
+        case 0x25: /* OR */
+        case 0x26: /* XOR */
+        case 0x27: /* NOR */
+        case 0x2A: /* SLT */
+        case 0x2B: /* SLTU */ set(IrOp::Alu, rs, rt, rd); break;
+        case 0x2C: /* DADD */
+        case 0x2D: /* DADDU */
+        case 0x2E: /* DSUB */
+        case 0x2F: /* DSUBU */ set(IrOp::Alu, rs, rt, rd, true); break;
+        case 0x30: /* TGE */
+        case 0x31: /* TGEU */
+        case 0x32: /* TLT */
+        case 0x33: /* TLTU */
+        case 0x34: /* TEQ */
+        case 0x36: /* TNE */ set(IrOp::Trap, rs, rt, {}); break;
+        case 0x38: /* DSLL */
+        case 0x3A: /* DSRL */
+        case 0x3B: /* DSRA */
+        case 0x3C: /* DSLL32 */
+        case 0x3E: /* DSRL32 */
+        case 0x3F: /* DSRA32 */ set(IrOp::Alu, rt, {}, rd, true); break;
+        }
+        break;
+    case 0x01: // REGIMM
+        if (rt <= 0x03) set(IrOp::Branch, rs, {}, {}); // BLTZ, BGEZ, BLTZL, BGEZL
+        else if (rt >= 0x08 && rt <= 0x0E && rt != 0x0D) set(IrOp::Trap, rs, {}, {});
+        else if (rt >= 0x10 && rt <= 0x13) set(IrOp::Branch, rs, {}, 31); // BLTZAL, BGEZAL, BLTZALL, BGEZALL
+        break;
+    case 0x02: /* J */ set(IrOp::Branch, {}, {}, {}); break;
+    case 0x03: /* JAL */ set(IrOp::Branch, {}, {}, 31); break;
+    case 0x04: /* BEQ */
+    case 0x05: /* BNE */
+    case 0x14: /* BEQL */
+    case 0x15: /* BNEL */ set(IrOp::Branch, rs, rt, {}); break;
+    case 0x06: /* BLEZ */
+    case 0x07: /* BGTZ */
+    case 0x16: /* BLEZL */
+    case 0x17: /* BGTZL */ set(IrOp::Branch, rs, {}, {}); break;
+    case 0x08: /* ADDI */
+    case 0x09: /* ADDIU */
+    case 0x0A: /* SLTI */
+    case 0x0B: /* SLTIU */
+    case 0x0C: /* ANDI */
+    case 0x0D: /* ORI */
+    case 0x0E: /* XORI */ set(IrOp::Alu, rs, {}, rt); break;
+    case 0x0F: /* LUI */ set(IrOp::Alu, {}, {}, rt); break;
+    case 0x18: /* DADDI */
+    case 0x19: /* DADDIU */ set(IrOp::Alu, rs, {}, rt, true); break;
+    case 0x1A: /* LDL */
+    case 0x1B: /* LDR */ set(IrOp::Load, rs, rt, rt, true); break;
+    case 0x20: /* LB */
+    case 0x21: /* LH */
+    case 0x23: /* LW */
+    case 0x24: /* LBU */
+    case 0x25: /* LHU */
+    case 0x27: /* LWU */ set(IrOp::Load, rs, {}, rt); break;
+    case 0x22: /* LWL */
+    case 0x26: /* LWR */ set(IrOp::Load, rs, rt, rt); break;
+    case 0x28: /* SB */
+    case 0x29: /* SH */
+    case 0x2A: /* SWL */
+    case 0x2B: /* SW */
+    case 0x2E: /* SWR */ set(IrOp::Store, rs, rt, {}); break;
+    case 0x2C: /* SDL */
+    case 0x2D: /* SDR */
+    case 0x3F: /* SD */ set(IrOp::Store, rs, rt, {}, true); break;
+    case 0x37: /* LD */ set(IrOp::Load, rs, {}, rt, true); break;
+    }
+
+    // Only the arithmetic that can overflow, and branches likely (whose delay slot is skipped by leaving the block),
+    // may leave the block among the Alu and Branch instructions.
+    auto overflow_checked = [word] {
+        u32 op = word >> 26, funct = word & 63;
+        return op == 0x08 || op == 0x18
+            || (op == 0 && (funct == 0x20 || funct == 0x22 || funct == 0x2C || funct == 0x2E));
+    };
+    switch (instr.op) {
+    case IrOp::Alu: instr.may_exit = instr.dword || overflow_checked(); break;
+    case IrOp::Branch: instr.may_exit = IsLikelyBranch(word); break;
+    default: instr.may_exit = true; break;
+    }
+
+    if (instr.op == IrOp::Opaque) {
+        for (u8 gpr = 1; gpr < 32; ++gpr) {
+            Use(gpr);
+        }
+        for (u8 gpr = 1; gpr < 32; ++gpr) {
+            Define(gpr, index);
+        }
+    } else {
+        if (src0) instr.src[0] = Use(*src0);
+        if (src1) instr.src[1] = Use(*src1);
+        if (dst) instr.dst = Define(*dst, index);
+    }
+    instrs_.push_back(instr);
+}
+
+// The branch state can be kept out of memory if the branch is known to start with the state being NoBranch (it is
+// not the first instruction, which can be the delay slot of the previous block), and its delay slot is in the block
+// and cannot leave it (e.g. through an exception, which would need the state to set Cause.BD).
+bool IrBlock::CanFoldBranchState(u32 branch_index) const
+{
+    return branch_index > 0 && branch_index + 1 < instrs_.size() && instrs_[branch_index].op == IrOp::Branch
+        && instrs_[0].op != IrOp::Branch && instrs_[branch_index + 1].op == IrOp::Alu
+        && !instrs_[branch_index + 1].may_exit;
+}
+
+u32 IrBlock::Define(u8 gpr, u32 def)
+{
+    if (gpr == 0) {
+        return IrInstr::none;
+    }
+    u32 value = u32(values_.size());
+    values_.push_back({ .def = def, .gpr = gpr, .sign_extended = false, .num_uses = 0, .constant = {} });
+    current_[gpr] = value;
+    return value;
+}
+
+std::string IrBlock::Dump() const
+{
+    static constexpr std::array op_names = { "alu", "branch", "load", "store", "trap", "opaque" };
+    auto value_str = [this](u32 value) {
+        return std::format("v{}({})", value, mips::GprIdxToName(values_[value].gpr));
+    };
+    std::string str = std::format("IR of block ${:016X}\n", vaddr_);
+    for (IrInstr const& instr : instrs_) {
+        str += std::format("${:016X}  {:08X}  {:<6}", instr.vaddr, instr.word, op_names[std::to_underlying(instr.op)]);
+        if (instr.dst != IrInstr::none) {
+            str += std::format(" {} <-", value_str(instr.dst));
+        }
+        for (u32 src : instr.src) {
+            if (src != IrInstr::none) {
+                str += " " + value_str(src);
+            }
+        }
+        if (instr.dst != IrInstr::none) {
+            IrValue const& dst = values_[instr.dst];
+            if (dst.constant) str += std::format("  const=${:X}", u64(*dst.constant));
+            if (dst.sign_extended) str += "  sext";
+            if (instr.copy_of != IrInstr::none) str += std::format("  copy={}", value_str(instr.copy_of));
+        }
+        if (instr.dead) str += "  dead";
+        if (instr.may_exit) str += "  may-exit";
+        str += '\n';
+    }
+    return str;
+}
+
+// Removes writes to GPRs that are overwritten before being read, with no way for the block to be left in between.
+// The block can be left after its first instruction, if it is the delay slot of the previous block's branch, and after
+// the delay slot of each of its own branches.
+// Results that are materialized as constants or copies do not count as reads of the sources they are computed from.
+void IrBlock::EliminateDeadWrites()
+{
+    auto materialized = [this](IrInstr const& instr) {
+        return instr.op == IrOp::Alu && !instr.may_exit && instr.dst != IrInstr::none
+            && (values_[instr.dst].constant || instr.copy_of != IrInstr::none);
+    };
+    auto release_sources = [this](IrInstr const& instr, u32 except) {
+        for (u32 src : instr.src) {
+            if (src != IrInstr::none && src != except) {
+                --values_[src].num_uses;
+            }
+        }
+    };
+    for (IrInstr const& instr : instrs_) {
+        if (materialized(instr)) {
+            release_sources(instr, values_[instr.dst].constant ? IrInstr::none : instr.copy_of);
+        }
+    }
+    for (u32 i = u32(instrs_.size()); i-- > 1;) {
+        IrInstr& instr = instrs_[i];
+        if (instr.op != IrOp::Alu || instr.may_exit || instr.dst == IrInstr::none || values_[instr.dst].num_uses
+            || instrs_[i - 1].op == IrOp::Branch) {
+            continue;
+        }
+        u8 gpr = values_[instr.dst].gpr;
+        for (u32 j = i + 1; j < instrs_.size() && !instrs_[j].may_exit; ++j) {
+            if (instrs_[j].dst != IrInstr::none && values_[instrs_[j].dst].gpr == gpr) {
+                instr.dead = true;
+                break;
+            }
+            if (instrs_[j - 1].op == IrOp::Branch) {
+                break;
+            }
+        }
+        if (instr.dead) {
+            if (!materialized(instr)) {
+                release_sources(instr, IrInstr::none);
+            } else if (!values_[instr.dst].constant) {
+                --values_[instr.copy_of].num_uses;
+            }
+        }
+    }
+}
+
+// Blocks go on past the delay slot of a conditional branch (see EmitSideExit), unless the delay slot holds another
+// branch. The recompiler stops at the same places, so that the IR never reaches further than the emitted code.
+bool IrBlock::EndsBlock(u32 index, bool can_execute_dword_instrs) const
+{
+    IrInstr const& instr = instrs_[index];
+    if (index > 0 && instrs_[index - 1].op == IrOp::Branch
+        && (instr.op == IrOp::Branch
+            || mips::GetBranchKind(instrs_[index - 1].word, mips::Isa::Vr4300) != mips::BranchKind::Conditional)) {
+        return true;
+    }
+    return instr.op == IrOp::Trap || instr.op == IrOp::Opaque || (instr.dword && !can_execute_dword_instrs);
+}
+
+// See EmitLoopBackEdge. The delay slot of the branch must be in the block, as the branch is otherwise only performed
+// in the next block.
+bool IrBlock::IsLoop() const
+{
+    for (u32 i = 0; i + 1 < instrs_.size(); ++i) {
+        if (instrs_[i].op == IrOp::Branch && GetStaticBranchTarget(instrs_[i]) == vaddr_) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// See BlockEpilogWithIdleLoopSkip. The loop may consist only of loads, ALU ops and compares, and must branch back to
+// its own start with the first branch of the block. No GPR may be written that is read before being written within
+// the loop, so that every iteration computes the same values as the one before.
+bool IrBlock::IsIdleLoop(u32 max_instrs) const
+{
+    auto branch_it = std::ranges::find(instrs_, IrOp::Branch, &IrInstr::op);
+    if (branch_it == instrs_.end() || branch_it + 1 == instrs_.end()) {
+        return false;
+    }
+    u32 branch_index = u32(branch_it - instrs_.begin());
+    std::span<IrInstr const> loop = std::span(instrs_).first(branch_index + 2);
+    if (loop.size() > max_instrs) {
+        return false;
+    }
+    u32 gprs_written = 0;
+    for (u32 i = 0; i < loop.size(); ++i) {
+        IrInstr const& instr = loop[i];
+        if (i == branch_index) {
+            if (instr.op != IrOp::Branch || instr.dst != IrInstr::none || GetStaticBranchTarget(instr) != vaddr_) {
+                return false;
+            }
+        } else if (instr.op != IrOp::Alu && instr.op != IrOp::Load) {
+            return false;
+        }
+        u32 funct = instr.word & 63;
+        if (instr.op == IrOp::Alu && instr.word >> 26 == 0 && (funct == 0x11 || funct == 0x13 || funct >= 0x18)
+            && funct <= 0x1F) {
+            return false; // writes to hi/lo
+        }
+        if (instr.dst != IrInstr::none) {
+            gprs_written |= 1u << values_[instr.dst].gpr;
+        }
+    }
+    for (IrInstr const& instr : loop) {
+        for (u32 src : instr.src) {
+            if (src != IrInstr::none && values_[src].def == IrValue::entry && (gprs_written >> values_[src].gpr & 1)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void IrBlock::Optimize()
+{
+    PropagateConstants();
+    EliminateDeadWrites();
+}
+
+// Also tracks which values are known to be sign-extended from 32 bits, so that 32-bit moves (e.g. 'sll rd, rt, 0')
+// of such values become plain copies.
+void IrBlock::PropagateConstants()
+{
+    for (IrInstr& instr : instrs_) {
+        if (instr.dst == IrInstr::none) {
+            continue;
+        }
+        IrValue& dst = values_[instr.dst];
+        switch (instr.op) {
+        case IrOp::Alu: {
+            AluResult result = EvaluateAlu(instr, values_);
+            dst.constant = result.value;
+            dst.sign_extended = result.sign_extended;
+            instr.copy_of = result.copy_of;
+            if (instr.copy_of != IrInstr::none) {
+                dst.constant = values_[instr.copy_of].constant;
+                dst.sign_extended = values_[instr.copy_of].sign_extended;
+            }
+            break;
+        }
+        case IrOp::Branch: dst.constant = s64(instr.vaddr + 8); break;
+        case IrOp::Load: {
+            u32 op = instr.word >> 26;
+            dst.sign_extended = op == 0x20 || op == 0x21 || op == 0x23 || op == 0x24 || op == 0x25; // LB..LHU, not LWU
+            break;
+        }
+        default: break;
+        }
+        if (dst.constant && *dst.constant == s32(*dst.constant)) {
+            dst.sign_extended = true;
+        }
+    }
+}
+
+void IrBlock::Reset(u64 vaddr)
+{
+    vaddr_ = vaddr;
+    instrs_.clear();
+    values_.clear();
+    for (u8 gpr = 0; gpr < 32; ++gpr) {
+        values_.push_back(
+          { .def = IrValue::entry, .gpr = gpr, .sign_extended = gpr == 0, .num_uses = 0, .constant = {} });
+        current_[gpr] = gpr;
+    }
+    values_[0].constant = 0;
+}
+
+u32 IrBlock::Use(u8 gpr)
+{
+    u32 value = current_[gpr];
+    ++values_[value].num_uses;
+    return value;
+}
+
+AluResult EvaluateAlu(IrInstr const& instr, std::span<IrValue const> values)
+{
+    constexpr u32 none = IrInstr::none;
+    u32 word = instr.word, sa = word >> 6 & 31;
+    s16 imm = s16(word);
+    u16 uimm = u16(word);
+    IrValue const* src0 = instr.src[0] != none ? &values[instr.src[0]] : nullptr;
+    IrValue const* src1 = instr.src[1] != none ? &values[instr.src[1]] : nullptr;
+    std::optional<s64> a = src0 ? src0->constant : std::nullopt;
+    std::optional<s64> b = src1 ? src1->constant : std::nullopt;
+    bool a_sext = src0 && src0->sign_extended, b_sext = src1 && src1->sign_extended;
+    bool a_zero = a == 0, b_zero = b == 0;
+
+    auto fold = [&](auto f) -> std::optional<s64> {
+        if (a && (!src1 || b)) return f(a.value_or(0), b.value_or(0));
+        return {};
+    };
+    auto checked_add32 = [](s64 x, s64 y) -> std::optional<s64> {
+        s64 sum = s64(s32(x)) + s64(s32(y));
+        return sum == s32(sum) ? std::optional<s64>(sum) : std::nullopt;
+    };
+    auto copy_if = [](bool cond, u32 value) { return cond ? value : none; };
+
+    if (word >> 26 == 0) {
+        u32 shift_copy = copy_if(sa == 0 && a_sext, instr.src[0]);
+        switch (word & 63) {
+        case 0x00: /* SLL */ return { fold([&](s64 x, s64) { return s64(s32(u32(x) << sa)); }), true, shift_copy };
+        case 0x02: /* SRL */ return { fold([&](s64 x, s64) { return s64(s32(u32(x) >> sa)); }), true, shift_copy };
+        case 0x03: /* SRA */ return { fold([&](s64 x, s64) { return s64(s32(x >> sa)); }), true, shift_copy };
+        case 0x04: /* SLLV */ return { fold([](s64 x, s64 y) { return s64(s32(u32(x) << (y & 31))); }), true, none };
+        case 0x06: /* SRLV */ return { fold([](s64 x, s64 y) { return s64(s32(u32(x) >> (y & 31))); }), true, none };
+        case 0x07: /* SRAV */ return { fold([](s64 x, s64 y) { return s64(s32(x >> (y & 31))); }), true, none };
+        case 0x14: /* DSLLV */ return { fold([](s64 x, s64 y) { return s64(u64(x) << (y & 63)); }), false, none };
+        case 0x16: /* DSRLV */ return { fold([](s64 x, s64 y) { return s64(u64(x) >> (y & 63)); }), false, none };
+        case 0x17: /* DSRAV */ return { fold([](s64 x, s64 y) { return x >> (y & 63); }), false, none };
+        case 0x20: /* ADD */ return { a && b ? checked_add32(*a, *b) : std::nullopt, true, none };
+        case 0x21: /* ADDU */
+            return { fold([](s64 x, s64 y) { return s64(s32(u64(x) + u64(y))); }),
+                true,
+                b_zero && a_sext ? instr.src[0] : copy_if(a_zero && b_sext, instr.src[1]) };
+        case 0x22: /* SUB */ return { a && b ? checked_add32(*a, -s64(s32(*b))) : std::nullopt, true, none };
+        case 0x23: /* SUBU */
+            return { fold([](s64 x, s64 y) { return s64(s32(u64(x) - u64(y))); }),
+                true,
+                copy_if(b_zero && a_sext, instr.src[0]) };
+        case 0x24: /* AND */
+            if (a_zero || b_zero) return { 0, true, none };
+            return { fold([](s64 x, s64 y) { return x & y; }), a_sext && b_sext, none };
+        case 0x25: /* OR */
+            return { fold([](s64 x, s64 y) { return x | y; }),
+                a_sext && b_sext,
+                b_zero ? instr.src[0] : copy_if(a_zero, instr.src[1]) };
+        case 0x26: /* XOR */
+            if (instr.src[0] == instr.src[1]) return { 0, true, none };
+            return { fold([](s64 x, s64 y) { return x ^ y; }),
+                a_sext && b_sext,
+                b_zero ? instr.src[0] : copy_if(a_zero, instr.src[1]) };
+        case 0x27: /* NOR */ return { fold([](s64 x, s64 y) { return ~(x | y); }), a_sext && b_sext, none };
+        case 0x2A: /* SLT */ return { fold([](s64 x, s64 y) { return s64(x < y); }), true, none };
+        case 0x2B: /* SLTU */ return { fold([](s64 x, s64 y) { return s64(u64(x) < u64(y)); }), true, none };
+        case 0x2D: /* DADDU */
+            return { fold([](s64 x, s64 y) { return s64(u64(x) + u64(y)); }),
+                false,
+                b_zero ? instr.src[0] : copy_if(a_zero, instr.src[1]) };
+        case 0x2F: /* DSUBU */
+            return { fold([](s64 x, s64 y) { return s64(u64(x) - u64(y)); }), false, copy_if(b_zero, instr.src[0]) };
+        case 0x38: /* DSLL */
+            return { fold([&](s64 x, s64) { return s64(u64(x) << sa); }), false, copy_if(sa == 0, instr.src[0]) };
+        case 0x3A: /* DSRL */
+            return { fold([&](s64 x, s64) { return s64(u64(x) >> sa); }), false, copy_if(sa == 0, instr.src[0]) };
+        case 0x3B: /* DSRA */
+            return { fold([&](s64 x, s64) { return x >> sa; }), false, copy_if(sa == 0, instr.src[0]) };
+        case 0x3C: /* DSLL32 */ return { fold([&](s64 x, s64) { return s64(u64(x) << (sa + 32)); }), false, none };
+        case 0x3E: /* DSRL32 */ return { fold([&](s64 x, s64) { return s64(u64(x) >> (sa + 32)); }), sa > 0, none };
+        case 0x3F: /* DSRA32 */ return { fold([&](s64 x, s64) { return x >> (sa + 32); }), true, none };
+        default: return { {}, false, none }; // MFHI, MFLO
+        }
+    }
+    switch (word >> 26) {
+    case 0x08: /* ADDI */ return { a ? checked_add32(*a, imm) : std::nullopt, true, none };
+    case 0x09: /* ADDIU */
+        return { fold([&](s64 x, s64) { return s64(s32(u64(x) + u64(s64(imm)))); }),
+            true,
+            copy_if(imm == 0 && a_sext, instr.src[0]) };
+    case 0x0A: /* SLTI */ return { fold([&](s64 x, s64) { return s64(x < imm); }), true, none };
+    case 0x0B: /* SLTIU */ return { fold([&](s64 x, s64) { return s64(u64(x) < u64(s64(imm))); }), true, none };
+    case 0x0C: /* ANDI */
+        if (uimm == 0) return { 0, true, none };
+        return { fold([&](s64 x, s64) { return x & uimm; }), true, none };
+    case 0x0D: /* ORI */
+        return { fold([&](s64 x, s64) { return x | uimm; }), a_sext, copy_if(uimm == 0, instr.src[0]) };
+    case 0x0E: /* XORI */
+        return { fold([&](s64 x, s64) { return x ^ uimm; }), a_sext, copy_if(uimm == 0, instr.src[0]) };
+    case 0x0F: /* LUI */ return { s64(s32(u32(uimm) << 16)), true, none };
+    case 0x19: /* DADDIU */
+        return { fold([&](s64 x, s64) { return s64(u64(x) + u64(s64(imm))); }),
+            false,
+            copy_if(imm == 0, instr.src[0]) };
+    default: return { {}, false, none }; // DADDI
+    }
+}
+
+std::optional<u64> GetStaticBranchTarget(IrInstr const& instr)
+{
+    u32 op = instr.word >> 26;
+    if (op == 0x02 || op == 0x03) {
+        return (instr.vaddr + 4 & ~0x0FFF'FFFF_u64) | (instr.word & 0x03FF'FFFF) << 2;
+    }
+    if (op == 0x01 || (op >= 0x04 && op <= 0x07) || (op >= 0x14 && op <= 0x17)) {
+        return instr.vaddr + 4 + (s64(s16(instr.word)) << 2);
+    }
+    return {}; // JR, JALR
+}
+
+bool IsLikelyBranch(u32 word)
+{
+    u32 op = word >> 26;
+    return (op >= 0x14 && op <= 0x17) || (op == 0x01 && (word >> 16 & 2));
+}
+
+} // namespace n64::vr4300
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "numtypes.hpp"
+
+#include <array>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace n64::vr4300 {
+
+enum class IrOp : u8 {
+    Alu, /* 'dst' is a function of the sources only */
+    Branch, /* may also link, in which case 'dst' is the return address */
+    Load,
+    Store,
+    Trap, /* trap instructions, break and syscall */
+    Opaque /* not modelled (e.g. coprocessor instructions); reads and writes every GPR */
+};
+
+struct IrValue {
+    static constexpr u32 entry = ~0u; /* 'def' of the values that the GPRs hold when the block is entered */
+
+    u32 def; /* index of the defining instruction */
+    u8 gpr;
+    bool sign_extended; /* bits 63-32 are copies of bit 31 */
+    u16 num_uses; /* uses by instructions that still read the value once emitted */
+    std::optional<s64> constant;
+};
+
+struct IrInstr {
+    static constexpr u32 none = ~0u;
+
+    u64 vaddr;
+    u32 word;
+    IrOp op;
+    bool dword; /* a 64-bit operation, which raises an exception outside of 64-bit mode */
+    bool may_exit; /* may leave the block before writing 'dst', e.g. by raising an exception */
+    bool dead; /* 'dst' is overwritten before it can be observed; the instruction need not be emitted */
+    u32 dst; /* value defined, or 'none' */
+    std::array<u32, 2> src; /* values used, or 'none' */
+    u32 copy_of; /* source value that 'dst' is a plain copy of (no operation or sign extension needed), or 'none' */
+};
+
+/* An SSA form of the integer side of a block, built from its guest instructions before they are emitted. Each write
+   to a GPR defines a new value, and each read refers to the value reaching it. The passes run by Optimize annotate
+   the instructions, so that the emitters can e.g. materialize known constants instead of computing them. */
+class IrBlock {
+    std::vector<IrInstr> instrs_;
+    std::vector<IrValue> values_;
+    std::array<u32, 32> current_; /* value of each GPR at the end of the instructions appended so far */
+    u64 vaddr_{};
+
+    u32 Define(u8 gpr, u32 def);
+    u32 Use(u8 gpr);
+    void EliminateDeadWrites();
+    void PropagateConstants();
+
+public:
+    void Append(u32 word);
+    bool CanFoldBranchState(u32 branch_index) const;
+    std::string Dump() const;
+    bool EndsBlock(u32 index, bool can_execute_dword_instrs) const;
+    std::span<IrInstr const> Instrs() const { return instrs_; }
+    bool IsIdleLoop(u32 max_instrs) const;
+    bool IsLoop() const; /* the block holds a branch back to its own start */
+    void Optimize();
+    void Reset(u64 vaddr);
+    IrValue const& Value(u32 value) const { return values_[value]; }
+};
+
+} // namespace n64::vr4300
@@ -4,8 +4,9 @@
 #include "exceptions.hpp"
 #include "log.hpp"
 #include "memory/memory.hpp"
+#include "memory/rdram.hpp"
 #include "n64_build_options.hpp"
-
+#include "recompiler.hpp"
 #include "vr4300.hpp"
 
 #include <array>
@@ -13,6 +14,7 @@
 #include <cassert>
 #include <limits>
 #include <type_traits>
+#include <vector>
 
 namespace n64::vr4300 {
 
@@ -30,7 +32,25 @@ struct TlbEntry {
     bool global;
 };
 
+/* Caches the outcome of TLB lookups at a granularity of 4 KiB pages, so that mapped accesses do not need to scan all
+   TLB entries. Tagged with the full virtual page number (including the region bits), and with the ASID the lookup was
+   made under, unless the TLB entry matched is global. Changes of the ASID in EntryHi thus need no invalidation. */
+struct TlbCacheEntry {
+    u64 vpage;
+    u32 ppage_addr;
+    u8 asid;
+    bool global;
+    bool valid; /* EntryLo.V; accesses raise a TLB invalid exception if clear */
+    bool dirty; /* EntryLo.D; writes raise a TLB modification exception if clear */
+};
+
+constexpr size_t tlb_cache_size = 0x1000;
+constexpr u64 invalid_tlb_cache_vpage = ~0_u64; /* virtual page numbers are at most 52 bits */
+
 static std::array<TlbEntry, 32> tlb_entries;
+static std::array<TlbCacheEntry, tlb_cache_size> tlb_cache;
+static std::vector<u32> fastmem_tlb_filled_pages; /* so that fastmem_tlb can be flushed without touching all of it */
+static u8 fastmem_tlb_asid;
 
 template<MemOp> static u32 VirtualToPhysicalAddressUserMode32(u64 vaddr, bool& cacheable_area);
 template<MemOp> static u32 VirtualToPhysicalAddressUserMode64(u64 vaddr, bool& cacheable_area);
@@ -39,6 +59,17 @@ template<MemOp> static u32 VirtualToPhysicalAddressSupervisorMode64(u64 vaddr, b
 template<MemOp> static u32 VirtualToPhysicalAddressKernelMode32(u64 vaddr, bool& cacheable_area);
 template<MemOp> static u32 VirtualToPhysicalAddressKernelMode64(u64 vaddr, bool& cacheable_area);
 template<MemOp> static u32 VirtualToPhysicalAddressTlb(u64 vaddr);
+static void FillFastmemTlb(u64 vaddr, u32 ppage_addr, bool writable);
+static void FlushFastmemTlb();
+static void FlushTlbCache();
+static void InvalidateTlbCache(TlbEntry const& entry);
+
+// With fastmem, compiled code accesses RDRAM directly. All data accesses then bypass the dcache model, so that the
+// fast and the slow paths see the same memory.
+bool DataAccessesBypassDCache()
+{
+    return enable_cpu_fastmem && cpu_impl == CpuImpl::Recompiler;
+}
 
 void TlbEntry::Read() const
 {
@@ -47,10 +78,13 @@ void TlbEntry::Read() const
     cop0.entry_lo[0].g = cop0.entry_lo[1].g = global;
     cop0.entry_hi = entry_hi;
     cop0.page_mask = page_mask;
+    OnWriteToEntryHi();
 }
 
 void TlbEntry::Write()
 {
+    InvalidateTlbCache(*this); /* translations of the entry being replaced */
+    FlushFastmemTlb();
     // Each pair of bits in PageMask should be either 00 or 11
     page_mask = cop0.page_mask & 0xAAA << 13;
     page_mask |= page_mask >> 1;
@@ -64,6 +98,7 @@ void TlbEntry::Write()
     vpn2_addr_mask = 0xFF'FFFF'E000 & ~u64(page_mask);
     vpn2_compare = std::bit_cast<u64>(entry_hi) & vpn2_addr_mask;
     offset_addr_mask = page_mask >> 1 | 0xFFF;
+    InvalidateTlbCache(*this); /* translations shadowed by the new entry */
 }
 
 u32 Devirtualize(u64 vaddr)
@@ -77,6 +112,37 @@ u32 FetchInstruction(u64 vaddr)
     return ReadVirtual<s32, Alignment::Aligned, MemOp::InstrFetch>(vaddr);
 }
 
+/* Only pages that are mapped into RDRAM, and that compiled code can address without sign extension, are held. */
+void FillFastmemTlb(u64 vaddr, u32 ppage_addr, bool writable)
+{
+    if constexpr (!enable_cpu_fastmem) return;
+    if (u64(s32(vaddr)) != vaddr || ppage_addr >= rdram::GetSize()) return;
+    if (fastmem_tlb_filled_pages.empty()) {
+        fastmem_tlb_asid = u8(cop0.entry_hi.asid);
+    }
+    u32 vpage = u32(vaddr) >> 12;
+    if (!fastmem_tlb[vpage]) {
+        fastmem_tlb_filled_pages.push_back(vpage);
+    }
+    fastmem_tlb[vpage] =
+      ppage_addr - (u32(vaddr) & ~0xFFF) | fastmem_tlb_readable | (writable ? fastmem_tlb_writable : 0);
+}
+
+void FlushFastmemTlb()
+{
+    for (u32 vpage : fastmem_tlb_filled_pages) {
+        fastmem_tlb[vpage] = 0;
+    }
+    fastmem_tlb_filled_pages.clear();
+}
+
+void FlushTlbCache()
+{
+    for (TlbCacheEntry& entry : tlb_cache) {
+        entry.vpage = invalid_tlb_cache_vpage;
+    }
+}
+
 void InitializeMMU()
 {
     for (TlbEntry& entry : tlb_entries) {
@@ -85,6 +151,30 @@ void InitializeMMU()
         entry.global = 1;
         /* TODO: vpn2_addr_mask, vpn2_compare, offset_addr_mask? */
     }
+    FlushTlbCache();
+    FlushFastmemTlb();
+}
+
+/* Invalidates the cached translations of all pages that 'entry' maps. Entries mapping more pages than the cache holds
+   (including ones never written to, whose masks are all zero) flush it whole. */
+void InvalidateTlbCache(TlbEntry const& entry)
+{
+    u64 num_pages = ((~entry.vpn2_addr_mask & 0xFF'FFFF'FFFF) + 1) >> 12;
+    if (num_pages >= tlb_cache_size) {
+        FlushTlbCache();
+    } else {
+        u64 first_vpage = entry.vpn2_compare >> 12;
+        for (u64 i = 0; i < num_pages; ++i) {
+            tlb_cache[(first_vpage + i) & (tlb_cache_size - 1)].vpage = invalid_tlb_cache_vpage;
+        }
+    }
+}
+
+void OnWriteToEntryHi()
+{
+    if (!fastmem_tlb_filled_pages.empty() && cop0.entry_hi.asid != fastmem_tlb_asid) {
+        FlushFastmemTlb();
+    }
 }
 
 template<std::signed_integral Int, Alignment alignment, MemOp mem_op> Int ReadVirtual(u64 vaddr)
@@ -118,7 +208,8 @@ template<std::signed_integral Int, Alignment alignment, MemOp mem_op> Int ReadVi
     }
     last_paddr_on_load = paddr;
     auto ret = [=] {
-        if (cacheable_area) { /* TODO: figure out some way to avoid this branch, if possible */
+        if (cacheable_area && (mem_op == MemOp::InstrFetch || !DataAccessesBypassDCache())) {
+            /* TODO: figure out some way to avoid this branch, if possible */
             /* cycle counter incremented in the function, depending on if cache hit/miss */
             return ReadCacheableArea<Int, mem_op>(paddr);
         } else {
@@ -133,6 +224,7 @@ template<std::signed_integral Int, Alignment alignment, MemOp mem_op> Int ReadVi
 
 void SetVaddrToPaddrFuncs()
 {
+    VaddrToPaddrFunc prev_vaddr_to_paddr_read_func = vaddr_to_paddr_read_func;
     if (cop0.status.ksu == 0 || cop0.status.erl == 1 || cop0.status.exl == 1) { /* Kernel mode */
         operating_mode = OperatingMode::Kernel;
         if (cop0.status.kx == 0) {
@@ -172,6 +264,10 @@ void SetVaddrToPaddrFuncs()
     }
     can_execute_dword_instrs = operating_mode == OperatingMode::Kernel || addressing_mode == AddressingMode::Dword;
     can_exec_cop0_instrs = operating_mode == OperatingMode::Kernel || cop0.status.cu0;
+    if (vaddr_to_paddr_read_func != prev_vaddr_to_paddr_read_func) {
+        FlushDispatchCache();
+        FlushFastmemTlb(); /* the pages that are mapped differ between modes */
+    }
 }
 
 template<MemOp mem_op> u32 VirtualToPhysicalAddressUserMode32(u64 vaddr, bool& cacheable_area)
@@ -319,6 +415,22 @@ template<MemOp mem_op> u32 VirtualToPhysicalAddressKernelMode64(u64 vaddr, bool&
 
 template<MemOp mem_op> u32 VirtualToPhysicalAddressTlb(u64 vaddr)
 {
+    u64 vpage = vaddr >> 12;
+    TlbCacheEntry& cached = tlb_cache[vpage & (tlb_cache_size - 1)];
+    if (cached.vpage == vpage && (cached.global || cached.asid == cop0.entry_hi.asid)) {
+        if (!cached.valid) {
+            TlbInvalidException(vaddr, mem_op);
+            return 0;
+        }
+        if constexpr (mem_op == MemOp::Write) {
+            if (!cached.dirty) {
+                TlbModificationException(vaddr);
+                return 0;
+            }
+        }
+        FillFastmemTlb(vaddr, cached.ppage_addr, cached.dirty);
+        return cached.ppage_addr | u32(vaddr & 0xFFF);
+    }
     for (TlbEntry const& entry : tlb_entries) {
         /* Compare the virtual page number (divided by two; VPN2) of the entry with the VPN2 of the virtual address */
         if ((vaddr & entry.vpn2_addr_mask) != entry.vpn2_compare) continue;
@@ -331,6 +443,15 @@ template<MemOp mem_op> u32 VirtualToPhysicalAddressTlb(u64 vaddr)
          */
         bool vpn_odd = (vaddr & (entry.offset_addr_mask + 1)) != 0;
         auto entry_lo = entry.entry_lo[vpn_odd];
+        u32 paddr = u32(vaddr & entry.offset_addr_mask | entry_lo.pfn << 12 & ~entry.offset_addr_mask);
+        cached = {
+            .vpage = vpage,
+            .ppage_addr = paddr & ~0xFFF,
+            .asid = u8(cop0.entry_hi.asid),
+            .global = entry.global,
+            .valid = bool(entry_lo.v),
+            .dirty = bool(entry_lo.d),
+        };
         if (!entry_lo.v) { /* If the "Valid" bit is clear, it indicates that the TLB entry is invalid. */
             TlbInvalidException(vaddr, mem_op);
             return 0;
@@ -342,7 +463,8 @@ template<MemOp mem_op> u32 VirtualToPhysicalAddressTlb(u64 vaddr)
             }
         }
         /* TLB hit */
-        return u32(vaddr & entry.offset_addr_mask | entry_lo.pfn << 12 & ~entry.offset_addr_mask);
+        FillFastmemTlb(vaddr, paddr & ~0xFFF, entry_lo.d);
+        return paddr;
     }
     /* TLB miss */
     addressing_mode == AddressingMode::Word ? TlbMissException(vaddr, mem_op) : XtlbMissException(vaddr, mem_op);
@@ -382,7 +504,7 @@ template<size_t access_size, Alignment alignment> void WriteVirtual(u64 vaddr, s
                 << (8 * (access_size - offset - 1));
         }
     };
-    if (cacheable_area) {
+    if (cacheable_area && !DataAccessesBypassDCache()) {
         if constexpr (use_mask) WriteCacheableArea<access_size>(physical_address, data, Mask());
         else WriteCacheableArea<access_size>(physical_address, data);
     } else {
@@ -436,6 +558,7 @@ bool tlbwi()
     } else {
         auto index = cop0.index.value;
         if (index < 32) tlb_entries[index].Write();
+        FlushDispatchCache();
         return false;
     }
 }
@@ -448,6 +571,7 @@ bool tlbwr()
     } else {
         auto index = random_generator.Generate();
         if (index < 32) tlb_entries[index].Write();
+        FlushDispatchCache();
         return false;
     }
 }
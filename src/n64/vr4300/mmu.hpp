@@ -2,6 +2,7 @@
 
 #include "numtypes.hpp"
 
+#include <array>
 #include <concepts>
 
 namespace n64::vr4300 {
@@ -25,9 +26,11 @@ enum class MemOp {
     Write
 };
 
+bool DataAccessesBypassDCache();
 u32 Devirtualize(u64 vaddr);
 u32 FetchInstruction(u64 vaddr);
 void InitializeMMU();
+void OnWriteToEntryHi();
 template<std::signed_integral Int, Alignment alignment = Alignment::Aligned, MemOp mem_op = MemOp::Read>
 Int ReadVirtual(u64 vaddr);
 void SetVaddrToPaddrFuncs();
@@ -40,4 +43,12 @@ inline u32 last_paddr_on_instr_fetch;
 inline u32 last_paddr_on_load;
 inline bool can_execute_dword_instrs, can_exec_cop0_instrs;
 
+// Per 4 KiB page of the sign-extended 32-bit virtual address space, the translation of the page through the TLB into
+// RDRAM, for the fastmem accesses of the CPU recompiler. An entry holds the physical minus the virtual page address,
+// with the permission bits below in its low bits, or is zero if the page has no translation held. Filled in as the
+// TLB translates accesses, and only valid for the current ASID and operating mode.
+inline std::array<u32, 0x10'0000> fastmem_tlb;
+constexpr u32 fastmem_tlb_readable = 1;
+constexpr u32 fastmem_tlb_writable = 2;
+
 } // namespace n64::vr4300
@@ -0,0 +1,420 @@
+#include "persistent_cache.hpp"
+#include "asmjit/core/cpuinfo.h"
+#include "asmjit/core/virtmem.h"
+#include "files.hpp"
+#include "log.hpp"
+#include "memory/rdram.hpp"
+#include "platform.hpp"
+#include "recompiler.hpp"
+#include "serializer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <expected>
+#include <filesystem>
+#include <format>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#if PLATFORM_LINUX
+#    include <dlfcn.h>
+#elif PLATFORM_WINDOWS
+#    include <Windows.h>
+#endif
+
+using namespace asmjit;
+
+namespace n64::vr4300 {
+
+constexpr u32 file_magic = 0x4A43'3436; // "64CJ"
+constexpr u32 file_version = 1;
+constexpr size_t max_cache_bytes = 32_MiB; // of blocks held in memory and on disk, per ROM
+constexpr size_t max_variants_per_location = 4; // e.g. overlays loaded to the same address
+
+static std::unordered_map<u64, std::vector<PersistentBlock>> blocks; // key: see GetKey
+static std::filesystem::path cache_path;
+static size_t cache_bytes;
+static u64 use_clock;
+static bool cache_open;
+
+static void EvictLeastRecentlyUsed(size_t target_bytes);
+static u64 GetBuildId();
+static std::filesystem::path GetExecutablePath();
+static void const* GetHostModuleBase(void const* addr);
+static u64 GetKey(u64 vaddr, u32 context);
+static u8 const* GetRelocAnchor();
+static u64 Hash(std::span<u8 const> data, u64 hash = 0xCBF2'9CE4'8422'2325);
+static size_t StorageSize(PersistentBlock const& block);
+static void StreamBlock(Serializer& serializer, PersistentBlock& block);
+
+bool ApplyHostRelocs(std::span<u8> code, std::span<HostReloc const> relocs, void const* dispatch_stub)
+{
+    VirtMem::ProtectJitReadWriteScope write_scope(code.data(), code.size());
+    for (HostReloc const& reloc : relocs) {
+        u8 const* target = [&] {
+            switch (reloc.target_kind) {
+            case HostRelocTarget::Block: return static_cast<u8 const*>(code.data()) + reloc.target;
+            case HostRelocTarget::DispatchStub: return static_cast<u8 const*>(dispatch_stub);
+            case HostRelocTarget::Executable: return GetRelocAnchor() + reloc.target;
+            default: std::unreachable();
+            }
+        }();
+        if (reloc.size == 8) {
+            std::memcpy(code.data() + reloc.offset, &target, 8);
+        } else {
+            s64 rel = target - (code.data() + reloc.rel_base);
+            if (!std::in_range<s32>(rel)) {
+                return false;
+            }
+            s32 rel32 = s32(rel);
+            std::memcpy(code.data() + reloc.offset, &rel32, 4);
+        }
+    }
+    return true;
+}
+
+// asmjit has already resolved every relocation entry against the final address of the code, so the value of each
+// field is read back and classified by what it points to. A 32-bit field that points into the address table at the
+// end of the block refers to the 64-bit absolute address stored there, which is the one that needs relocating.
+std::optional<std::vector<HostReloc>> CaptureHostRelocs(CodeHolder const& code_holder,
+  u8 const* code,
+  void const* dispatch_stub)
+{
+    size_t code_size = code_holder.codeSize();
+    void const* executable_base = GetHostModuleBase(GetRelocAnchor());
+    auto classify = [&](u8 const* target) -> std::optional<std::pair<HostRelocTarget, s64>> {
+        if (target >= code && target < code + code_size) {
+            return std::pair{ HostRelocTarget::Block, s64(target - code) };
+        }
+        if (target == dispatch_stub) {
+            return std::pair{ HostRelocTarget::DispatchStub, s64(0) };
+        }
+        if (executable_base && GetHostModuleBase(target) == executable_base) {
+            return std::pair{ HostRelocTarget::Executable, s64(target - GetRelocAnchor()) };
+        }
+        return {};
+    };
+
+    std::vector<HostReloc> relocs;
+    auto add_abs64 = [&](u32 offset) {
+        if (offset + 8 > code_size) {
+            return false;
+        }
+        if (std::ranges::contains(relocs, offset, &HostReloc::offset)) {
+            return true; // an address table entry shared by several call sites
+        }
+        u8 const* target;
+        std::memcpy(&target, code + offset, 8);
+        auto classified = classify(target);
+        if (!classified) {
+            return false;
+        }
+        relocs.push_back({ .offset = offset,
+          .rel_base = 0,
+          .target = classified->second,
+          .target_kind = classified->first,
+          .size = 8 });
+        return true;
+    };
+
+    for (RelocEntry const* re : code_holder.relocEntries()) {
+        u64 source_offset = code_holder.sectionById(re->sourceSectionId())->offset() + re->sourceOffset();
+        u32 offset = u32(source_offset + re->format().valueOffset());
+        if (re->format().valueSize() == 8) {
+            if (!add_abs64(offset)) {
+                return {};
+            }
+        } else if (re->format().valueSize() == 4) {
+            u32 rel_base = u32(source_offset + re->format().regionSize());
+            s32 rel32;
+            std::memcpy(&rel32, code + offset, 4);
+            u8 const* target = code + rel_base + rel32;
+            if (target >= code && target < code + code_size) {
+                if (re->relocType() == RelocType::kX64AddressEntry && !add_abs64(u32(target - code))) {
+                    return {};
+                }
+                continue; // position-independent
+            }
+            auto classified = classify(target);
+            if (!classified) {
+                return {};
+            }
+            relocs.push_back({ .offset = offset,
+              .rel_base = rel_base,
+              .target = classified->second,
+              .target_kind = classified->first,
+              .size = 4 });
+        } else {
+            return {};
+        }
+    }
+    return relocs;
+}
+
+// Evicts the blocks used the longest time ago, until at most 'target_bytes' remain
+void EvictLeastRecentlyUsed(size_t target_bytes)
+{
+    if (cache_bytes <= target_bytes) {
+        return;
+    }
+    std::vector<std::pair<u64, u64>> uses; // last use, key
+    for (auto const& [key, variants] : blocks) {
+        for (PersistentBlock const& block : variants) {
+            uses.emplace_back(block.last_use, key);
+        }
+    }
+    std::ranges::sort(uses);
+    for (auto [last_use, key] : uses) {
+        if (cache_bytes <= target_bytes) {
+            break;
+        }
+        auto it = blocks.find(key);
+        std::erase_if(it->second, [last_use](PersistentBlock const& block) {
+            if (block.last_use == last_use) {
+                cache_bytes -= StorageSize(block);
+                ++recompiler_stats.persistent_cache_evictions;
+                return true;
+            }
+            return false;
+        });
+        if (it->second.empty()) {
+            blocks.erase(it);
+        }
+    }
+}
+
+PersistentBlock const* FindPersistentBlock(u64 vaddr, u32 paddr, u32 context)
+{
+    auto it = blocks.find(GetKey(vaddr, context));
+    if (it == blocks.end()) {
+        ++recompiler_stats.persistent_cache_misses;
+        return nullptr;
+    }
+    for (PersistentBlock& block : it->second) {
+        if (block.vaddr == vaddr && block.paddr == paddr && HashGuestCode(paddr, block.num_instrs) == block.code_hash) {
+            ++recompiler_stats.persistent_cache_hits;
+            block.last_use = ++use_clock;
+            return &block;
+        }
+    }
+    ++recompiler_stats.persistent_cache_stale;
+    return nullptr;
+}
+
+// The code only stays valid for the executable that compiled it: it has the addresses of functions and the layout of
+// the guest state baked in, and may use any of the instruction set extensions of the host CPU. The brand alone does not
+// identify those, as the OS or a hypervisor may hide some of them (e.g. AVX-512), so the detected feature set is hashed
+// too. 0 if the executable could not be read, in which case the cache is not used.
+u64 GetBuildId()
+{
+    static std::optional<u64> build_id;
+    if (!build_id) {
+        std::expected<std::vector<u8>, std::string> executable = OpenFile(GetExecutablePath());
+        if (executable) {
+            CpuInfo const& cpu = CpuInfo::host();
+            std::string_view cpu_brand = cpu.brand();
+            CpuFeatures const& cpu_features = cpu.features();
+            u64 hash = Hash(executable.value());
+            hash = Hash({ reinterpret_cast<u8 const*>(cpu_brand.data()), cpu_brand.size() }, hash);
+            hash = Hash({ reinterpret_cast<u8 const*>(&cpu_features), sizeof(cpu_features) }, hash);
+            build_id = hash == 0 ? 1 : hash;
+        } else {
+            build_id = 0;
+        }
+    }
+    return *build_id;
+}
+
+std::filesystem::path GetExecutablePath()
+{
+#if PLATFORM_LINUX
+    std::error_code ec;
+    return std::filesystem::read_symlink("/proc/self/exe", ec);
+#elif PLATFORM_WINDOWS
+    std::array<wchar_t, 4096> path;
+    DWORD length = GetModuleFileNameW(nullptr, path.data(), DWORD(path.size()));
+    return length > 0 && length < path.size() ? std::filesystem::path(path.data(), path.data() + length)
+                                              : std::filesystem::path{};
+#endif
+}
+
+// The base address of the executable or shared library that 'addr' lies in; null if it is not in any of them
+void const* GetHostModuleBase(void const* addr)
+{
+#if PLATFORM_LINUX
+    Dl_info info;
+    return dladdr(addr, &info) ? info.dli_fbase : nullptr;
+#elif PLATFORM_WINDOWS
+    HMODULE module;
+    constexpr DWORD flags = GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT;
+    return GetModuleHandleExW(flags, static_cast<LPCWSTR>(addr), &module) ? module : nullptr;
+#endif
+}
+
+// Only blocks in the unmapped segments are stored, where the lower 32 bits of the vaddr identify it.
+u64 GetKey(u64 vaddr, u32 context)
+{
+    return u64(context) << 32 | u32(vaddr);
+}
+
+// Addresses within the executable are stored relative to this, as the image may be loaded at a different base.
+u8 const* GetRelocAnchor()
+{
+    return reinterpret_cast<u8 const*>(&RunRecompiler);
+}
+
+// FNV-1a
+u64 Hash(std::span<u8 const> data, u64 hash)
+{
+    for (u8 byte : data) {
+        hash = (hash ^ byte) * 0x100'0000'01B3;
+    }
+    return hash;
+}
+
+std::optional<u64> HashGuestCode(u32 paddr, u32 num_instrs)
+{
+    if (u64(paddr) + num_instrs * 4 > rdram::GetSize()) {
+        return {};
+    }
+    return Hash({ rdram::GetPointerToMemory(paddr), num_instrs * 4 });
+}
+
+bool IsPersistentCacheOpen()
+{
+    return cache_open;
+}
+
+void OpenPersistentCache(u64 rom_id)
+{
+    blocks.clear();
+    cache_bytes = 0;
+    use_clock = 0;
+    cache_path = std::filesystem::current_path() / "cache" / std::format("{:016X}.jitcache", rom_id);
+    cache_open = GetBuildId() != 0;
+    if (!cache_open) {
+        LogWarn("Failed to identify the emulator build; the JIT block cache is disabled");
+        return;
+    }
+
+    std::error_code ec;
+    if (!std::filesystem::exists(cache_path, ec)) {
+        return;
+    }
+    Serializer serializer{ Serializer::Mode::Read, cache_path };
+    u32 magic{}, version{};
+    u64 build_id{};
+    size_t num_blocks{};
+    serializer.StreamTrivial(magic);
+    serializer.StreamTrivial(version);
+    serializer.StreamTrivial(build_id);
+    if (serializer.HasError() || magic != file_magic || version != file_version || build_id != GetBuildId()) {
+        LogInfo("Discarding the JIT block cache at {}, as it was written by another build", cache_path.string());
+        return;
+    }
+    serializer.StreamTrivial(use_clock);
+    serializer.StreamTrivial(num_blocks);
+    for (size_t i = 0; i < num_blocks && !serializer.HasError(); ++i) {
+        PersistentBlock block;
+        StreamBlock(serializer, block);
+        if (!serializer.HasError()) {
+            cache_bytes += StorageSize(block);
+            blocks[GetKey(block.vaddr, block.context)].push_back(std::move(block));
+        }
+    }
+    if (serializer.HasError()) {
+        LogWarn("Failed to read the JIT block cache at {}; starting over", cache_path.string());
+        blocks.clear();
+        cache_bytes = 0;
+        return;
+    }
+    LogInfo("Loaded {} blocks ({} bytes) from the JIT block cache at {}", num_blocks, cache_bytes, cache_path.string());
+}
+
+void SavePersistentCache()
+{
+    if (!cache_open) {
+        return;
+    }
+    EvictLeastRecentlyUsed(max_cache_bytes);
+    std::error_code ec;
+    std::filesystem::create_directories(cache_path.parent_path(), ec);
+    Serializer serializer{ Serializer::Mode::Write, cache_path };
+    u32 magic = file_magic, version = file_version;
+    u64 build_id = GetBuildId();
+    size_t num_blocks = 0;
+    for (auto const& [key, variants] : blocks) {
+        num_blocks += variants.size();
+    }
+    serializer.StreamTrivial(magic);
+    serializer.StreamTrivial(version);
+    serializer.StreamTrivial(build_id);
+    serializer.StreamTrivial(use_clock);
+    serializer.StreamTrivial(num_blocks);
+    for (auto& [key, variants] : blocks) {
+        for (PersistentBlock& block : variants) {
+            StreamBlock(serializer, block);
+        }
+    }
+    if (serializer.HasError()) {
+        LogWarn("Failed to write the JIT block cache to {}", cache_path.string());
+        return;
+    }
+    RecompilerStats const& stats = recompiler_stats;
+    u64 lookups = stats.persistent_cache_hits + stats.persistent_cache_misses + stats.persistent_cache_stale;
+    LogInfo("Saved {} blocks ({} bytes) to the JIT block cache; {} hits, {} misses, {} stale ({:.1f}% hit rate)",
+      num_blocks,
+      cache_bytes,
+      stats.persistent_cache_hits,
+      stats.persistent_cache_misses,
+      stats.persistent_cache_stale,
+      lookups ? 100.0 * double(stats.persistent_cache_hits) / double(lookups) : 0.0);
+}
+
+size_t StorageSize(PersistentBlock const& block)
+{
+    return sizeof(block) + block.code.size() + block.relocs.size() * sizeof(HostReloc)
+         + block.links.size() * sizeof(LinkSite) + block.fastmem_sites.size() * sizeof(FastmemSiteOffsets);
+}
+
+void StorePersistentBlock(PersistentBlock block)
+{
+    block.last_use = ++use_clock;
+    cache_bytes += StorageSize(block);
+    std::vector<PersistentBlock>& variants = blocks[GetKey(block.vaddr, block.context)];
+    auto same_or_oldest = std::ranges::find_if(variants, [&block](PersistentBlock const& variant) {
+        return variant.vaddr == block.vaddr && variant.paddr == block.paddr && variant.code_hash == block.code_hash;
+    });
+    if (same_or_oldest == variants.end() && variants.size() == max_variants_per_location) {
+        same_or_oldest = std::ranges::min_element(variants, {}, &PersistentBlock::last_use);
+    }
+    if (same_or_oldest != variants.end()) {
+        cache_bytes -= StorageSize(*same_or_oldest);
+        *same_or_oldest = std::move(block);
+    } else {
+        variants.push_back(std::move(block));
+    }
+    if (cache_bytes > max_cache_bytes) {
+        EvictLeastRecentlyUsed(max_cache_bytes * 3 / 4);
+    }
+}
+
+void StreamBlock(Serializer& serializer, PersistentBlock& block)
+{
+    serializer.StreamTrivial(block.vaddr);
+    serializer.StreamTrivial(block.paddr);
+    serializer.StreamTrivial(block.context);
+    serializer.StreamTrivial(block.num_instrs);
+    serializer.StreamTrivial(block.gprs_dead_on_entry);
+    serializer.StreamTrivial(block.code_hash);
+    serializer.StreamTrivial(block.last_use);
+    serializer.StreamVector(block.code);
+    serializer.StreamVector(block.relocs);
+    serializer.StreamVector(block.links);
+    serializer.StreamVector(block.fastmem_sites);
+}
+
+} // namespace n64::vr4300
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "asmjit/core/codeholder.h"
+#include "numtypes.hpp"
+
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace n64::vr4300 {
+
+// A link from a block to its successor (see BlockLink in recompiler.cpp), by the offset of its 'jmp rel32' from the
+// start of the block
+struct LinkSite {
+    u32 jmp_site;
+    u32 target_paddr;
+    u32 unflushed_gprs;
+};
+
+// A fastmem access (see FastmemSite in recompiler.cpp), by offsets from the start of the block
+struct FastmemSiteOffsets {
+    u32 patch_site;
+    u32 access;
+    u32 slow_path;
+};
+
+enum class HostRelocTarget : u8 {
+    Block, // 'target' is an offset from the start of the block
+    DispatchStub,
+    Executable // 'target' is an offset from RunRecompiler, within the executable image
+};
+
+// A field in the code of a block that holds a host address: either a 64-bit absolute address, or a 32-bit
+// displacement from the offset 'rel_base'.
+struct HostReloc {
+    u32 offset;
+    u32 rel_base;
+    s64 target;
+    HostRelocTarget target_kind;
+    u8 size;
+};
+
+// A compiled block, together with everything needed to place it at another host address in a later run. It is only
+// reused if the guest code that it was compiled from is unchanged, and was compiled under the same 'context' (see
+// GetModeContext in recompiler.cpp).
+struct PersistentBlock {
+    u64 vaddr;
+    u32 paddr;
+    u32 context;
+    u32 num_instrs;
+    u32 gprs_dead_on_entry;
+    u64 code_hash; // of the guest instructions
+    u64 last_use; // for LRU eviction; a value of a clock that is kept across runs
+    std::vector<u8> code;
+    std::vector<HostReloc> relocs;
+    std::vector<LinkSite> links;
+    std::vector<FastmemSiteOffsets> fastmem_sites;
+};
+
+// Writes the relocated host addresses into the code of a block, which has been copied to 'code'. Returns false if a
+// displacement is out of range, in which case the block cannot be used.
+bool ApplyHostRelocs(std::span<u8> code, std::span<HostReloc const> relocs, void const* dispatch_stub);
+
+// Finds the host addresses in the code of a block that has just been added to the code cache at 'code'. Returns none
+// if any of them cannot be expressed in a form that holds up in another run, e.g. a pointer into the heap.
+std::optional<std::vector<HostReloc>> CaptureHostRelocs(asmjit::CodeHolder const& code_holder,
+  u8 const* code,
+  void const* dispatch_stub);
+
+// The stored block for the given location and context whose guest code matches what is currently in RDRAM, or null
+PersistentBlock const* FindPersistentBlock(u64 vaddr, u32 paddr, u32 context);
+
+// None if the code is not entirely within RDRAM
+std::optional<u64> HashGuestCode(u32 paddr, u32 num_instrs);
+
+bool IsPersistentCacheOpen();
+
+// Reads the blocks stored for the ROM with the given id, if they were compiled by this very executable.
+void OpenPersistentCache(u64 rom_id);
+void SavePersistentCache();
+void StorePersistentBlock(PersistentBlock block);
+
+} // namespace n64::vr4300
@@ -1,22 +1,47 @@
 #include "recompiler.hpp"
-#include "asmjit/arm/a64compiler.h"
+#include "asmjit/arm/a64assembler.h"
 #include "asmjit/core/codeholder.h"
-#include "asmjit/core/jitruntime.h"
-#include "asmjit/x86/x86compiler.h"
-#include "bump_allocator.hpp"
+#include "asmjit/core/virtmem.h"
+#include "asmjit/x86/x86assembler.h"
 #include "cop0.hpp"
 #include "decoder.hpp"
 #include "exceptions.hpp"
+#include "fastmem.hpp"
 #include "fatal_error.hpp"
+#include "free_list_allocator.hpp"
 #include "frontend/message.hpp"
+#include "interface/vi.hpp"
+#include "interpreter.hpp"
+#include "ir.hpp"
+#include "jit_code_cache.hpp"
 #include "jit_common.hpp"
+#include "log.hpp"
+#include "memory/memory.hpp"
+#include "memory/rdram.hpp"
+#include "mips/gpr_liveness.hpp"
 #include "mmu.hpp"
 #include "n64_build_options.hpp"
+#include "persistent_cache.hpp"
+#include "scheduler.hpp"
 #include "vr4300.hpp"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <bit>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -30,33 +55,223 @@ constexpr u32 instructions_per_pool = bytes_per_pool / 4;
 constexpr u32 num_pools = 0x80'0000; // 32 bits (address range) - 8 (bits per pool)
 constexpr u32 pool_max_addr_excl = (num_pools * bytes_per_pool);
 static_assert(std::has_single_bit(pool_max_addr_excl));
+constexpr size_t code_cache_size = 128_MiB;
+constexpr size_t max_free_code_holders = 8; // kept for reuse; see ReleaseCompiledBlock
+constexpr size_t max_block_code_size = 64_KiB; // the code cache is flushed before compiling unless this much is free
+constexpr u32 dispatch_cache_size = 0x1000;
+static_assert(std::has_single_bit(dispatch_cache_size));
+constexpr u64 invalid_dispatch_vaddr = ~0_u64; // misaligned; the pc never holds this value when a block is dispatched
+constexpr u32 max_idle_loop_instructions = 8; // including the branch delay slot
+constexpr u32 max_block_instructions = 128; // see AtBlockEnd
+constexpr size_t fastmem_sites_per_chunk = 0x1000;
+// A fastmem site takes well over 16 bytes of code, so the code cache never holds more sites than this
+constexpr size_t max_fastmem_site_chunks = code_cache_size / 16 / fastmem_sites_per_chunk;
 
 using Block = void (*)(s64 const* gpr_mid_ptr);
 
+// A block, together with the mode that it was compiled for (see GetModeContext)
+struct BlockSlot {
+    Block block;
+    u32 mode_context;
+    u32 gprs_dead_on_entry; // see mips::GprLiveness::DeadOnEntry
+};
+
 struct Pool {
-    std::array<Block, instructions_per_pool> blocks;
+    std::array<BlockSlot, instructions_per_pool> slots;
+};
+
+// A block compiled for an address whose slot in the pool holds the block compiled under another mode
+struct BlockVariant {
+    u32 paddr;
+    BlockSlot slot;
+};
+
+// A 'jmp rel32' at the end of a compiled block, targeting the block compiled for 'target_paddr'. While the target
+// exists, the jmp enters it directly; otherwise, it falls through to a return to RunRecompiler. GPRs in
+// 'unflushed_gprs' are only written back on the way to the return, so the target must overwrite them before use.
+struct BlockLink {
+    u8* jmp_site;
+    u32 source_pool;
+    u32 target_paddr;
+    u32 mode_context; // of both blocks; a block is left without a link if it changes the mode
+    u32 unflushed_gprs;
+};
+
+struct PendingBlockLink {
+    asmjit::Label jmp_site;
+    u32 target_paddr;
+    u32 unflushed_gprs;
+};
+
+// Maps a virtual pc straight to a compiled block, without an address translation. The context holds the ASID and
+// the operating mode (see GetDispatchContext), under which the pc was translated. The layout is relied on by the
+// dispatch stub (see EmitDispatchStub).
+struct alignas(32) DispatchCacheEntry {
+    u64 vaddr;
+    u32 context;
+    Block block;
 };
+static_assert(sizeof(DispatchCacheEntry) == 32);
 
-static BumpAllocator allocator;
-static asmjit::CodeHolder code_holder;
+// A fastmem access, and the 5-byte nop in front of it which is patched into a jmp to its slow path once the access
+// faults. By offsets from the start of the code cache.
+struct FastmemSite {
+    u32 access;
+    u32 patch_site;
+    u32 slow_path;
+};
+
+struct PendingFastmemSite {
+    asmjit::Label patch_site;
+    asmjit::Label access;
+    asmjit::Label slow_path;
+};
+
+// The instructions that a block may span (see GetMaxBlockInstrs), as copied from RDRAM when the block was requested
+// from the compile thread
+using BlockInstrs = std::array<u32, max_block_instructions>;
+
+struct CompileRequest {
+    CompileContext context;
+    BlockInstrs instrs;
+    std::chrono::steady_clock::time_point request_time;
+};
+
+// A block that has been emitted, but not yet placed in the code cache. Only the emulation thread places and installs
+// blocks, as it owns the code cache, the pools and the links between blocks.
+struct CompiledBlock {
+    CompileContext context;
+    std::unique_ptr<asmjit::CodeHolder> code;
+    std::vector<PendingBlockLink> links;
+    std::vector<PendingFastmemSite> fastmem_sites;
+    u32 num_instrs;
+    u32 gprs_dead_on_entry;
+    u64 compile_time_ns;
+    BlockInstrs instrs; // if compiled on the compile thread
+    std::chrono::steady_clock::time_point request_time; // likewise
+};
+
+static FreeListAllocator<Pool> allocator;
+static std::unique_ptr<asmjit::CodeHolder> code_holder; // of the block being compiled
+static asmjit::Section* cold_section; // of 'code_holder'; placed after the .text section
+static JitCodeCache code_cache;
 static asmjit::FileLogger jit_logger(stdout);
-static asmjit::JitRuntime jit_runtime;
 static std::vector<Pool*> pools;
+static std::array<DispatchCacheEntry, dispatch_cache_size> dispatch_cache;
+static void* dispatch_stub;
+static std::unordered_map<u32, std::vector<BlockLink>> incoming_links; // key: index of the pool of the link targets
+static std::unordered_map<u32, std::vector<u32>> outgoing_link_pools; // key: index of the pool of the linking blocks
+// Key: index of a pool that blocks starting in earlier pools extend into; value: the indices of the pools they start in
+static std::unordered_map<u32, std::vector<u32>> spanning_block_pools;
+static std::unordered_map<u32, std::deque<BlockVariant>> block_variants; // key: index of the pool of the blocks
+static u64 dispatch_mode_state; // see OnModeContextChange
+static std::vector<PendingBlockLink> pending_links;
+// The fastmem sites of the blocks in the code cache, sorted by access, for the access violation handler to search
+// without allocating or locking (see RegisterFastmemSites). The chunks are allocated as needed, and never moved.
+static std::array<std::unique_ptr<FastmemSite[]>, max_fastmem_site_chunks> fastmem_site_chunks;
+static std::atomic<size_t> num_fastmem_sites;
+static std::vector<PendingFastmemSite> pending_fastmem_sites;
+static std::vector<LinkSite> link_sites; // of the block being installed, whether compiled or loaded
+static std::vector<FastmemSiteOffsets> fastmem_site_offsets; // likewise
+static std::optional<u64> static_branch_target;
+static u32 num_taken_branch_sites;
 static bool block_has_branch_instr;
+static bool block_is_idle_loop;
+static bool block_is_loop; // see IrBlock::IsLoop
+static asmjit::Label loop_head; // bound after the GPRs have been loaded; see BeginLoop
+static bool fold_branch_state; // see IrBlock::CanFoldBranchState
+static IrBlock ir_block;
+static mips::GprLiveness gpr_liveness; // of the instructions in 'ir_block'
+static std::span<u32 const> block_instrs; // copied instructions of the block being compiled; fetched if empty
+static IrInstr const* current_ir_instr; // the instruction being emitted, if it is part of the IR
+static std::jthread compile_thread;
+static std::mutex compile_mutex; // held while a block is compiled, as the emitters share global state
+static std::mutex compile_queue_mutex; // guards 'compile_requests', 'compiled_blocks' and 'free_code_holders'
+static std::condition_variable_any compile_queue_cv;
+static std::deque<CompileRequest> compile_requests;
+static std::vector<CompiledBlock> compiled_blocks;
+static std::atomic<bool> compiled_blocks_ready;
+static std::vector<std::unique_ptr<asmjit::CodeHolder>> free_code_holders; // of placed blocks, for reuse
+// Of blocks requested and not yet installed, by mode context and physical address; emulation thread only
+static std::unordered_set<u64> requested_blocks;
+static std::mutex pools_mutex; // guards changes to the pools against GetGprsDeadOnEntry on the compile thread
 
-static void Compile(Block& block);
+static bool AtBlockEnd(u64 vaddr);
+static void BlockEpilogWithIdleLoopSkip();
+static void BlockEpilogWithLink(u64 target);
+static void BeginLoop();
+static void BuildIr();
+static CompileContext CaptureCompileContext(u32 paddr);
+static CompiledBlock Compile(CompileContext const& context, std::span<u32 const> instrs);
+static void CompileThread(std::stop_token stop_token);
 static void EmitBranchCheck();
-static bool EmitInstruction();
-static void FinalizeBlock(Block& block);
-static Block& GetBlock(u32 paddr);
+static void EmitDispatchStub();
+static bool EmitFromIr(IrInstr const& instr);
+static void EmitInstruction();
+static void EmitLoopBackEdge();
+static void EmitSideExit();
+static u32 FetchBlockInstruction(u64 vaddr);
+static void FinalizeBlock();
+static void FlushCodeCache();
+static BlockSlot* FindBlockSlot(u32 paddr, u32 mode_context);
+static BlockSlot& GetBlockSlot(u32 paddr, u32 mode_context);
+static u32 GetDispatchContext();
+static u64 GetDispatchModeState();
+static FastmemSite const& GetFastmemSite(size_t index);
+static u32 GetGprsDeadOnEntry(u32 paddr, u32 mode_context);
+static std::optional<u32> GetLinkablePaddr(u64 target);
+static u32 GetMaxBlockInstrs(u32 paddr);
+static u32 GetModeContext(CompileContext const& context);
+static void InstallBlock(BlockSlot& slot, Block block, u32 paddr, u32 num_instrs, u32 gprs_dead_on_entry);
+static void InstallCompiledBlocks();
+static bool IsLinkable(u32 unflushed_gprs, u32 target_paddr, u32 mode_context);
+static bool IsUnmappedKernelVaddr(u64 vaddr);
+static void LinkBlock(Block block, u32 paddr, u32 mode_context);
+static bool LoadPersistedBlock(BlockSlot& slot, u32 paddr);
+static void PatchJmp(u8* jmp_site, void const* target);
+static void PersistBlock(CompiledBlock const& compiled, Block block);
+static Block PlaceBlock(CompiledBlock& compiled);
+static void ReleaseCompiledBlock(CompiledBlock& compiled);
 static void RecordBlockCycles();
-static void ResetPool(Pool*& pool);
+static void RegisterFastmemSites(Block block);
+static bool RequestCompile(u32 paddr);
+static void ResetPool(u32 pool_index);
+static void SetPageHasCode(u32 paddr, bool has_code);
+static void SkipIdleLoop();
+
+void SetPc(u64 new_pc);
+
+void AddFastmemSite(Label patch_site, Label access, Label slow_path)
+{
+    pending_fastmem_sites.emplace_back(patch_site, access, slow_path);
+}
+
+// Blocks run on through pools and past conditional branches (see EmitSideExit), but not beyond the page that they
+// start in, whose successor in the virtual address space need not be the next physical page, nor beyond a maximum
+// length.
+bool AtBlockEnd(u64 vaddr)
+{
+    return !(vaddr & (code_page_size - 1)) || vaddr - compile_context.vaddr >= 4 * max_block_instructions;
+}
 
 void BlockEpilog()
 {
     RecordBlockCycles();
     reg_alloc.BlockEpilog();
-    c.ret();
+}
+
+void BlockEpilogWithDispatch(void* func)
+{
+    RecordBlockCycles();
+    reg_alloc.BlockEpilogWithCallAndJmp(func, dispatch_stub);
+}
+
+// Raises an exception by calling 'func', and enters the block at the exception vector, without returning to
+// RunRecompiler first
+void BlockEpilogWithException(void* func, int pc_offset)
+{
+    FlushPc(pc_offset);
+    BlockEpilogWithDispatch(func);
 }
 
 void BlockEpilogWithJmp(void* func)
@@ -71,88 +286,283 @@ void BlockEpilogWithPcFlushAndJmp(void* func, int pc_offset)
     BlockEpilogWithJmp(func);
 }
 
+// Ends an iteration of a busy-wait loop. Its start is returned to through RunRecompiler rather than through a link,
+// after the cycles that the loop would spin for have been skipped.
+void BlockEpilogWithIdleLoopSkip()
+{
+    SetPc(compile_context.vaddr);
+    BlockEpilogWithJmp((void*)SkipIdleLoop);
+}
+
+void BlockEpilogWithLink(u64 target)
+{
+    SetPc(target);
+    std::optional<u32> target_paddr = GetLinkablePaddr(target);
+    if (!target_paddr) {
+        BlockEpilog();
+        return;
+    }
+    // Same as RecordBlockCycles, but the updated cycle counter is kept in eax for the comparison, rather than reloaded
+    assert(block_cycles > 0);
+    c.mov(eax, JitPtr(cycle_counter));
+    c.add(eax, block_cycles);
+    c.mov(JitPtr(cycle_counter), eax);
+    c.add(JitPtr(cop0.count), block_cycles);
+    c.cmp(eax, JitPtr(cycles_to_run));
+    // If the block ends with a branch, its delay slot is the first instruction of the successor, after which the
+    // successor may leave to the branch target before overwriting anything
+    u32 gprs_dead_in_successor = 0;
+    if (!last_emitted_instr_was_branch) {
+        gprs_dead_in_successor = *target_paddr == compile_context.paddr
+                                 ? gpr_liveness.DeadOnEntry() // a block branching back to its own start
+                                 : GetGprsDeadOnEntry(*target_paddr, GetModeContext(compile_context));
+    }
+    Label l_jmp_site = c.newLabel();
+    u32 unflushed_gprs = reg_alloc.BlockEpilogWithLink(l_jmp_site, gprs_dead_in_successor);
+    pending_links.emplace_back(l_jmp_site, *target_paddr, unflushed_gprs);
+}
+
 void BlockEpilogWithPcFlush(int pc_offset)
 {
     FlushPc(pc_offset);
     BlockEpilog();
 }
 
+// For an exception that has already been raised, with the pc set to the vector
+void BlockEpilogToExceptionVector()
+{
+    RecordBlockCycles();
+    reg_alloc.BlockEpilogWithJmp(dispatch_stub);
+}
+
+// Each block gets a code holder of its own, which is handed over to the emulation thread along with the block. Once
+// the block has been placed, the code holder is recycled (see RecycleCodeHolder), so that its memory is reused.
+// Blocks are emitted straight to machine code; the register allocator sets up and tears down the stack frame.
 void BlockProlog()
 {
-    code_holder.reset();
-    asmjit::Error err = code_holder.init(jit_runtime.environment(), jit_runtime.cpuFeatures());
+    {
+        std::lock_guard lock{ compile_queue_mutex };
+        if (!free_code_holders.empty()) {
+            code_holder = std::move(free_code_holders.back());
+            free_code_holders.pop_back();
+        }
+    }
+    if (!code_holder) {
+        code_holder = std::make_unique<CodeHolder>();
+        asmjit::Error err = code_holder->init(Environment::host(), CpuInfo::host().features());
+        if (err) {
+            FATAL("Failed to init asmjit code holder; returned {}", asmjit::DebugUtils::errorAsString(err));
+        }
+    }
+    asmjit::Error err = code_holder->newSection(&cold_section, ".cold", SIZE_MAX, SectionFlags::kExecutable, 1);
     if (err) {
-        FATAL("Failed to init asmjit code holder; returned {}", asmjit::DebugUtils::errorAsString(err));
+        FATAL("Failed to create asmjit section; returned {}", asmjit::DebugUtils::errorAsString(err));
     }
-    err = code_holder.attach(&c);
+    err = code_holder->attach(&c);
     if (err) {
-        FATAL("Failed to attach asmjit compiler to code holder; returned {}", asmjit::DebugUtils::errorAsString(err));
+        FATAL("Failed to attach asmjit assembler to code holder; returned {}", asmjit::DebugUtils::errorAsString(err));
     }
     if constexpr (enable_cpu_jit_error_handler) {
         static AsmjitLogErrorHandler asmjit_log_error_handler;
-        code_holder.setErrorHandler(&asmjit_log_error_handler);
+        code_holder->setErrorHandler(&asmjit_log_error_handler);
     }
     if constexpr (log_cpu_jit_blocks) {
         jit_logger.addFlags(FormatFlags::kMachineCode);
-        code_holder.setLogger(&jit_logger);
+        code_holder->setLogger(&jit_logger);
         jit_logger.log("======== CPU BLOCK BEGIN ========\n");
     }
-    FuncNode* func_node = c.addFunc(FuncSignature::build<void>());
-    func_node->frame().setAvxEnabled();
-    func_node->frame().setAvxCleanup();
     reg_alloc.BlockProlog();
 }
 
+// Starts a loop back to the start of the block, which EmitLoopBackEdge closes. The GPRs that the block accesses are
+// loaded up front, so that the loop can run with them in host registers throughout. Instructions not modelled by the
+// liveness analysis are taken to access every GPR, and are left out.
+void BeginLoop()
+{
+    u32 gprs = 0, gprs_written = 0;
+    for (u32 i = 0; i < gpr_liveness.Size(); ++i) {
+        mips::GprAccess const& access = gpr_liveness.Access(i);
+        if (access.reads != ~1u) {
+            gprs |= access.reads | access.writes;
+            gprs_written |= access.writes;
+        }
+    }
+    // Leave some host registers for temporaries and call arguments
+    constexpr int max_loop_gprs = int(reg_alloc_num_gprs) - 3;
+    while (std::popcount(gprs) > max_loop_gprs) {
+        gprs &= ~(1u << (31 - std::countl_zero(gprs)));
+    }
+    reg_alloc.BeginLoop(gprs, gprs_written & gprs);
+    loop_head = c.newLabel();
+    c.bind(loop_head);
+}
+
+// Builds and optimizes the IR of the block being compiled. The emitters get the instruction words from the IR, as far
+// as it reaches.
+void BuildIr()
+{
+    ir_block.Reset(compile_context.vaddr);
+    u64 vaddr = compile_context.vaddr;
+    do {
+        ir_block.Append(FetchBlockInstruction(vaddr));
+        vaddr += 4;
+    } while (!ir_block.EndsBlock(u32(ir_block.Instrs().size() - 1), compile_context.can_execute_dword_instrs)
+             && !AtBlockEnd(vaddr));
+    ir_block.Optimize();
+    std::array<u32, max_block_instructions> instrs;
+    std::ranges::transform(ir_block.Instrs(), instrs.begin(), &IrInstr::word);
+    gpr_liveness.Analyze(std::span(instrs).first(ir_block.Instrs().size()), mips::Isa::Vr4300);
+    if constexpr (log_cpu_jit_ir) {
+        LogInfo("{}", ir_block.Dump());
+    }
+}
+
+// Of the block at the pc, which is about to be compiled
+CompileContext CaptureCompileContext(u32 paddr)
+{
+    return {
+        .vaddr = pc,
+        .paddr = paddr,
+        .operating_mode = operating_mode,
+        .can_execute_dword_instrs = can_execute_dword_instrs,
+        .can_exec_cop0_instrs = can_exec_cop0_instrs,
+        .cop1_usable = bool(cop0.status.cu1),
+        .fr = bool(cop0.status.fr),
+        .fpu_exception_enables = u8(std::bit_cast<u32>(fcr31) >> FCR31BitIndex::EnableInexact & 31),
+    };
+}
+
 bool CheckDwordOpCondJit()
 {
-    if (can_execute_dword_instrs) {
+    if (compile_context.can_execute_dword_instrs) {
         return true;
     } else {
-        BlockEpilogWithPcFlushAndJmp((void*)ReservedInstructionException);
+        BlockEpilogWithException((void*)ReservedInstructionException);
         branched = true;
         return false;
     }
 }
 
-void Compile(Block& block)
+Label ColdBlockEpilogWithException(void* func, int pc_offset)
 {
+    Label l_cold = c.newLabel();
+    Section* hot_section = ColdCodeBegin();
+    c.bind(l_cold);
+    BlockEpilogWithException(func, pc_offset);
+    ColdCodeEnd(hot_section);
+    return l_cold;
+}
+
+// Code emitted between ColdCodeBegin and ColdCodeEnd is placed after all other code of the block, so that the rarely
+// taken exception paths do not dilute the straight-line code in the i-cache. The code is still emitted in program
+// order, so it sees the register allocator state of the instruction it was emitted for. It goes to a section of its
+// own, which the code cache lays out after the .text section.
+Section* ColdCodeBegin()
+{
+    Section* hot_section = c.currentSection();
+    c.section(cold_section);
+    return hot_section;
+}
+
+void ColdCodeEnd(Section* hot_section)
+{
+    c.section(hot_section);
+}
+
+// Emits the block described by 'context', on either thread. 'instrs' holds the instructions that the block may span;
+// if empty, they are fetched from guest memory, which only the emulation thread may do.
+CompiledBlock Compile(CompileContext const& context, std::span<u32 const> instrs)
+{
+    std::lock_guard lock{ compile_mutex };
+    auto compile_start = std::chrono::steady_clock::now();
+    compile_context = context;
+    block_instrs = instrs;
     branched = block_has_branch_instr = false;
     block_cycles = 0;
-    jit_pc = pc;
+    jit_pc = context.vaddr;
+    num_taken_branch_sites = 0;
+    static_branch_target = {};
+    pending_links.clear();
+    pending_fastmem_sites.clear();
+    fold_branch_state = false;
+    BuildIr();
+    block_is_idle_loop = ir_block.IsIdleLoop(max_idle_loop_instructions);
+    block_is_loop = !block_is_idle_loop && ir_block.IsLoop();
+    reg_alloc.SetGprLiveness(&gpr_liveness);
 
     BlockProlog();
-
-    bool got_exception = EmitInstruction();
-
-    if (got_exception) {
-        BlockEpilog();
-        goto compile_end;
+    if (block_is_loop) {
+        BeginLoop();
     }
 
+    EmitInstruction();
+
     // If the previously executed block ended with a branch instruction, meaning that the branch delay
     // slot did not fit, execute only the first instruction in this block, before jumping.
     // The jump can be cancelled if the first instruction is also a branch.
-    if (!last_instr_was_branch) {
+    if (!last_emitted_instr_was_branch) {
         EmitBranchCheck();
     }
 
-    while (!branched && !got_exception && (jit_pc & 255)) {
-        branched |= last_instr_was_branch; // If the branch delay slot instruction fits within the block boundary,
-                                           // include it before stopping
-        got_exception = EmitInstruction();
+    while (!branched && !AtBlockEnd(jit_pc)) {
+        // If the branch delay slot instruction fits within the block boundary, include it before stopping. Past the
+        // delay slot of a conditional branch, the block goes on with the path on which the branch is not taken.
+        bool in_delay_slot = last_emitted_instr_was_branch;
+        bool falls_through = in_delay_slot
+                          && mips::GetBranchKind(FetchBlockInstruction(jit_pc - 4), mips::Isa::Vr4300)
+                               == mips::BranchKind::Conditional;
+        branched |= in_delay_slot && !falls_through;
+        EmitInstruction();
+        if (falls_through && !branched) {
+            if (last_emitted_instr_was_branch) {
+                branched = true; // a branch in the delay slot; see IrBlock::EndsBlock
+            } else if (!AtBlockEnd(jit_pc)) {
+                EmitSideExit();
+            }
+        }
     }
 
-    if (got_exception) {
-        BlockEpilog();
-    } else {
-        if (!last_instr_was_branch && block_has_branch_instr) {
-            EmitBranchCheck();
-        }
-        BlockEpilogWithPcFlush(0);
+    if (!last_emitted_instr_was_branch && block_has_branch_instr) {
+        EmitBranchCheck();
     }
+    BlockEpilogWithLink(jit_pc);
+
+    FinalizeBlock();
+    block_instrs = {};
+    return {
+        .context = context,
+        .code = std::move(code_holder),
+        .links = std::move(pending_links),
+        .fastmem_sites = std::move(pending_fastmem_sites),
+        .num_instrs = u32(jit_pc - context.vaddr) / 4,
+        .gprs_dead_on_entry = gpr_liveness.DeadOnEntry(),
+        .compile_time_ns = u64(std::chrono::nanoseconds(std::chrono::steady_clock::now() - compile_start).count()),
+        .instrs = {},
+        .request_time = {},
+    };
+}
 
-compile_end:
-    FinalizeBlock(block);
+// Compiles the blocks requested by the emulation thread (see RequestCompile), in order
+void CompileThread(std::stop_token stop_token)
+{
+    while (true) {
+        CompileRequest request;
+        {
+            std::unique_lock lock{ compile_queue_mutex };
+            if (!compile_queue_cv.wait(lock, stop_token, [] { return !compile_requests.empty(); })) {
+                return;
+            }
+            request = compile_requests.front();
+            compile_requests.pop_front();
+        }
+        u32 num_instrs = GetMaxBlockInstrs(request.context.paddr);
+        CompiledBlock compiled = Compile(request.context, std::span(request.instrs).first(num_instrs));
+        compiled.instrs = request.instrs;
+        compiled.request_time = request.request_time;
+        std::lock_guard lock{ compile_queue_mutex };
+        compiled_blocks.push_back(std::move(compiled));
+        compiled_blocks_ready.store(true, std::memory_order_release);
+    }
 }
 
 void Cop3Jit()
@@ -162,65 +572,215 @@ void Cop3Jit()
     c.bt(JitPtr(vr4300::cop0.status), 31); // cu3
     c.jc(l0);
     c.mov(host_gpr_arg[0].r32(), 3);
-    BlockEpilogWithPcFlushAndJmp((void*)CoprocessorUnusableException);
+    BlockEpilogWithException((void*)CoprocessorUnusableException);
     c.bind(l0);
-    BlockEpilogWithPcFlushAndJmp((void*)ReservedInstructionException);
-    // compiler_exception_occurred = true; // TODO
+    BlockEpilogWithException((void*)ReservedInstructionException);
+    branched = true;
 }
 
 void EmitBranchCheck()
 {
     Label l_nobranch = c.newLabel();
-    c.cmp(JitPtr(branch_state), BranchState::Perform);
+    c.cmp(JitPtr(branch_state), BranchState::DelaySlotTaken);
     c.jne(l_nobranch);
-    BlockEpilogWithJmp((void*)PerformBranch);
+    if (static_branch_target) {
+        c.mov(JitPtr(branch_state), BranchState::NoBranch);
+        if (block_is_idle_loop && *static_branch_target == compile_context.vaddr) {
+            BlockEpilogWithIdleLoopSkip();
+        } else if (block_is_loop && *static_branch_target == compile_context.vaddr && reg_alloc.CanEndLoop()) {
+            EmitLoopBackEdge();
+        } else {
+            BlockEpilogWithLink(*static_branch_target);
+        }
+    } else {
+        BlockEpilogWithDispatch((void*)PerformBranch);
+    }
     c.bind(l_nobranch);
-    c.mov(JitPtr(branch_state), BranchState::NoBranch);
+    if (!fold_branch_state) {
+        c.mov(JitPtr(branch_state), BranchState::NoBranch);
+    }
 }
 
 void EmitBranchDiscarded()
 {
-    c.mov(JitPtr(branch_state), BranchState::NoBranch);
-    BlockEpilogWithPcFlush(8);
+    if (!fold_branch_state) {
+        c.mov(JitPtr(branch_state), BranchState::NoBranch);
+    }
+    BlockEpilogWithLink(jit_pc + 8);
 }
 
+// With the branch state folded, the state stays NoBranch when the branch is not taken. The jump address of a taken
+// branch is then never read either, as the branch check at the end of the block links to the static target.
 void EmitBranchNotTaken()
 {
-    c.mov(JitPtr(branch_state), BranchState::DelaySlotNotTaken);
+    if (!fold_branch_state) {
+        c.mov(JitPtr(branch_state), BranchState::DelaySlotNotTaken);
+    }
 }
 
 void EmitBranchTaken(u64 target)
 {
     c.mov(JitPtr(branch_state), BranchState::DelaySlotTaken);
-    c.mov(rax, target);
-    c.mov(JitPtr(jump_addr), rax);
+    if (!fold_branch_state) {
+        c.mov(rax, target);
+        c.mov(JitPtr(jump_addr), rax);
+    }
+    // The target can only be linked to if it is the only one that the branch check at the end of the block can see.
+    // This is not the case e.g. if a branch is placed in the delay slot of another.
+    if (++num_taken_branch_sites == 1) {
+        static_branch_target = target;
+    } else {
+        static_branch_target = {};
+    }
 }
 
 void EmitBranchTaken(HostGpr64 target)
 {
     c.mov(JitPtr(branch_state), BranchState::DelaySlotTaken);
     c.mov(JitPtr(jump_addr), target);
+    ++num_taken_branch_sites;
+    static_branch_target = {};
+}
+
+// Entered with a jmp from a block epilog, in place of a return to RunRecompiler. If there are cycles left to run and
+// the pc hits in the dispatch cache, the cached block is entered directly.
+void EmitDispatchStub()
+{
+    auto StubPtr = [](auto const& obj, u32 ptr_size = 0) {
+        s32 offset = s32(get_offset_to_guest_gpr_base_ptr(&obj));
+        return ptr(host_gpr_arg[0], offset, ptr_size ? ptr_size : u32(sizeof(obj)));
+    };
+    CodeHolder stub_code;
+    stub_code.init(Environment::host(), CpuInfo::host().features());
+    x86::Assembler a(&stub_code);
+    Label l_miss = a.newLabel();
+    a.mov(host_gpr_arg[0], reinterpret_cast<u64>(gpr.ptr(16)));
+    a.mov(eax, StubPtr(cycle_counter));
+    a.cmp(eax, StubPtr(cycles_to_run));
+    a.jae(l_miss);
+    a.mov(rax, StubPtr(pc));
+    a.mov(r10d, eax);
+    a.and_(r10d, (dispatch_cache_size - 1) << 2);
+    a.shl(r10d, 3); // index * sizeof(DispatchCacheEntry)
+    a.lea(rdx, StubPtr(dispatch_cache));
+    a.add(rdx, r10);
+    a.cmp(rax, qword_ptr(rdx, offsetof(DispatchCacheEntry, vaddr)));
+    a.jne(l_miss);
+    a.movzx(eax, StubPtr(cop0.entry_hi, 1)); // asid
+    a.mov(r10d, StubPtr(operating_mode));
+    a.shl(r10d, 8);
+    a.or_(eax, r10d);
+    a.cmp(eax, dword_ptr(rdx, offsetof(DispatchCacheEntry, context)));
+    a.jne(l_miss);
+    a.mov(StubPtr(exception_occurred), 0);
+    a.jmp(qword_ptr(rdx, offsetof(DispatchCacheEntry, block)));
+    a.bind(l_miss);
+    a.ret();
+    dispatch_stub = code_cache.add(stub_code);
+    if (!dispatch_stub) {
+        FATAL("Failed to add dispatch stub to the code cache");
+    }
+}
+
+// Leaves the block if the conditional branch whose delay slot has just been emitted was taken. The branches that
+// follow are checked on their own, so the record of taken branch sites starts over.
+void EmitSideExit()
+{
+    EmitBranchCheck();
+    block_has_branch_instr = false;
+    num_taken_branch_sites = 0;
+    static_branch_target = {};
+}
+
+// Jumps back to the start of a block that loops to itself, instead of leaving it and entering it again through its
+// link, as long as the cycle budget of the run lasts. The budget is checked on every iteration, so that the scheduler
+// still gets to process its events (and raise interrupts) on time.
+void EmitLoopBackEdge()
+{
+    assert(block_cycles > 0);
+    c.mov(eax, JitPtr(cycle_counter));
+    c.add(eax, block_cycles);
+    c.mov(JitPtr(cycle_counter), eax);
+    c.add(JitPtr(cop0.count), block_cycles);
+    c.cmp(eax, JitPtr(cycles_to_run));
+    Label l_exit = c.newLabel();
+    c.jae(l_exit);
+    reg_alloc.EndLoop();
+    c.jmp(loop_head);
+    Section* hot_section = ColdCodeBegin();
+    c.bind(l_exit);
+    SetPc(compile_context.vaddr);
+    reg_alloc.BlockEpilog();
+    ColdCodeEnd(hot_section);
 }
 
-bool EmitInstruction()
+// Emits an ALU instruction whose result the IR passes have determined, without going through its emitter. Returns
+// false if the instruction has to be emitted as usual.
+bool EmitFromIr(IrInstr const& instr)
+{
+    if (instr.op != IrOp::Alu || instr.may_exit || instr.dst == IrInstr::none) {
+        return false;
+    }
+    if (instr.dead) {
+        ++recompiler_stats.ir_dead_writes_eliminated;
+        return true;
+    }
+    IrValue const& dst = ir_block.Value(instr.dst);
+    if (dst.constant) {
+        Gpq hd = reg_alloc.GetDirtyGpr(dst.gpr);
+        if (*dst.constant == 0) {
+            c.xor_(hd.r32(), hd.r32());
+        } else {
+            c.mov(hd, *dst.constant);
+        }
+        ++recompiler_stats.ir_constants_materialized;
+        return true;
+    }
+    if (instr.copy_of != IrInstr::none) {
+        u8 src_gpr = ir_block.Value(instr.copy_of).gpr;
+        if (src_gpr != dst.gpr) {
+            Gpq hd = reg_alloc.GetDirtyGpr(dst.gpr), hs = reg_alloc.GetGpr(src_gpr);
+            c.mov(hd, hs);
+        }
+        return true;
+    }
+    return false;
+}
+
+void EmitInstruction()
 {
     block_cycles++;
-    last_instr_was_branch = false;
-    bool got_exception = false; // TODO
-    u32 instr = FetchInstruction(jit_pc);
-    if (got_exception) {
-        return got_exception; // todo: handle this. need to compile exception handling
+    last_emitted_instr_was_branch = false;
+    std::span<IrInstr const> ir_instrs = ir_block.Instrs();
+    u32 ir_index = u32(jit_pc - compile_context.vaddr) / 4;
+    current_ir_instr = ir_index < ir_instrs.size() ? &ir_instrs[ir_index] : nullptr;
+    reg_alloc.BeginInstruction(ir_index);
+    u32 instr = current_ir_instr ? current_ir_instr->word : FetchBlockInstruction(jit_pc);
+    if (current_ir_instr && current_ir_instr->op == IrOp::Branch) {
+        fold_branch_state = ir_block.CanFoldBranchState(ir_index);
     }
-    decode_and_emit_cpu(instr);
-    if (got_exception) {
-        return got_exception;
+    if (!current_ir_instr || !EmitFromIr(*current_ir_instr)) {
+        decode_and_emit_cpu(instr);
     }
+    current_ir_instr = nullptr;
     jit_pc += 4;
-    block_has_branch_instr |= last_instr_was_branch;
+    block_has_branch_instr |= last_emitted_instr_was_branch;
     if constexpr (log_cpu_jit_register_status) {
         jit_logger.log(reg_alloc.GetStatus().c_str());
     }
-    return got_exception;
+}
+
+// Leaves the block for the exception vector if the function just called raised an exception. The check is a single
+// compare and branch; the exit itself is placed out of line.
+void EmitExceptionCheck()
+{
+    Label l_exception = c.newLabel();
+    c.cmp(JitPtr(exception_occurred), 0);
+    c.jne(l_exception);
+    Section* hot_section = ColdCodeBegin();
+    c.bind(l_exception);
+    BlockEpilogToExceptionVector();
+    ColdCodeEnd(hot_section);
 }
 
 void EmitLink(u32 reg)
@@ -229,54 +789,293 @@ void EmitLink(u32 reg)
     c.mov(gp, jit_pc + 8);
 }
 
-void FinalizeBlock(Block& block)
+// The instruction at 'vaddr' in the block being compiled. Fetched by its physical address, as a fetch through the MMU
+// would go through the icache model, and raise its exceptions, at compile time. Blocks do not cross pages, so the
+// translation of the first instruction, made before the block is looked up, holds for all of them.
+u32 FetchBlockInstruction(u64 vaddr)
 {
-    c.endFunc();
-    asmjit::Error err = c.finalize();
-    if (err) {
-        FATAL("Failed to finalize code block; returned {}", asmjit::DebugUtils::errorAsString(err));
+    u32 index = u32(vaddr - compile_context.vaddr) / 4;
+    if (block_instrs.empty()) {
+        return memory::Read<s32>(compile_context.paddr + index * 4);
     }
-    err = jit_runtime.add(&block, &code_holder);
-    if (err) {
-        FATAL("Failed to add code to asmjit runtime! Returned {}", err);
+    assert(index < block_instrs.size());
+    return block_instrs[index];
+}
+
+// The assembler is detached from the code holder, which may then be placed on the emulation thread while the next
+// block is compiled.
+void FinalizeBlock()
+{
+    code_holder->detach(&c);
+}
+
+// Discards all compiled code at once, when either the pool allocator or the code cache is exhausted. Finding blocks
+// to evict would cost more than recompiling the few that are still hot.
+void FlushCodeCache()
+{
+    std::unique_lock lock{ pools_mutex };
+    for (Pool*& pool : pools) {
+        if (pool) {
+            pool = nullptr;
+            ++recompiler_stats.pools_released;
+        }
     }
+    allocator.reset();
+    block_variants.clear();
+    lock.unlock();
+    incoming_links.clear();
+    outgoing_link_pools.clear();
+    spanning_block_pools.clear();
+    num_fastmem_sites.store(0, std::memory_order_release);
+    code_page_bitmap = {};
+    code_cache.flush();
+    EmitDispatchStub();
+    recompiler_stats.code_cache_bytes_used = code_cache.used();
+    FlushDispatchCache();
+    ++recompiler_stats.code_cache_flushes;
+}
+
+void FlushDispatchCache()
+{
+    if (cpu_impl == CpuImpl::Recompiler) {
+        dispatch_cache.fill({ .vaddr = invalid_dispatch_vaddr, .context = 0, .block = nullptr });
+    }
+}
+
+std::optional<s64> GetConstantGpr(u32 gpr)
+{
+    if (gpr == 0) {
+        return 0;
+    }
+    if (current_ir_instr) {
+        for (u32 src : current_ir_instr->src) {
+            if (src != IrInstr::none && ir_block.Value(src).gpr == gpr) {
+                return ir_block.Value(src).constant;
+            }
+        }
+    }
+    return {};
 }
 
 void FlushPc(int pc_offset)
 {
-    u64 new_pc = jit_pc + pc_offset;
-    s64 new_pc_diff = new_pc - pc;
-    if (std::in_range<s32>(new_pc_diff)) {
-        c.add(JitPtr(pc), new_pc_diff);
-    } else {
-        c.mov(rax, new_pc);
-        c.mov(JitPtr(pc), rax);
+    SetPc(jit_pc + pc_offset);
+}
+
+// The slot holding the block compiled for 'paddr' under the given mode, or null if there is no such block. Called
+// from the compile thread with 'pools_mutex' held, or from the emulation thread.
+BlockSlot* FindBlockSlot(u32 paddr, u32 mode_context)
+{
+    u32 pool_index = paddr >> 8 & (num_pools - 1);
+    Pool* pool = pools[pool_index];
+    if (!pool) {
+        return nullptr;
+    }
+    BlockSlot& slot = pool->slots[paddr >> 2 & 63];
+    if (slot.block && slot.mode_context == mode_context) {
+        return &slot;
     }
+    auto variants_it = block_variants.find(pool_index);
+    if (variants_it != block_variants.end()) {
+        for (BlockVariant& variant : variants_it->second) {
+            if (variant.paddr == paddr && variant.slot.block && variant.slot.mode_context == mode_context) {
+                return &variant.slot;
+            }
+        }
+    }
+    return nullptr;
 }
 
-Block& GetBlock(u32 paddr)
+// The slot for the block compiled for 'paddr' under the given mode, which is empty if the block is yet to be compiled.
+// The slot in the pool goes to the first mode that the address is run under; blocks for other modes are kept as
+// variants next to the pool.
+BlockSlot& GetBlockSlot(u32 paddr, u32 mode_context)
 {
     static_assert(std::has_single_bit(num_pools));
-    Pool*& pool = pools[paddr >> 8 & (num_pools - 1)]; // each pool 6 bits, each instruction 2 bits
+    u32 pool_index = paddr >> 8 & (num_pools - 1); // each pool 6 bits, each instruction 2 bits
+    Pool*& pool = pools[pool_index];
     if (!pool) {
-        pool = allocator.acquire<Pool>(); // TODO: check if OOM
+        Pool* acquired = allocator.acquire();
+        if (!acquired) {
+            FlushCodeCache();
+            acquired = allocator.acquire();
+        }
+        std::lock_guard lock{ pools_mutex };
+        pool = acquired;
+        ++recompiler_stats.pools_acquired;
     }
     assert(pool);
-    return pool->blocks[paddr >> 2 & 63];
+    std::lock_guard lock{ pools_mutex };
+    BlockSlot& slot = pool->slots[paddr >> 2 & 63];
+    if (!slot.block || slot.mode_context == mode_context) {
+        slot.mode_context = mode_context;
+        return slot;
+    }
+    std::deque<BlockVariant>& variants = block_variants[pool_index];
+    auto variant_it = std::ranges::find_if(variants, [paddr, mode_context](BlockVariant const& variant) {
+        return variant.paddr == paddr && variant.slot.mode_context == mode_context;
+    });
+    if (variant_it != variants.end()) {
+        return variant_it->slot;
+    }
+    ++recompiler_stats.block_variants;
+    return variants.emplace_back(paddr, BlockSlot{ .block = nullptr, .mode_context = mode_context }).slot;
+}
+
+u32 GetDispatchContext()
+{
+    return u32(cop0.entry_hi.asid) | u32(std::to_underlying(operating_mode)) << 8;
+}
+
+FastmemSite const& GetFastmemSite(size_t index)
+{
+    return fastmem_site_chunks[index / fastmem_sites_per_chunk][index % fastmem_sites_per_chunk];
+}
+
+// Of the block compiled for 'paddr' under the given mode; none if there is no such block yet. Also called from the
+// compile thread.
+u32 GetGprsDeadOnEntry(u32 paddr, u32 mode_context)
+{
+    std::lock_guard lock{ pools_mutex };
+    BlockSlot const* slot = FindBlockSlot(paddr, mode_context);
+    return slot ? slot->gprs_dead_on_entry : 0;
+}
+
+// Only successors in the unmapped kseg0/kseg1 segments are linked to, and only from blocks in these segments. The
+// address translation is then fixed, and the successor is known to be executable in the current (kernel) mode.
+std::optional<u32> GetLinkablePaddr(u64 target)
+{
+    if (IsUnmappedKernelVaddr(compile_context.vaddr) && IsUnmappedKernelVaddr(target) && !(target & 3)) {
+        return u32(target & 0x1FFF'FFFF);
+    } else {
+        return {};
+    }
+}
+
+// The number of instructions that a block starting at 'paddr' may span; see AtBlockEnd
+u32 GetMaxBlockInstrs(u32 paddr)
+{
+    return std::min(max_block_instructions, (code_page_size - (paddr & (code_page_size - 1))) / 4);
+}
+
+// The guest state that the parts of the mode context other than the operating mode are derived from (see
+// OnModeContextChange)
+u64 GetDispatchModeState()
+{
+    constexpr u32 status_mode_mask = 0x3400'00E0; // cu1, cu0, fr, kx, sx, ux
+    u32 fpu_exception_enables = std::bit_cast<u32>(fcr31) >> FCR31BitIndex::EnableInexact & 31;
+    return u64(cop0.status.raw & status_mode_mask) | u64(fpu_exception_enables) << 32;
+}
+
+// The parts of a compile context that do not depend on the location of the block, packed into an integer. Blocks are
+// specialized on it: a block is only run under the mode that it was compiled for, and the same code compiled under
+// another mode is a block of its own (see GetBlockSlot).
+u32 GetModeContext(CompileContext const& context)
+{
+    return u32(std::to_underlying(context.operating_mode)) | u32(context.can_execute_dword_instrs) << 8
+         | u32(context.can_exec_cop0_instrs) << 9 | u32(context.cop1_usable) << 10 | u32(context.fr) << 11
+         | u32(context.fpu_exception_enables) << 12;
 }
 
 Status InitRecompiler()
 {
+    if (!code_cache.base()) {
+        Status status = code_cache.allocate(code_cache_size);
+        if (!status.Ok()) {
+            return status;
+        }
+    }
+    code_cache.flush();
+    num_fastmem_sites.store(0, std::memory_order_release);
+    EmitDispatchStub();
+    recompiler_stats.code_cache_bytes_used = code_cache.used();
+    recompiler_stats.code_cache_capacity = code_cache.capacity();
+    if constexpr (enable_cpu_fastmem && platform.x64) {
+        fastmem_base = rdram::GetPointerToMemory(0);
+        Status status = InstallFastmemFaultHandler();
+        if (!status.Ok()) {
+            return status;
+        }
+    }
     allocator.allocate(64_MiB);
     pools.resize(num_pools, nullptr);
+    dispatch_cache.fill({ .vaddr = invalid_dispatch_vaddr, .context = 0, .block = nullptr });
+    code_page_bitmap = {};
+    dispatch_mode_state = GetDispatchModeState();
+    if constexpr (enable_cpu_jit_tiered_compilation) {
+        if (!compile_thread.joinable()) {
+            compile_thread = std::jthread(CompileThread);
+        }
+    }
     return OkStatus();
 }
 
-void Invalidate(u32 paddr)
+// Makes a block that has just been placed in the code cache reachable through 'slot', its entry in the pool of 'paddr'.
+// The block is registered with the other pools that its instructions extend into, so that it is dropped once any of
+// them is invalidated.
+void InstallBlock(BlockSlot& slot, Block block, u32 paddr, u32 num_instrs, u32 gprs_dead_on_entry)
+{
+    u32 first_pool = paddr >> 8 & (num_pools - 1);
+    {
+        std::lock_guard lock{ pools_mutex };
+        slot.block = block;
+        slot.gprs_dead_on_entry = gprs_dead_on_entry;
+    }
+    u32 last_pool = (paddr + 4 * std::max(num_instrs, 1u) - 1) >> 8 & (num_pools - 1);
+    for (u32 i = first_pool + 1; i <= last_pool; ++i) {
+        std::vector<u32>& start_pools = spanning_block_pools[i];
+        if (!std::ranges::contains(start_pools, first_pool)) {
+            start_pools.push_back(first_pool);
+        }
+    }
+    LinkBlock(block, paddr, slot.mode_context);
+    RegisterFastmemSites(block);
+    SetPageHasCode(paddr, true);
+}
+
+// Installs the blocks finished by the compile thread. A block is discarded if its instructions were modified while it
+// was being compiled; it is then requested again once it is run. A block whose mode was left in the meantime is still
+// installed, for when the mode is entered again.
+void InstallCompiledBlocks()
+{
+    std::vector<CompiledBlock> blocks;
+    {
+        std::lock_guard lock{ compile_queue_mutex };
+        blocks.swap(compiled_blocks);
+        compiled_blocks_ready.store(false, std::memory_order_relaxed);
+    }
+    auto now = std::chrono::steady_clock::now();
+    for (CompiledBlock& compiled : blocks) {
+        u32 paddr = compiled.context.paddr;
+        u32 mode_context = GetModeContext(compiled.context);
+        requested_blocks.erase(u64(mode_context) << 32 | paddr);
+        u64 latency_us = std::chrono::duration_cast<std::chrono::microseconds>(now - compiled.request_time).count();
+        recompiler_stats.compile_latency_total_us += latency_us;
+        recompiler_stats.compile_latency_max_us = std::max(recompiler_stats.compile_latency_max_us, latency_us);
+        ++recompiler_stats.compiles_background;
+        bool modified =
+          std::memcmp(rdram::GetPointerToMemory(paddr), compiled.instrs.data(), compiled.num_instrs * 4) != 0;
+        if (modified) {
+            ++recompiler_stats.compiles_discarded;
+        } else {
+            if (code_cache.available() < max_block_code_size) {
+                FlushCodeCache();
+            }
+            BlockSlot& slot = GetBlockSlot(paddr, mode_context);
+            if (!slot.block) {
+                InstallBlock(slot, PlaceBlock(compiled), paddr, compiled.num_instrs, compiled.gprs_dead_on_entry);
+            }
+        }
+        ReleaseCompiledBlock(compiled);
+    }
+    recompiler_stats.compile_queue_depth = requested_blocks.size();
+}
+
+void InvalidatePool(u32 paddr)
 {
     if (cpu_impl == CpuImpl::Recompiler) {
         assert(paddr < pool_max_addr_excl);
-        ResetPool(pools[paddr >> 8 & (num_pools - 1)]); // each pool 6 bits, each instruction 2 bits
+        ResetPool(paddr >> 8 & (num_pools - 1)); // each pool 6 bits, each instruction 2 bits
     }
 }
 
@@ -285,12 +1084,204 @@ void InvalidateRange(u32 paddr_lo, u32 paddr_hi)
     if (cpu_impl == CpuImpl::Recompiler) {
         assert(paddr_lo <= paddr_hi);
         assert(paddr_hi < pool_max_addr_excl);
-        u32 pool_lo = paddr_lo >> 8;
-        u32 pool_hi = paddr_hi >> 8;
-        for (u32 i = pool_lo; i <= pool_hi; ++i) {
-            ResetPool(pools[i]);
+        // Only visit the pools of pages that hold compiled code
+        for (u32 page_addr = paddr_lo & ~(code_page_size - 1); page_addr <= paddr_hi; page_addr += code_page_size) {
+            if (!PageHasCode(page_addr)) {
+                ++recompiler_stats.invalidations_avoided;
+                continue;
+            }
+            ++recompiler_stats.invalidations_performed;
+            u32 pool_lo = std::max(paddr_lo, page_addr) >> 8;
+            u32 pool_hi = std::min(paddr_hi, page_addr + code_page_size - 1) >> 8;
+            for (u32 i = pool_lo; i <= pool_hi; ++i) {
+                ResetPool(i);
+            }
+        }
+    }
+}
+
+bool IsLinkable(u32 unflushed_gprs, u32 target_paddr, u32 mode_context)
+{
+    return (unflushed_gprs & ~GetGprsDeadOnEntry(target_paddr, mode_context)) == 0;
+}
+
+bool IsUnmappedKernelVaddr(u64 vaddr)
+{
+    return (vaddr >> 30) == 0x3'FFFF'FFFE;
+}
+
+// Links only connect blocks compiled for the same mode, as the mode cannot change on the way through a link
+void LinkBlock(Block block, u32 paddr, u32 mode_context)
+{
+    u32 source_pool = paddr >> 8 & (num_pools - 1);
+    for (LinkSite const& link_site : link_sites) {
+        u8* jmp_site = reinterpret_cast<u8*>(block) + link_site.jmp_site;
+        u32 target_pool = link_site.target_paddr >> 8 & (num_pools - 1);
+        BlockSlot const* target = FindBlockSlot(link_site.target_paddr, mode_context);
+        if (target && IsLinkable(link_site.unflushed_gprs, link_site.target_paddr, mode_context)) {
+            PatchJmp(jmp_site, reinterpret_cast<void const*>(target->block));
+        }
+        incoming_links[target_pool].emplace_back(jmp_site,
+          source_pool,
+          link_site.target_paddr,
+          mode_context,
+          link_site.unflushed_gprs);
+        outgoing_link_pools[source_pool].push_back(target_pool);
+    }
+    link_sites.clear();
+
+    auto links_it = incoming_links.find(source_pool);
+    if (links_it != incoming_links.end()) {
+        for (BlockLink const& link : links_it->second) {
+            if (link.target_paddr == paddr && link.mode_context == mode_context
+                && IsLinkable(link.unflushed_gprs, paddr, mode_context)) {
+                PatchJmp(link.jmp_site, reinterpret_cast<void const*>(block));
+            }
+        }
+    }
+}
+
+// Installs the block stored in the persistent cache for the pc, in place of compiling it. Returns false if there is
+// no usable one.
+bool LoadPersistedBlock(BlockSlot& slot, u32 paddr)
+{
+    if (!IsPersistentCacheOpen() || !IsUnmappedKernelVaddr(pc)) {
+        return false;
+    }
+    PersistentBlock const* persisted = FindPersistentBlock(pc, paddr, slot.mode_context);
+    if (!persisted) {
+        return false;
+    }
+    u8* code = static_cast<u8*>(code_cache.add(persisted->code));
+    if (!code) {
+        return false;
+    }
+    recompiler_stats.code_cache_bytes_used = code_cache.used();
+    if (!ApplyHostRelocs(std::span(code, persisted->code.size()), persisted->relocs, dispatch_stub)) {
+        return false; // the copied code is left unused until the next flush
+    }
+    link_sites = persisted->links;
+    fastmem_site_offsets = persisted->fastmem_sites;
+    InstallBlock(slot, reinterpret_cast<Block>(code), paddr, persisted->num_instrs, persisted->gprs_dead_on_entry);
+    return true;
+}
+
+// Called from the access violation handler, so it only reads the published sites, with a binary search. The site is
+// redirected to its slow path for good, as an access that faulted once (e.g. a read of an I/O register) will most
+// likely do so again. The access is then never reached, so the site can stay in the table.
+u8 const* OnFastmemFault(u8 const* fault_pc)
+{
+    u8* base = code_cache.base();
+    if (!base || fault_pc < base || fault_pc >= base + code_cache.capacity()) {
+        return nullptr;
+    }
+    u32 access = u32(fault_pc - base);
+    size_t num_sites = num_fastmem_sites.load(std::memory_order_acquire);
+    size_t lo = 0, hi = num_sites;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (GetFastmemSite(mid).access < access) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
         }
     }
+    if (lo == num_sites || GetFastmemSite(lo).access != access) {
+        return nullptr;
+    }
+    FastmemSite const& site = GetFastmemSite(lo);
+    PatchJmp(base + site.patch_site, base + site.slow_path);
+    ++recompiler_stats.fastmem_backpatches;
+    return base + site.slow_path;
+}
+
+// Writes a 'jmp rel32' over the 5 bytes at 'jmp_site'. Passing the address following the jmp as the target unlinks it.
+void PatchJmp(u8* jmp_site, void const* target)
+{
+    s64 rel = static_cast<u8 const*>(target) - (jmp_site + 5);
+    if (!std::in_range<s32>(rel)) {
+        return; // the blocks stay unlinked, which is always safe
+    }
+    s32 rel32 = s32(rel);
+    VirtMem::ProtectJitReadWriteScope write_scope(jmp_site, 5);
+    jmp_site[0] = 0xE9;
+    std::memcpy(jmp_site + 1, &rel32, 4);
+}
+
+// Stores the block that has just been compiled in the persistent cache, if it can be relocated and its guest code is
+// in RDRAM, where it can be checked for modification before the block is reused in a later run.
+void PersistBlock(CompiledBlock const& compiled, Block block)
+{
+    if (!IsPersistentCacheOpen() || !IsUnmappedKernelVaddr(compiled.context.vaddr)) {
+        return;
+    }
+    std::optional<u64> code_hash = HashGuestCode(compiled.context.paddr, compiled.num_instrs);
+    if (!code_hash) {
+        return;
+    }
+    u8 const* code = reinterpret_cast<u8 const*>(block);
+    std::optional<std::vector<HostReloc>> relocs = CaptureHostRelocs(*compiled.code, code, dispatch_stub);
+    if (!relocs) {
+        return;
+    }
+    StorePersistentBlock({
+      .vaddr = compiled.context.vaddr,
+      .paddr = compiled.context.paddr,
+      .context = GetModeContext(compiled.context),
+      .num_instrs = compiled.num_instrs,
+      .gprs_dead_on_entry = compiled.gprs_dead_on_entry,
+      .code_hash = *code_hash,
+      .last_use = 0,
+      .code = { code, code + compiled.code->codeSize() },
+      .relocs = std::move(*relocs),
+      .links = link_sites,
+      .fastmem_sites = fastmem_site_offsets,
+    });
+}
+
+// Places the code of a compiled block in the code cache, and resolves the locations of its link and fastmem sites
+Block PlaceBlock(CompiledBlock& compiled)
+{
+    CodeHolder& code = *compiled.code;
+    Block block = reinterpret_cast<Block>(code_cache.add(code));
+    if (!block) {
+        FATAL("Compiled block of {} bytes does not fit in the code cache", code.codeSize());
+    }
+    recompiler_stats.code_cache_bytes_used = code_cache.used();
+    auto label_offset = [&code](Label label) { return u32(code.labelOffsetFromBase(label)); };
+    link_sites.clear();
+    for (PendingBlockLink const& pending_link : compiled.links) {
+        link_sites.emplace_back(label_offset(pending_link.jmp_site),
+          pending_link.target_paddr,
+          pending_link.unflushed_gprs);
+    }
+    fastmem_site_offsets.clear();
+    for (PendingFastmemSite const& pending_site : compiled.fastmem_sites) {
+        fastmem_site_offsets.emplace_back(label_offset(pending_site.patch_site),
+          label_offset(pending_site.access),
+          label_offset(pending_site.slow_path));
+    }
+    if constexpr (enable_cpu_jit_persistent_cache) {
+        PersistBlock(compiled, block);
+    }
+    return block;
+}
+
+// Accounts for the compile time of a block that has been placed or discarded, and recycles its code holder
+void ReleaseCompiledBlock(CompiledBlock& compiled)
+{
+    ++recompiler_stats.compiled_blocks;
+    recompiler_stats.compiled_instrs += compiled.num_instrs;
+    recompiler_stats.compile_time_total_ns += compiled.compile_time_ns;
+    // A reinitialized code holder keeps the memory of its arena, which then need not be allocated for the next block
+    asmjit::Error err = compiled.code->reinit();
+    if (err) {
+        return;
+    }
+    std::lock_guard lock{ compile_queue_mutex };
+    if (free_code_holders.size() < max_free_code_holders) {
+        free_code_holders.push_back(std::move(compiled.code));
+    }
 }
 
 void RecordBlockCycles()
@@ -300,42 +1291,251 @@ void RecordBlockCycles()
     c.add(JitPtr(cop0.count), block_cycles);
 }
 
-void ResetPool(Pool*& pool)
+// Appends the sites of a block that is being installed to those published to the access violation handler. Blocks are
+// bump-allocated from the code cache, so the sites of a block all lie past those of the blocks installed before it, and
+// the table stays sorted. The sites are written before the count that makes them visible.
+void RegisterFastmemSites(Block block)
+{
+    std::ranges::sort(fastmem_site_offsets, {}, &FastmemSiteOffsets::access);
+    u32 block_offset = u32(reinterpret_cast<u8 const*>(block) - code_cache.base());
+    size_t num_sites = num_fastmem_sites.load(std::memory_order_relaxed);
+    assert(num_sites == 0 || fastmem_site_offsets.empty()
+           || GetFastmemSite(num_sites - 1).access < block_offset + fastmem_site_offsets.front().access);
+    for (FastmemSiteOffsets const& site : fastmem_site_offsets) {
+        std::unique_ptr<FastmemSite[]>& chunk = fastmem_site_chunks[num_sites / fastmem_sites_per_chunk];
+        if (!chunk) {
+            chunk = std::make_unique_for_overwrite<FastmemSite[]>(fastmem_sites_per_chunk);
+        }
+        chunk[num_sites % fastmem_sites_per_chunk] = {
+            .access = block_offset + site.access,
+            .patch_site = block_offset + site.patch_site,
+            .slow_path = block_offset + site.slow_path,
+        };
+        ++num_sites;
+    }
+    num_fastmem_sites.store(num_sites, std::memory_order_release);
+    fastmem_site_offsets.clear();
+}
+
+// Requests the block at the pc from the compile thread, with a copy of its instructions. Returns false if they are not
+// all in RDRAM, in which case the block has to be compiled right away.
+bool RequestCompile(u32 paddr)
+{
+    CompileContext context = CaptureCompileContext(paddr);
+    u64 request_key = u64(GetModeContext(context)) << 32 | paddr;
+    if (requested_blocks.contains(request_key)) {
+        return true;
+    }
+    u32 num_instrs = GetMaxBlockInstrs(paddr);
+    if (u64(paddr) + num_instrs * 4 > rdram::GetSize()) {
+        return false;
+    }
+    CompileRequest request = {
+        .context = context,
+        .instrs = {},
+        .request_time = std::chrono::steady_clock::now(),
+    };
+    std::memcpy(request.instrs.data(), rdram::GetPointerToMemory(paddr), num_instrs * 4);
+    {
+        std::lock_guard lock{ compile_queue_mutex };
+        compile_requests.push_back(request);
+    }
+    compile_queue_cv.notify_one();
+    requested_blocks.insert(request_key);
+    recompiler_stats.compile_queue_depth = requested_blocks.size();
+    recompiler_stats.compile_queue_depth_max =
+      std::max(recompiler_stats.compile_queue_depth_max, recompiler_stats.compile_queue_depth);
+    return true;
+}
+
+void ResetPool(u32 pool_index)
 {
-    if (pool) {
-        for (Block block : pool->blocks) {
-            if (block) {
-                jit_runtime.release(block);
+    // Blocks that extend into this pool from earlier ones go as well, together with the rest of their pools
+    auto spanning_it = spanning_block_pools.find(pool_index);
+    if (spanning_it != spanning_block_pools.end()) {
+        std::vector<u32> start_pools = std::move(spanning_it->second);
+        spanning_block_pools.erase(spanning_it);
+        for (u32 start_pool : start_pools) {
+            ResetPool(start_pool);
+        }
+    }
+    Pool*& pool = pools[pool_index];
+    if (!pool) {
+        return;
+    }
+    // Links from the blocks of this pool are about to be freed, and links into them must fall back to returning
+    // to RunRecompiler. The latter are kept, so that they can be patched again once their targets are recompiled.
+    auto outgoing_it = outgoing_link_pools.find(pool_index);
+    if (outgoing_it != outgoing_link_pools.end()) {
+        for (u32 target_pool : outgoing_it->second) {
+            auto incoming_it = incoming_links.find(target_pool);
+            if (incoming_it != incoming_links.end()) {
+                std::erase_if(incoming_it->second,
+                  [pool_index](BlockLink const& link) { return link.source_pool == pool_index; });
             }
         }
+        outgoing_link_pools.erase(outgoing_it);
+    }
+    auto incoming_it = incoming_links.find(pool_index);
+    if (incoming_it != incoming_links.end()) {
+        for (BlockLink const& link : incoming_it->second) {
+            PatchJmp(link.jmp_site, link.jmp_site + 5);
+        }
+    }
+    // The code of the blocks stays in the code cache until it is flushed as a whole.
+    {
+        std::lock_guard lock{ pools_mutex };
+        allocator.release(pool);
+        block_variants.erase(pool_index);
         pool = nullptr;
     }
+    ++recompiler_stats.pools_released;
+    FlushDispatchCache();
+    SetPageHasCode(pool_index * bytes_per_pool, false);
 }
 
 u32 RunRecompiler(u32 cycles)
 {
     cycle_counter = 0;
-    while (cycle_counter < cycles) {
+    cycles_to_run = cycles;
+    while (cycle_counter < cycles_to_run) {
+        if constexpr (enable_cpu_jit_tiered_compilation) {
+            if (compiled_blocks_ready.load(std::memory_order_acquire)) {
+                InstallCompiledBlocks();
+            }
+        }
         exception_occurred = false;
-        Block& block = GetBlock(Devirtualize(pc));
-        if (!block) {
-            Compile(block);
+        DispatchCacheEntry& entry = dispatch_cache[pc >> 2 & (dispatch_cache_size - 1)];
+        u32 context = GetDispatchContext();
+        if (entry.vaddr != pc || entry.context != context) {
+            u32 paddr = Devirtualize(pc);
+            if (exception_occurred) {
+                continue;
+            }
+            if (code_cache.available() < max_block_code_size) [[unlikely]] {
+                FlushCodeCache();
+            }
+            CompileContext block_context = CaptureCompileContext(paddr);
+            BlockSlot& slot = GetBlockSlot(paddr, GetModeContext(block_context));
+            if (!slot.block && !LoadPersistedBlock(slot, paddr)) {
+                // With tiered compilation, the code runs in the interpreter until its block has been compiled
+                if (enable_cpu_jit_tiered_compilation && RequestCompile(paddr)) {
+                    InterpretBlock();
+                    continue;
+                }
+                CompiledBlock compiled = Compile(block_context, {});
+                InstallBlock(slot, PlaceBlock(compiled), paddr, compiled.num_instrs, compiled.gprs_dead_on_entry);
+                ReleaseCompiledBlock(compiled);
+            }
+            entry = { .vaddr = pc, .context = context, .block = slot.block };
         }
-        block(gpr.ptr(16));
+        entry.block(gpr.ptr(16));
+    }
+    return cycle_counter - cycles_to_run;
+}
+
+// Entered in place of the jump back to the start of a busy-wait loop. Nothing that the loop reads can change before
+// the next scheduler event, so the cycles up to it are skipped. The run of the CPU ends at the latest at that event,
+// which bounds the skip. VI_V_CURRENT changes every half-line without an event, so a loop polling it must not skip
+// past the next half-line either.
+void SkipIdleLoop()
+{
+    if (!skip_idle_loops) {
+        return;
+    }
+    s64 cycles_left = s64(cycles_to_run) - s64(cycle_counter);
+    s64 cycles_to_skip =
+      std::min({ cycles_left, scheduler::GetCyclesUntilNextEvent(), vi::GetCyclesUntilNextHalfline() });
+    if (cycles_to_skip > 0) {
+        AdvancePipeline(u32(cycles_to_skip));
+        recompiler_stats.idle_cycles_skipped += cycles_to_skip;
+    }
+}
+
+// A page is only marked as free of code once none of its pools hold compiled blocks.
+void SetPageHasCode(u32 paddr, bool has_code)
+{
+    u32 page = paddr / code_page_size & (num_code_pages - 1);
+    if (!has_code) {
+        constexpr u32 pools_per_page = code_page_size / bytes_per_pool;
+        u32 first_pool = paddr / code_page_size * pools_per_page;
+        for (u32 i = first_pool; i < first_pool + pools_per_page; ++i) {
+            if (pools[i]) return;
+        }
+    }
+    if (has_code) {
+        code_page_bitmap[page / 64] |= 1_u64 << (page & 63);
+    } else {
+        code_page_bitmap[page / 64] &= ~(1_u64 << (page & 63));
+    }
+}
+
+// The pc is written as an absolute value, as the pc held in memory at this point depends on which of the paths
+// through the block were taken. Addresses in the 32-bit segments fit in a sign-extended imm32.
+void SetPc(u64 new_pc)
+{
+    if (std::in_range<s32>(s64(new_pc))) {
+        c.mov(JitPtr(pc), s32(new_pc));
+    } else {
+        c.mov(rax, new_pc);
+        c.mov(JitPtr(pc), rax);
+    }
+}
+
+// Called after writes to the status register and to fcr31. The dispatch cache is keyed by the ASID and the operating
+// mode only, while the blocks that it holds are specialized on the whole mode context, so it is flushed once anything
+// else that the mode context is derived from changes. Links need no such care, as blocks that change the mode end
+// without one.
+void OnModeContextChange()
+{
+    if (cpu_impl != CpuImpl::Recompiler) {
+        return;
+    }
+    u64 mode_state = GetDispatchModeState();
+    if (mode_state != dispatch_mode_state) {
+        dispatch_mode_state = mode_state;
+        FlushDispatchCache();
     }
-    return cycle_counter - cycles;
 }
 
 void OnReservedInstruction()
 {
-    BlockEpilogWithPcFlushAndJmp((void*)ReservedInstructionException);
-    // compiler_exception_occurred = true; // TODO
+    BlockEpilogWithException((void*)ReservedInstructionException);
+    branched = true;
 }
 
 void TearDownRecompiler()
 {
+    compile_thread = {}; // requests a stop, and joins
+    compile_requests.clear();
+    compiled_blocks.clear();
+    compiled_blocks_ready = false;
+    free_code_holders.clear();
+    requested_blocks.clear();
+    if (log_jit_compile_stats && recompiler_stats.compiled_instrs > 0) {
+        LogInfo("Compiled {} CPU blocks of {} instructions in {:.1f} ms; {:.0f} ns per instruction",
+          recompiler_stats.compiled_blocks,
+          recompiler_stats.compiled_instrs,
+          double(recompiler_stats.compile_time_total_ns) / 1e6,
+          double(recompiler_stats.compile_time_total_ns) / double(recompiler_stats.compiled_instrs));
+    }
+    if constexpr (enable_cpu_fastmem && platform.x64) {
+        UninstallFastmemFaultHandler();
+    }
+    SavePersistentCache();
+    num_fastmem_sites.store(0, std::memory_order_release);
+    for (std::unique_ptr<FastmemSite[]>& chunk : fastmem_site_chunks) {
+        chunk.reset();
+    }
+    code_cache.deallocate();
+    dispatch_stub = nullptr;
     allocator.deallocate();
     pools.clear();
+    code_page_bitmap = {};
+    incoming_links.clear();
+    outgoing_link_pools.clear();
+    spanning_block_pools.clear();
+    block_variants.clear();
 }
 
 } // namespace n64::vr4300
@@ -8,6 +8,8 @@
 #include "status.hpp"
 #include "vr4300.hpp"
 
+#include <array>
+#include <optional>
 #include <type_traits>
 
 #if PLATFORM_A64
@@ -22,31 +24,113 @@
 
 namespace n64::vr4300 {
 
+struct RecompilerStats {
+    u64 block_variants; /* blocks compiled for an address that already has one, under another mode */
+    u64 code_cache_bytes_used;
+    u64 code_cache_capacity;
+    u64 code_cache_flushes;
+    u64 compile_latency_max_us; /* from a block being requested from the compile thread to it being installed */
+    u64 compile_latency_total_us;
+    u64 compile_queue_depth; /* blocks requested from the compile thread and not yet installed */
+    u64 compile_queue_depth_max;
+    u64 compiles_background;
+    u64 compiles_discarded; /* compiled in the background, but modified in the meantime */
+    u64 compile_time_total_ns; /* spent emitting blocks, on either thread */
+    u64 compiled_blocks;
+    u64 compiled_instrs; /* guest instructions; with compile_time_total_ns, gives the compile time per instruction */
+    u64 fastmem_backpatches; /* fastmem accesses that faulted, and were redirected to their slow path for good */
+    u64 idle_cycles_skipped; /* cycles fast-forwarded through in busy-wait loops */
+    u64 ir_constants_materialized; /* ALU instructions emitted as a move of their known result */
+    u64 ir_dead_writes_eliminated; /* ALU instructions not emitted, as their result is overwritten unobserved */
+    u64 invalidations_avoided; /* writes to physical pages holding no compiled code */
+    u64 invalidations_performed;
+    u64 persistent_cache_evictions;
+    u64 persistent_cache_hits; /* blocks loaded from the persistent cache instead of being compiled */
+    u64 persistent_cache_misses;
+    u64 persistent_cache_stale; /* stored blocks whose guest code has since changed */
+    u64 pools_acquired;
+    u64 pools_released;
+};
+
+// The guest state that the emitters bake into the code of a block. It is captured when the block is requested, so
+// that the block can be compiled on the compile thread while the guest runs on. Emitters read it instead of the live
+// guest state.
+struct CompileContext {
+    u64 vaddr;
+    u32 paddr;
+    OperatingMode operating_mode;
+    bool can_execute_dword_instrs;
+    bool can_exec_cop0_instrs;
+    bool cop1_usable; // cop0.status.cu1
+    bool fr; // cop0.status.fr
+    u8 fpu_exception_enables; // fcr31 bits 7-11, from inexact to invalid
+};
+
+constexpr u32 code_page_size = 0x1000;
+constexpr u32 num_code_pages = 0x2000'0000 / code_page_size;
+
+void AddFastmemSite(asmjit::Label patch_site, asmjit::Label access, asmjit::Label slow_path);
 void BlockEpilog();
+void BlockEpilogWithDispatch(void* func);
+void BlockEpilogWithException(void* func, int pc_offset = 0);
 void BlockEpilogWithJmp(void* func);
 void BlockEpilogWithPcFlushAndJmp(void* func, int pc_offset = 0);
 void BlockEpilogWithPcFlush(int pc_offset = 0);
+void BlockEpilogToExceptionVector();
 void BlockProlog();
 bool CheckDwordOpCondJit();
+asmjit::Label ColdBlockEpilogWithException(void* func, int pc_offset = 0);
+asmjit::Section* ColdCodeBegin();
+void ColdCodeEnd(asmjit::Section* hot_section);
 void Cop3Jit();
 void EmitBranchDiscarded();
 void EmitBranchNotTaken();
 void EmitBranchTaken(u64 target);
 void EmitBranchTaken(HostGpr64 target);
+void EmitExceptionCheck();
 void EmitLink(u32 reg);
+void FlushDispatchCache();
 void FlushPc(int pc_offset = 0);
+// The value that the instruction being emitted reads from 'gpr', if it is known at compile time
+std::optional<s64> GetConstantGpr(u32 gpr);
 Status InitRecompiler();
-void Invalidate(u32 paddr);
+void InvalidatePool(u32 paddr);
 void InvalidateRange(u32 paddr_lo, u32 paddr_hi);
+void OnModeContextChange();
 u32 RunRecompiler(u32 cpu_cycles);
+u8 const* OnFastmemFault(u8 const* fault_pc);
 void OnReservedInstruction();
 void TearDownRecompiler();
 
-inline JitCompiler c;
+inline JitAssembler c;
 inline RegisterAllocator reg_alloc{ c, gpr.view(), fpr.view() };
+inline CompileContext compile_context; // of the block being compiled
 inline u64 jit_pc;
 inline u32 block_cycles;
 inline bool branched;
+inline bool last_emitted_instr_was_branch; // kept apart from 'last_instr_was_branch', which the interpreter uses
+inline RecompilerStats recompiler_stats;
+inline u8* fastmem_base; // host address of physical address 0; see rdram.cpp
+
+// Bit n is set if the physical page n holds the code of at least one compiled block. Maintained by the recompiler,
+// so that writes to pages without code do not need to touch the pools at all.
+inline std::array<u64, num_code_pages / 64> code_page_bitmap;
+
+inline bool PageHasCode(u32 paddr)
+{
+    u32 page = paddr / code_page_size & (num_code_pages - 1);
+    return code_page_bitmap[page / 64] >> (page & 63) & 1;
+}
+
+inline void Invalidate(u32 paddr)
+{
+    if (PageHasCode(paddr)) {
+        ++recompiler_stats.invalidations_performed;
+        InvalidatePool(paddr);
+    } else {
+        ++recompiler_stats.invalidations_avoided;
+    }
+}
 
 inline ptrdiff_t get_offset_to_guest_gpr_base_ptr(void const* obj)
 {
@@ -18,14 +18,14 @@ constexpr int register_stack_space = gprs_stack_space + vprs_stack_space;
 
 static_assert(!IsVolatile(guest_gpr_mid_ptr_reg));
 
-RegisterAllocator::RegisterAllocator(JitCompiler& compiler,
+RegisterAllocator::RegisterAllocator(JitAssembler& assembler,
   std::span<s64 const, 32> guest_gprs,
   std::span<s64 const, 32> guest_fprs)
   : state_gpr{ this },
     state_fpr{ this },
     guest_gprs{ guest_gprs },
     guest_fprs{ guest_fprs },
-    c{ compiler },
+    c{ assembler },
     gpr_mid_ptr{ guest_gprs.data() + guest_gprs.size() / 2 },
     fpr_mid_ptr{ guest_fprs.data() + guest_fprs.size() / 2 },
     fp_instructions_used_in_current_block{},
@@ -35,6 +35,32 @@ RegisterAllocator::RegisterAllocator(JitCompiler& compiler,
     state_fpr.FillBindings(reg_alloc_volatile_vprs, reg_alloc_nonvolatile_vprs);
 }
 
+// 'index' is the index of the instruction into the liveness information given to SetGprLiveness
+void RegisterAllocator::BeginInstruction(u32 index)
+{
+    state_gpr.BeginInstruction(index);
+}
+
+// Loads 'gprs' into host registers ahead of a loop back to this point, where they stay across iterations as long as
+// the body of the loop does not need the registers for other values. 'gprs_written' are marked dirty right away, so
+// that they need not be written back at the end of every iteration. Called before the label at the start of the loop
+// is bound.
+void RegisterAllocator::BeginLoop(u32 gprs, u32 gprs_written)
+{
+    for (u32 gpr = 1; gpr < 32; ++gpr) {
+        if (gprs >> gpr & 1) {
+            state_gpr.GetGpr(gpr, gprs_written >> gpr & 1);
+        }
+    }
+    loop_entry = {
+        .gpr_bindings = state_gpr.bindings,
+        .fpr_bindings = state_fpr.bindings,
+        .num_saved_nonvolatiles = used_host_nonvolatiles.size(),
+        .fp_instructions_used = fp_instructions_used_in_current_block,
+        .gpr_stack_space_setup = gpr_stack_space_setup,
+    };
+}
+
 void RegisterAllocator::BlockEpilog()
 {
     state_gpr.FlushAndRestoreAll();
@@ -56,6 +82,18 @@ void RegisterAllocator::BlockEpilog()
     }
 }
 
+void RegisterAllocator::BlockEpilogWithCallAndJmp(void* call_target, void* jmp_target)
+{
+    state_gpr.FlushAndRestoreAll();
+    state_fpr.FlushAndRestoreAll();
+    if constexpr (platform.a64) {}
+    if constexpr (platform.x64) {
+        c.pop(guest_gpr_mid_ptr_reg);
+        jit_call_with_stack_alignment(c, call_target); // only the return address is on the stack at this point
+        c.jmp(jmp_target);
+    }
+}
+
 void RegisterAllocator::BlockEpilogWithJmp(void* func)
 {
     state_gpr.FlushAndRestoreAll();
@@ -67,6 +105,43 @@ void RegisterAllocator::BlockEpilogWithJmp(void* func)
     }
 }
 
+// Expects the flags of a comparison of the cycle counter against the cycle limit to be live; none of the instructions
+// emitted before the 'jae' modify them. The jmp bound to 'link_site' initially falls through to the return, and is
+// later patched by the recompiler to jump straight into the successor block, with the guest gpr pointer as argument.
+// Dirty GPRs in 'gprs_dead_in_successor' that are held in volatile host registers are only written back on the way to
+// the return, as the successor overwrites them before reading them. These GPRs are returned; the jmp may only be
+// patched to enter a block that overwrites all of them.
+u32 RegisterAllocator::BlockEpilogWithLink(asmjit::Label link_site, u32 gprs_dead_in_successor)
+{
+    u32 unflushed_gprs = 0;
+    for (auto const& binding : state_gpr.bindings) {
+        if (binding.Occupied() && binding.dirty && binding.is_volatile && binding.host != host_gpr_arg[0]
+            && gprs_dead_in_successor >> binding.guest.value() & 1) {
+            unflushed_gprs |= 1u << binding.guest.value();
+        } else {
+            state_gpr.Flush(binding, true);
+        }
+    }
+    state_fpr.FlushAndRestoreAll();
+    if constexpr (platform.a64) {}
+    if constexpr (platform.x64) {
+        asmjit::Label l_exit = c.newLabel();
+        c.mov(host_gpr_arg[0], guest_gpr_mid_ptr_reg);
+        c.pop(guest_gpr_mid_ptr_reg);
+        c.jae(l_exit);
+        c.bind(link_site);
+        c.long_().jmp(l_exit); // always encoded as 'jmp rel32' so that it can be patched
+        c.bind(l_exit);
+        for (auto const& binding : state_gpr.bindings) {
+            if (binding.Occupied() && unflushed_gprs >> binding.guest.value() & 1) {
+                c.mov(qword_ptr(host_gpr_arg[0], GetGprMidPtrOffset(binding.guest.value())), binding.host);
+            }
+        }
+        c.ret();
+    }
+    return unflushed_gprs;
+}
+
 void RegisterAllocator::BlockProlog()
 {
     Reset();
@@ -96,11 +171,40 @@ void RegisterAllocator::CallWithStackAlignment(void* func)
     }
 }
 
+// Leaves the allocator state untouched. Meant for out-of-line slow paths, whose state must match that of the fast path
+// they branch off from; the volatile host registers are to be preserved around the call with SaveVolatiles.
+void RegisterAllocator::CallWithoutFlush(void* func) const
+{
+    if (stack_is_16_byte_aligned) {
+        jit_call_no_stack_alignment(c, func);
+    } else {
+        jit_call_with_stack_alignment(c, func);
+    }
+}
+
+// Whether the loop started with BeginLoop can be closed at this point. The stack must be laid out as it was at the
+// start of the loop, i.e. no host register may have been saved since, and no stack space set up.
+bool RegisterAllocator::CanEndLoop() const
+{
+    return loop_entry && used_host_nonvolatiles.size() == loop_entry->num_saved_nonvolatiles
+        && fp_instructions_used_in_current_block == loop_entry->fp_instructions_used
+        && gpr_stack_space_setup == loop_entry->gpr_stack_space_setup;
+}
+
 void RegisterAllocator::DestroyVolatile(HostGpr64 gpr)
 {
     state_gpr.DestroyVolatile(gpr);
 }
 
+// Emits the code preceding the jump back to the start of the loop, which puts the guest registers back into the host
+// registers that they were held in there.
+void RegisterAllocator::EndLoop() const
+{
+    assert(CanEndLoop());
+    state_gpr.Reconcile(loop_entry->gpr_bindings);
+    state_fpr.Reconcile(loop_entry->fpr_bindings);
+}
+
 void RegisterAllocator::FlushGuest(HostGpr64 host, u32 guest)
 {
     assert(guest != 0);
@@ -245,6 +349,7 @@ void RegisterAllocator::Reset()
     state_fpr.Reset();
     fp_instructions_used_in_current_block = false;
     gpr_stack_space_setup = false;
+    loop_entry.reset();
 }
 
 void RegisterAllocator::RestoreHost(HostGpr64 host) const
@@ -309,6 +414,22 @@ void RegisterAllocator::RestoreHost(HostVpr128 host) const
     }
 }
 
+void RegisterAllocator::RestoreVolatiles() const
+{
+    if constexpr (platform.a64) {
+        // TODO
+    }
+    if constexpr (platform.x64) {
+        for (size_t i = 0; i < reg_alloc_volatile_vprs.size(); ++i) {
+            c.vmovdqu(reg_alloc_volatile_vprs[i], xmmword_ptr(x86::rsp, s32(16 * i)));
+        }
+        c.add(x86::rsp, s32(16 * reg_alloc_volatile_vprs.size()));
+        for (auto it = reg_alloc_volatile_gprs.rbegin(); it != reg_alloc_volatile_gprs.rend(); ++it) {
+            c.pop(*it);
+        }
+    }
+}
+
 void RegisterAllocator::SaveHost(HostGpr64 host)
 {
     assert(!IsVolatile(host));
@@ -341,6 +462,30 @@ void RegisterAllocator::SaveHost(HostVpr128 host)
     }
 }
 
+// Stores all volatile host registers on the stack, whether bound to guest registers or not. The number of bytes pushed
+// is a multiple of 16, so the stack alignment is unaffected.
+void RegisterAllocator::SaveVolatiles() const
+{
+    static_assert(reg_alloc_volatile_gprs.size() % 2 == 0);
+    if constexpr (platform.a64) {
+        // TODO
+    }
+    if constexpr (platform.x64) {
+        for (HostGpr64 gpr : reg_alloc_volatile_gprs) {
+            c.push(gpr);
+        }
+        c.sub(x86::rsp, s32(16 * reg_alloc_volatile_vprs.size()));
+        for (size_t i = 0; i < reg_alloc_volatile_vprs.size(); ++i) {
+            c.vmovdqu(xmmword_ptr(x86::rsp, s32(16 * i)), reg_alloc_volatile_vprs[i]);
+        }
+    }
+}
+
+void RegisterAllocator::SetGprLiveness(mips::GprLiveness const* liveness)
+{
+    state_gpr.SetLiveness(liveness);
+}
+
 void RegisterAllocator::SetupFp()
 {
     static_assert(!IsVolatile(guest_fpr_mid_ptr_reg));
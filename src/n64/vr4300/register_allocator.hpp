@@ -1,6 +1,7 @@
 #pragma once
 
 #include "jit_common.hpp"
+#include "mips/gpr_liveness.hpp"
 #include "mips/register_allocator_state.hpp"
 #include "numtypes.hpp"
 #include "platform.hpp"
@@ -8,6 +9,7 @@
 #include <algorithm>
 #include <array>
 #include <concepts>
+#include <optional>
 #include <span>
 #include <stack>
 #include <string>
@@ -169,11 +171,21 @@ class RegisterAllocator {
     using RegisterAllocatorStateFpr =
       mips::RegisterAllocatorState<RegisterAllocator, HostGpr128, reg_alloc_num_vprs, 32>;
 
+    // The state at the start of a loop within the block; see BeginLoop
+    struct LoopEntry {
+        decltype(RegisterAllocatorStateGpr::bindings) gpr_bindings;
+        decltype(RegisterAllocatorStateFpr::bindings) fpr_bindings;
+        size_t num_saved_nonvolatiles;
+        bool fp_instructions_used;
+        bool gpr_stack_space_setup;
+    };
+
     RegisterAllocatorStateGpr state_gpr;
     RegisterAllocatorStateFpr state_fpr;
+    std::optional<LoopEntry> loop_entry;
     std::span<s64 const, 32> guest_gprs;
     std::span<s64 const, 32> guest_fprs;
-    JitCompiler& c;
+    JitAssembler& c;
     s64 const* gpr_mid_ptr;
     s64 const* fpr_mid_ptr;
     s32 allocated_stack;
@@ -193,14 +205,23 @@ class RegisterAllocator {
     std::stack<asmjit::x86::Gpq> used_host_nonvolatiles;
 
 public:
-    RegisterAllocator(JitCompiler& compiler, std::span<s64 const, 32> guest_gprs, std::span<s64 const, 32> guest_fprs);
+    RegisterAllocator(JitAssembler& assembler,
+      std::span<s64 const, 32> guest_gprs,
+      std::span<s64 const, 32> guest_fprs);
 
+    void BeginInstruction(u32 index);
+    void BeginLoop(u32 gprs, u32 gprs_written);
     void BlockEpilog();
+    void BlockEpilogWithCallAndJmp(void* call_target, void* jmp_target);
     void BlockEpilogWithJmp(void* func);
+    u32 BlockEpilogWithLink(asmjit::Label link_site, u32 gprs_dead_in_successor);
     void BlockProlog();
     void Call(void* func);
     void CallWithStackAlignment(void* func);
+    void CallWithoutFlush(void* func) const;
+    bool CanEndLoop() const;
     void DestroyVolatile(HostGpr64 gpr);
+    void EndLoop() const;
     void FlushAll() const;
     void FlushAllVolatile();
     void FlushGuest(HostGpr64 host, u32 guest);
@@ -219,8 +240,11 @@ public:
     void RestoreHost(HostGpr64 host) const;
     void RestoreHost(HostVpr128 host) const;
     void RestoreHosts();
+    void RestoreVolatiles() const;
     void SaveHost(HostGpr64 host);
     void SaveHost(HostVpr128 host);
+    void SaveVolatiles() const;
+    void SetGprLiveness(mips::GprLiveness const* liveness);
     void SetupFp();
     void SetupGprStackSpace();
 };
@@ -48,6 +48,7 @@ inline u64 jump_addr;
 inline s64 lo;
 inline s64 hi;
 inline u32 cycle_counter;
+inline u32 cycles_to_run; /* of the current run of the CPU; cut short by the scheduler when an earlier event is added */
 inline BranchState branch_state{ BranchState::NoBranch };
 inline OperatingMode operating_mode;
 inline bool ll_bit;
@@ -55,5 +56,6 @@ inline bool last_instr_was_load;
 inline bool last_instr_was_branch;
 
 inline CpuImpl cpu_impl;
+inline bool skip_idle_loops; /* fast-forward busy-wait loops detected by the recompiler; set per game */
 
 } // namespace n64::vr4300